@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "access_log.h"
+#include "log_archiver.h"
+
+// 当前线程的缓冲区
+static __thread void* t_access_buffer = NULL;
+
+access_log::access_log() : m_wakeup(0) {
+    m_fd = -1;
+    m_format = COMBINED;
+    m_sample = 1;
+    m_split_bytes = 0;
+    m_file_bytes = 0;
+    m_today = 0;
+    m_part = 0;
+    m_bytes = 0;
+    m_dir[0] = '\0';
+    m_name[0] = '\0';
+    m_file_name[0] = '\0';
+    m_buffers = NULL;
+    m_stop = false;
+}
+
+access_log::~access_log() {
+    if (m_fd < 0) return;
+    // 结束后台线程，剩余的日志会在退出前写入
+    __atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+    m_wakeup.post();
+    pthread_join(m_tid, NULL);
+    close(m_fd);
+}
+
+// 单例模式
+access_log* access_log::get_instance() {
+    static access_log instance;
+    return &instance;
+}
+
+bool access_log::init(const char* file_name, int format, int sample, long long split_bytes) {
+    if (m_fd >= 0) return true;
+    m_format = format;
+    m_sample = sample > 1 ? sample : 1;
+    m_split_bytes = split_bytes > 0 ? split_bytes : 0;
+
+    // 与Log相同，文件名可以带路径，前面加上日期
+    const char* p = strrchr(file_name, '/');
+    if (p == NULL) {
+        m_dir[0] = '\0';
+        snprintf(m_name, sizeof(m_name), "%s", file_name);
+    } else {
+        snprintf(m_name, sizeof(m_name), "%s", p + 1);
+        snprintf(m_dir, sizeof(m_dir), "%.*s", (int)(p - file_name + 1), file_name);
+    }
+
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+    int fd = open_file(&my_tm, 0);
+    if (fd < 0) return false;
+    m_fd = fd;
+
+    if (pthread_create(&m_tid, NULL, worker, this) != 0) {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+int access_log::open_file(const struct tm* tm, int part) {
+    // 文件名格式：路径 + 年_月_日_ + 文件名（+ .part）
+    char full_name[300];
+    if (part > 0) {
+        snprintf(full_name, sizeof(full_name), "%s%d_%02d_%02d_%s.%d", m_dir, tm->tm_year + 1900, tm->tm_mon + 1,
+                 tm->tm_mday, m_name, part);
+    } else {
+        snprintf(full_name, sizeof(full_name), "%s%d_%02d_%02d_%s", m_dir, tm->tm_year + 1900, tm->tm_mon + 1,
+                 tm->tm_mday, m_name);
+    }
+
+    // O_APPEND保证每次write都追加到文件末尾，多个线程各自写入完整的行
+    int fd = open(full_name, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    struct stat st;
+    m_file_bytes = fstat(fd, &st) == 0 ? st.st_size : 0;
+    snprintf(m_file_name, sizeof(m_file_name), "%s", full_name);
+    m_today = tm->tm_mday;
+    m_part = part;
+    return fd;
+}
+
+access_log::buffer* access_log::get_buffer() {
+    if (t_access_buffer) return (buffer*)t_access_buffer;
+
+    buffer* buf = new buffer;
+    buf->data = new char[BUFFER_SIZE];
+    buf->len = 0;
+    buf->seq = 0;
+    buf->lines = 0;
+    buf->sampled_out = 0;
+    buf->ts_sec = 0;
+    buf->ts_len = 0;
+
+    // 加入链表，后台线程从链表头开始遍历
+    m_mutex.lock();
+    buf->next = m_buffers;
+    __atomic_store_n(&m_buffers, buf, __ATOMIC_RELEASE);
+    m_mutex.unlock();
+
+    t_access_buffer = buf;
+    return buf;
+}
+
+// 追加字符串，去掉会破坏格式的字符（引号、反斜杠和控制字符转义为\xhh）
+static char* append_escaped(char* p, char* end, const char* s, int len) {
+    static const char hex[] = "0123456789abcdef";
+    if (!s || len == 0) {
+        if (p < end) *p++ = '-';
+        return p;
+    }
+    for (int i = 0; (len < 0 ? s[i] != '\0' : i < len) && p < end - 4; ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\' || c < 0x20 || c == 0x7f) {
+            *p++ = '\\';
+            *p++ = 'x';
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 15];
+        } else {
+            *p++ = c;
+        }
+    }
+    return p;
+}
+
+// 追加非负整数
+static char* append_uint(char* p, unsigned long long v) {
+    char tmp[24];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n > 0) *p++ = tmp[--n];
+    return p;
+}
+
+int access_log::format(buffer* buf, const record& r, char* line) {
+    // 时间字段每个线程每秒只格式化一次
+    time_t now = time(NULL);
+    if (now != buf->ts_sec) {
+        struct tm my_tm;
+        localtime_r(&now, &my_tm);
+        buf->ts_len = strftime(buf->ts, sizeof(buf->ts), "[%d/%b/%Y:%H:%M:%S %z]", &my_tm);
+        buf->ts_sec = now;
+    }
+
+    // 为数字字段和换行符留出位置，字符串字段超长时截断
+    char* p = line;
+    char* end = line + LINE_SIZE - 128;
+
+    const unsigned char* ip = (const unsigned char*)&r.ip;
+    for (int i = 0; i < 4; ++i) {
+        p = append_uint(p, ip[i]);
+        *p++ = i < 3 ? '.' : ' ';
+    }
+    *p++ = '-';
+    *p++ = ' ';
+    p = append_escaped(p, end, r.user, -1);
+    *p++ = ' ';
+    memcpy(p, buf->ts, buf->ts_len);
+    p += buf->ts_len;
+
+    // 请求行，没有解析出请求行时记为"-"
+    *p++ = ' ';
+    *p++ = '"';
+    if (r.path) {
+        p = append_escaped(p, end, r.method, -1);
+        *p++ = ' ';
+        p = append_escaped(p, end, r.path, r.path_len);
+        *p++ = ' ';
+        p = append_escaped(p, end, r.version, -1);
+    } else {
+        *p++ = '-';
+    }
+    *p++ = '"';
+    *p++ = ' ';
+
+    p = append_uint(p, r.status);
+    *p++ = ' ';
+    if (r.bytes > 0) p = append_uint(p, r.bytes);
+    else *p++ = '-';
+
+    if (m_format == COMBINED) {
+        *p++ = ' ';
+        *p++ = '"';
+        p = append_escaped(p, end, r.referer, -1);
+        *p++ = '"';
+        *p++ = ' ';
+        *p++ = '"';
+        p = append_escaped(p, end, r.agent, -1);
+        *p++ = '"';
+    }
+
+    *p++ = ' ';
+    p = append_uint(p, r.usec > 0 ? r.usec : 0);
+    *p++ = '\n';
+    return p - line;
+}
+
+void access_log::write(const record& r) {
+    if (m_fd < 0) return;
+    buffer* buf = get_buffer();
+
+    // 采样只针对成功的响应，错误总是记录
+    if (m_sample > 1 && r.status < 400 && ++buf->seq % m_sample != 0) {
+        __atomic_fetch_add(&buf->sampled_out, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    char line[LINE_SIZE];
+    int len = format(buf, r, line);
+
+    buf->lock.lock();
+    if (buf->len + len > BUFFER_SIZE) write_out(buf);
+    memcpy(buf->data + buf->len, line, len);
+    buf->len += len;
+    buf->lines++;
+    buf->lock.unlock();
+}
+
+void access_log::write_out(buffer* buf) {
+    if (buf->len == 0) return;
+    // 切换文件时后台线程会等所有缓冲区的锁释放一次之后再关闭旧文件，这里读到的文件描述符一直有效
+    int fd = __atomic_load_n(&m_fd, __ATOMIC_ACQUIRE);
+    const char* p = buf->data;
+    int left = buf->len;
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    __atomic_fetch_add(&m_bytes, buf->len, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m_file_bytes, buf->len, __ATOMIC_RELAXED);
+    buf->len = 0;
+}
+
+void access_log::flush() {
+    for (buffer* buf = __atomic_load_n(&m_buffers, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+        buf->lock.lock();
+        write_out(buf);
+        buf->lock.unlock();
+    }
+}
+
+void access_log::rotate() {
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+
+    int part;
+    if (my_tm.tm_mday != m_today) part = 0;
+    else if (m_split_bytes > 0 && __atomic_load_n(&m_file_bytes, __ATOMIC_RELAXED) >= m_split_bytes) part = m_part + 1;
+    else return;
+
+    int old = m_fd;
+    char old_name[sizeof(m_file_name)];
+    memcpy(old_name, m_file_name, sizeof(old_name));
+    int fd = open_file(&my_tm, part);
+    if (fd < 0) return;  // 打开失败时继续写旧文件
+    __atomic_store_n(&m_fd, fd, __ATOMIC_RELEASE);
+
+    // 各线程只在持有自己缓冲区的锁时使用文件描述符，每把锁都获取一次之后没有线程再使用旧文件
+    for (buffer* buf = __atomic_load_n(&m_buffers, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+        buf->lock.lock();
+        buf->lock.unlock();
+    }
+    close(old);
+    // 切换掉的文件交给后台线程压缩
+    log_archiver::get_instance()->submit(old_name);
+}
+
+void* access_log::worker(void* arg) {
+    ((access_log*)arg)->run();
+    return NULL;
+}
+
+void access_log::run() {
+    while (true) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += FLUSH_INTERVAL * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        m_wakeup.timedwait(ts);
+
+        bool stop = __atomic_load_n(&m_stop, __ATOMIC_ACQUIRE);
+        flush();
+        if (stop) break;
+        rotate();
+    }
+}
+
+void access_log::get_stats(access_stats* stats) {
+    stats->lines = stats->sampled_out = 0;
+    for (buffer* buf = __atomic_load_n(&m_buffers, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+        buf->lock.lock();
+        stats->lines += buf->lines;
+        buf->lock.unlock();
+        stats->sampled_out += __atomic_load_n(&buf->sampled_out, __ATOMIC_RELAXED);
+    }
+    stats->bytes = __atomic_load_n(&m_bytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,119 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lock.h"
+
+// 访问日志：每个完成的响应记录一行，格式为Common/Combined Log Format，末尾追加处理耗时（微秒），
+//   127.0.0.1 - - [19/Oct/2026:16:23:21 +0800] "GET /index.html HTTP/1.1" 200 1234 "-" "curl/8.0" 532
+// 与诊断日志Log相互独立，写入单独的文件。每个线程把格式化好的行追加到自己的缓冲区（只有本线程和后台线程
+// 竞争这把锁，一般不会等待），缓冲区满时由本线程写入文件，否则由后台线程每隔FLUSH_INTERVAL写入，
+// 文件按日期和大小切换。可以按1/sample采样成功的请求，状态码不小于400的响应总是记录
+class access_log {
+public:
+    static const int FLUSH_INTERVAL = 1000;  // 后台线程写入和检查切换文件的间隔（毫秒）
+    static const int BUFFER_SIZE = 64 * 1024;  // 每个线程的缓冲区大小
+    static const int LINE_SIZE = 2048;  // 单行的最大长度，超长的字段被截断
+
+    // 日志格式
+    enum FORMAT {
+        COMMON = 0,  // 客户端地址、用户、时间、请求行、状态码、正文字节数
+        COMBINED  // 在COMMON之后加上Referer和User-Agent
+    };
+
+    // 一个完成的响应，字符串字段可以为NULL（记为"-"）
+    struct record {
+        uint32_t ip;  // 客户端IPv4地址（网络字节序）
+        const char* method;
+        const char* path;  // 请求路径，path_len为-1时以'\0'结尾
+        int path_len;
+        const char* version;
+        const char* user;
+        int status;  // 状态码
+        long long bytes;  // 响应正文的字节数
+        long long usec;  // 从读到请求到响应发送完毕的耗时（微秒）
+        const char* referer;
+        const char* agent;
+    };
+
+    // 统计信息
+    struct access_stats {
+        uint64_t lines;  // 写入的行数
+        uint64_t sampled_out;  // 因为采样没有记录的响应数
+        uint64_t bytes;  // 写入的字节数
+    };
+
+    // 局部静态变量单例模式
+    static access_log* get_instance();
+
+    // 打开日志文件并启动后台线程；sample为采样率（每sample个成功的响应记录一条），split_bytes为单个文件的最大字节数
+    bool init(const char* file_name, int format = COMBINED, int sample = 1, long long split_bytes = 256LL << 20);
+
+    // 是否已经初始化
+    bool enabled() {
+        return m_fd >= 0;
+    }
+
+    // 记录一个完成的响应（线程安全）
+    void write(const record& r);
+
+    // 把所有线程缓冲区中的日志写入文件
+    void flush();
+
+    void get_stats(access_stats* stats);
+
+private:
+    access_log();
+    ~access_log();
+
+    // 每个线程的缓冲区，第一次写日志时创建，之后一直保留
+    struct buffer {
+        mutex lock;  // 本线程和后台线程之间的互斥
+        char* data;
+        int len;
+        uint64_t seq;  // 用于采样的计数，只由所属线程访问
+        uint64_t lines;
+        uint64_t sampled_out;
+        time_t ts_sec;  // 缓存的时间字段对应的秒数
+        char ts[40];  // 缓存的时间字段（[日/月/年:时:分:秒 时区]）
+        int ts_len;
+        buffer* next;  // 所有线程的缓冲区串成链表
+    };
+
+    buffer* get_buffer();
+    // 格式化一行，返回长度
+    int format(buffer* buf, const record& r, char* line);
+    // 把缓冲区的内容写入文件（持有buf->lock）
+    void write_out(buffer* buf);
+    // 按日期打开日志文件，part大于0时文件名加上.part后缀
+    int open_file(const struct tm* tm, int part);
+    // 日期变化或者文件超过大小时切换文件（后台线程调用）
+    void rotate();
+
+    static void* worker(void* arg);
+    void run();
+
+private:
+    int m_fd;  // 当前的日志文件，切换时由后台线程替换
+    int m_format;
+    int m_sample;
+    long long m_split_bytes;
+    long long m_file_bytes;  // 当前文件已经写入的字节数
+    int m_today;  // 当前文件的日期
+    int m_part;  // 当天的第几个文件
+    uint64_t m_bytes;  // 写入的总字节数
+    char m_dir[128];  // 路径名
+    char m_name[128];  // 文件名
+    char m_file_name[300];  // 当前打开的日志文件的完整路径
+
+    mutex m_mutex;  // 保护缓冲区链表
+    buffer* m_buffers;
+    sem m_wakeup;  // 唤醒后台线程
+    bool m_stop;
+    pthread_t m_tid;
+};
+
+#endif
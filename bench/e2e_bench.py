@@ -0,0 +1,286 @@
+#!/usr/bin/env python3
+# 端到端场景测试：在回环地址上启动服务器，用loadgen依次运行固定的场景（小页面、大图片、长连接和短连接、登录和注册），
+# 记录每个场景的吞吐、延迟分位数、服务器的CPU时间和峰值内存，结果写入JSON；指定基线时逐项比较，
+# 有指标退化超过容忍范围（或者场景出现错误）时退出码为1，可以用来判断一次修改让服务器变快还是变慢。
+#
+# 登录和注册需要数据库：
+#   --mysqld 启动一个临时的mysqld作为替身（数据目录在临时目录中，跳过权限检查，服务器默认的账号可以直接连接），
+#            监听服务器连接的端口和socket，测试结束后删除；
+#   不指定时使用服务器配置的数据库，--skip-db跳过这两个场景。
+# 服务器以--doc_root指向仓库中的root目录启动，--server-arg传入其他配置（例如比较不同的触发模式或线程数）。
+#
+# 用法（在仓库根目录下）：
+#   g++ -O2 -I. bench/loadgen.cpp -lpthread -o bench/loadgen
+#   bench/e2e_bench.py --server ./a.out --save base.json                # 记录基线
+#   bench/e2e_bench.py --server ./a.out --baseline base.json --save new.json  # 修改后比较
+import argparse
+import json
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+# 场景：名字、请求路径、loadgen参数，db表示需要数据库
+SCENARIOS = [
+    {"name": "small_html", "path": "/judge.html", "args": ["-c", "64"]},
+    {"name": "small_html_close", "path": "/judge.html", "args": ["-c", "64", "-k"]},
+    {"name": "large_gif", "path": "/loginnew.gif", "args": ["-c", "16"]},
+    {"name": "login_post", "path": "/2CGISQL.cgi", "args": ["-c", "32", "-b", "user=e2e_bench&password=e2e_bench"],
+     "db": True},
+    {"name": "register_post", "path": "/3CGISQL.cgi", "args": ["-c", "32", "-b", "user=r{run}_{n}&password=pw"],
+     "db": True},
+]
+
+# 比较的指标：1表示越大越好，-1表示越小越好
+METRICS = {
+    "rps": 1,
+    "mb_per_s": 1,
+    "p50_us": -1,
+    "p90_us": -1,
+    "p99_us": -1,
+    "p999_us": -1,
+    "cpu_us_per_req": -1,
+    "peak_rss_kb": -1,
+}
+LATENCY_METRICS = ("p50_us", "p90_us", "p99_us", "p999_us")
+
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+
+
+def cpu_seconds(pid):
+    # /proc/pid/stat的第14、15项为进程（所有线程）的用户态和内核态时间
+    with open("/proc/%d/stat" % pid) as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / CLK_TCK
+
+
+def peak_rss_kb(pid):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith("VmHWM:"):
+                return int(line.split()[1])
+    return 0
+
+
+def reset_peak_rss(pid):
+    # 写入5清零VmHWM，之后读到的是这个场景中的峰值（内核不支持时保留整个进程的峰值）
+    try:
+        with open("/proc/%d/clear_refs" % pid, "w") as f:
+            f.write("5")
+    except OSError:
+        pass
+
+
+def wait_port(port, proc, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if proc.poll() is not None:
+            return False
+        try:
+            socket.create_connection(("127.0.0.1", port), 0.2).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def http_request(port, method, path, body=None):
+    # 发送一个短连接请求，返回状态码
+    req = "%s %s HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n" % (method, path)
+    if body is not None:
+        req += "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n%s" % (len(body), body)
+    else:
+        req += "\r\n"
+    s = socket.create_connection(("127.0.0.1", port), 5)
+    try:
+        s.sendall(req.encode())
+        data = s.recv(64)
+    finally:
+        s.close()
+    parts = data.split(b" ")
+    return int(parts[1]) if len(parts) > 1 and parts[1].isdigit() else 0
+
+
+def start_stand_in_db(args, workdir):
+    # 初始化一个空的数据目录并启动mysqld，跳过权限检查，然后建库建表
+    datadir = os.path.join(workdir, "mysql-data")
+    install = shutil.which("mariadb-install-db") or shutil.which("mysql_install_db")
+    if install:
+        cmd = [install, "--no-defaults", "--datadir=" + datadir, "--auth-root-authentication-method=normal"]
+    else:
+        cmd = [args.mysqld, "--no-defaults", "--initialize-insecure", "--datadir=" + datadir]
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    log = open(os.path.join(workdir, "mysqld.log"), "w")
+    proc = subprocess.Popen([args.mysqld, "--no-defaults", "--datadir=" + datadir, "--skip-grant-tables",
+                             "--port=%d" % args.db_port, "--socket=" + args.db_socket,
+                             "--pid-file=" + os.path.join(workdir, "mysqld.pid"), "--bind-address=127.0.0.1"],
+                            stdout=log, stderr=subprocess.STDOUT)
+    if not wait_port(args.db_port, proc, 60):
+        raise RuntimeError("stand-in mysqld did not start, see %s" % log.name)
+
+    client = shutil.which("mariadb") or shutil.which("mysql")
+    sql = ("CREATE DATABASE IF NOT EXISTS %s; "
+           "CREATE TABLE IF NOT EXISTS %s.user(username VARCHAR(50) PRIMARY KEY, passwd VARCHAR(50));"
+           % (args.db_name, args.db_name))
+    subprocess.run([client, "--no-defaults", "--socket=" + args.db_socket, "-uroot", "-e", sql], check=True)
+    return proc
+
+
+def run_loadgen(args, port, scenario, duration, run_id):
+    cmd = [args.loadgen, "-J", "-t", str(args.threads), "-d", str(duration)]
+    cmd += [a.replace("{run}", run_id) for a in scenario["args"]]
+    cmd.append("http://127.0.0.1:%d%s" % (port, scenario["path"]))
+    out = subprocess.run(cmd, check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return json.loads(out.strip().splitlines()[-1])
+
+
+def run_scenario(args, port, server, scenario, run_id):
+    # 预热的结果不记录
+    if args.warmup > 0:
+        run_loadgen(args, port, scenario, args.warmup, run_id + "w")
+
+    reset_peak_rss(server.pid)
+    cpu_before = cpu_seconds(server.pid)
+    r = run_loadgen(args, port, scenario, args.duration, run_id)
+    cpu = cpu_seconds(server.pid) - cpu_before
+
+    # 所有场景都应该成功（注册和登录的结果页面也是200），其他状态码都算错误
+    errors = r["connect_errors"] + r["lost"] + r["status"]["4xx"] + r["status"]["5xx"] + r["status"]["other"]
+    lat = r["latency_us"]
+    return {
+        "requests": r["requests"],
+        "rps": r["rps"],
+        "mb_per_s": r["mb_per_s"],
+        "p50_us": lat["p50"],
+        "p90_us": lat["p90"],
+        "p99_us": lat["p99"],
+        "p999_us": lat["p999"],
+        "max_us": lat["max"],
+        "cpu_seconds": round(cpu, 3),
+        "cpu_us_per_req": round(cpu * 1e6 / r["requests"], 2) if r["requests"] else 0,
+        "peak_rss_kb": peak_rss_kb(server.pid),
+        "status": r["status"],
+        "errors": errors,
+    }
+
+
+def compare(results, baseline, args):
+    # 返回是否有退化
+    failed = False
+    print("\n%-18s %-16s %14s %14s %9s" % ("scenario", "metric", "baseline", "current", "change"))
+    for name, cur in results["scenarios"].items():
+        if cur["errors"]:
+            print("%-18s %-16s %14s %14d %9s  FAIL" % (name, "errors", "", cur["errors"], ""))
+            failed = True
+        base = baseline.get("scenarios", {}).get(name)
+        if not base:
+            continue
+        for metric, direction in METRICS.items():
+            if metric not in base or metric not in cur or not base[metric]:
+                continue
+            tolerance = args.latency_tolerance if metric in LATENCY_METRICS else args.tolerance
+            change = (cur[metric] - base[metric]) / base[metric]
+            worse = -change * direction
+            status = "FAIL" if worse > tolerance else ""
+            failed = failed or worse > tolerance
+            print("%-18s %-16s %14.1f %14.1f %+8.1f%%  %s" % (name, metric, base[metric], cur[metric],
+                                                              change * 100, status))
+    return failed
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    p = argparse.ArgumentParser(description="End-to-end scenario benchmarks for the web server.")
+    p.add_argument("--server", required=True, help="server binary, started as SERVER PORT --doc_root=ROOT")
+    p.add_argument("--server-arg", action="append", default=[],
+                   help="extra server option such as --conn_trigger=LT (repeatable)")
+    p.add_argument("--loadgen", default=os.path.join(here, "loadgen"), help="bench/loadgen binary")
+    p.add_argument("--port", type=int, default=19006)
+    p.add_argument("--duration", type=int, default=10, help="seconds per scenario")
+    p.add_argument("--warmup", type=int, default=2, help="seconds of unrecorded load before each scenario")
+    p.add_argument("--threads", type=int, default=2, help="loadgen threads")
+    p.add_argument("--only", help="comma separated scenario names")
+    p.add_argument("--skip-db", action="store_true", help="skip the login and register scenarios")
+    p.add_argument("--mysqld", help="start a throwaway mysqld as the stand-in database")
+    p.add_argument("--db-port", type=int, default=3306)
+    p.add_argument("--db-socket", default="/var/run/mysqld/mysqld.sock")
+    p.add_argument("--db-name", default="yourdb")
+    p.add_argument("--save", default="e2e_results.json", help="write the results here")
+    p.add_argument("--baseline", help="compare against this results file")
+    p.add_argument("--tolerance", type=float, default=0.10, help="allowed regression of throughput, cpu and rss")
+    p.add_argument("--latency-tolerance", type=float, default=0.30, help="allowed regression of latency percentiles")
+    args = p.parse_args()
+
+    scenarios = [s for s in SCENARIOS if not (args.skip_db and s.get("db"))]
+    if args.only:
+        names = args.only.split(",")
+        scenarios = [s for s in scenarios if s["name"] in names]
+
+    workdir = tempfile.mkdtemp(prefix="e2e_bench_")
+    db = None
+    server = None
+    try:
+        if args.mysqld and any(s.get("db") for s in scenarios):
+            db = start_stand_in_db(args, workdir)
+
+        # 服务器的日志写在当前目录，在临时目录中运行
+        server_log = open(os.path.join(workdir, "server.out"), "w")
+        cmd = [os.path.abspath(args.server), str(args.port), "--doc_root=" + os.path.join(os.path.dirname(here), "root")]
+        if db:
+            cmd += ["--db_port=%d" % args.db_port, "--db_name=" + args.db_name]
+        server = subprocess.Popen(cmd + args.server_arg, cwd=workdir, stdout=server_log, stderr=subprocess.STDOUT)
+        if not wait_port(args.port, server, 30):
+            raise RuntimeError("server did not start, see %s" % server_log.name)
+        if http_request(args.port, "GET", "/judge.html") != 200:
+            raise RuntimeError("GET /judge.html failed, see %s" % server_log.name)
+        if any(s["name"] == "login_post" for s in scenarios):
+            http_request(args.port, "POST", "/3CGISQL.cgi", "user=e2e_bench&password=e2e_bench")
+
+        run_id = "%x" % int(time.time())
+        results = {
+            "meta": {
+                "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+                "commit": subprocess.run(["git", "rev-parse", "--short", "HEAD"], stdout=subprocess.PIPE,
+                                         stderr=subprocess.DEVNULL, universal_newlines=True,
+                                         cwd=here).stdout.strip(),
+                "duration": args.duration,
+                "threads": args.threads,
+                "cpus": os.cpu_count(),
+            },
+            "scenarios": {},
+        }
+        for s in scenarios:
+            r = run_scenario(args, args.port, server, s, run_id)
+            results["scenarios"][s["name"]] = r
+            print("%-18s %10.1f req/s %8.2f MB/s  p50 %8.1f p99 %9.1f p99.9 %9.1f us  cpu %7.1f us/req  "
+                  "rss %7d KB  errors %d" % (s["name"], r["rps"], r["mb_per_s"], r["p50_us"], r["p99_us"],
+                                             r["p999_us"], r["cpu_us_per_req"], r["peak_rss_kb"], r["errors"]))
+            if server.poll() is not None:
+                raise RuntimeError("server exited during %s" % s["name"])
+    finally:
+        for proc in (server, db):
+            if proc and proc.poll() is None:
+                proc.terminate()
+                try:
+                    proc.wait(10)
+                except subprocess.TimeoutExpired:
+                    proc.kill()
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    with open(args.save, "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    print("results written to %s" % args.save)
+
+    failed = any(r["errors"] for r in results["scenarios"].values())
+    if args.baseline:
+        with open(args.baseline) as f:
+            failed = compare(results, json.load(f), args)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,573 @@
+// HTTP负载生成器：每个线程用一个epoll驱动多条长连接（keep-alive），每条连接上可以流水线发送多个请求，
+// 统计完成的请求数、吞吐和延迟分位数，用于替代每个客户端fork一个进程、每个请求新建连接的webbench。
+// 两种模式：
+//   闭环（默认）：每条连接上始终保持depth个未完成的请求，收到响应立即发送下一个，测量最大吞吐；
+//   开环（-r）：按固定速率产生请求，与服务器的响应速度无关，请求的延迟从计划发送的时间算起，
+//     服务器变慢时排队等待发送的时间也计入延迟（修正协调遗漏，coordinated omission）
+// 请求体中的{n}替换为每个请求唯一的序号，可以用于注册不重复的用户名。
+// 编译（在bench目录下，不依赖MySQL）：
+//   g++ -O2 -I.. loadgen.cpp -lpthread -o loadgen
+// 运行：
+//   ./loadgen -c 200 -t 4 -d 30 http://127.0.0.1:9006/judge.html
+//   ./loadgen -c 100 -d 30 -r 20000 http://127.0.0.1:9006/judge.html
+//   ./loadgen -c 50 -d 10 -m POST -b 'user=u{n}&password=pw' http://127.0.0.1:9006/3CGISQL.cgi
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include "histogram.h"
+
+static const int IN_SIZE = 16 * 1024;  // 每条连接的接收缓冲区，响应头部不能超过这个大小
+static const int RETRY_MS = 100;  // 连接失败后重试的间隔
+static const size_t MAX_BACKLOG = 1000000;  // 开环模式下等待发送的请求数上限，超过的记为错误
+
+// 命令行参数
+struct options {
+    int connections;  // 总连接数
+    int threads;  // 线程数
+    int duration;  // 测试时长（秒）
+    int depth;  // 每条连接上流水线的深度
+    double rate;  // 开环模式下每秒的请求数（所有线程合计），0表示闭环
+    bool keep_alive;  // 是否使用长连接，关闭时每个请求新建连接
+    bool json;  // 以JSON格式输出结果（供bench/e2e_bench.py解析）
+    const char* method;
+    const char* body;  // 请求体，可以包含{n}
+    std::string host;
+    std::string port;
+    std::string path;
+};
+
+static options g_opt;
+static struct addrinfo* g_addr;
+static volatile bool g_stop = false;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 一条连接
+struct conn {
+    int fd;
+    bool connected;
+    uint64_t retry_at;  // 连接失败后下次重试的时间
+    std::string out;  // 待发送的请求
+    size_t out_off;  // 已经发送的字节数
+    char in[IN_SIZE + 1];  // 接收缓冲区（多一个字节用于解析头部时的'\0'）
+    int in_len;
+    std::deque<uint64_t> inflight;  // 已经发出、没有收到响应的请求的计划发送时间
+
+    // 响应的解析状态
+    bool in_body;  // 是否正在读取响应正文
+    long long body_left;  // 还没有读取的正文字节数
+    int status;  // 状态码
+    bool close_after;  // 服务器在这个响应之后关闭连接
+};
+
+// 一个线程的连接和统计
+struct worker {
+    int id;
+    pthread_t tid;
+    int epfd;
+    std::vector<conn*> conns;
+    size_t next_conn;  // 开环模式下轮流分配请求的起点
+
+    uint64_t seq;  // 请求序号，用于替换请求体中的{n}
+    double interval;  // 开环模式下本线程两个请求之间的间隔（纳秒）
+    double next_send;  // 开环模式下下一个请求的计划发送时间
+    std::deque<uint64_t> backlog;  // 开环模式下已经到了计划时间、还没有空闲连接可以发送的请求
+
+    histogram latency;  // 延迟（纳秒）
+    uint64_t completed;  // 完成的请求数
+    uint64_t bytes;  // 接收的字节数
+    uint64_t status[6];  // 按状态码的百位统计（1xx-5xx，其他计入第0项）
+    uint64_t connect_errors;  // 连接失败次数
+    uint64_t io_errors;  // 读写出错或者连接被关闭时丢失的请求数
+    uint64_t dropped;  // 开环模式下积压过多丢弃的请求数
+};
+
+// 生成一个请求追加到out
+static void build_request(worker* w, std::string& out) {
+    out += g_opt.method;
+    out += ' ';
+    out += g_opt.path;
+    out += " HTTP/1.1\r\nHost: ";
+    out += g_opt.host;
+    out += g_opt.keep_alive ? "\r\nConnection: keep-alive\r\n" : "\r\nConnection: close\r\n";
+    if (g_opt.body) {
+        // 替换{n}为唯一的序号（线程号在高位，不同线程不会重复）
+        std::string body;
+        char num[32];
+        snprintf(num, sizeof(num), "%d%llu", w->id, (unsigned long long)w->seq++);
+        for (const char* p = g_opt.body; *p; ++p) {
+            if (p[0] == '{' && p[1] == 'n' && p[2] == '}') {
+                body += num;
+                p += 2;
+            } else {
+                body += *p;
+            }
+        }
+        char line[64];
+        snprintf(line, sizeof(line), "Content-Length: %zu\r\n", body.size());
+        out += "Content-Type: application/x-www-form-urlencoded\r\n";
+        out += line;
+        out += "\r\n";
+        out += body;
+    } else {
+        out += "\r\n";
+    }
+}
+
+static void update_events(worker* w, conn* c) {
+    epoll_event ev;
+    ev.data.ptr = c;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    if (!c->connected || c->out_off < c->out.size()) ev.events |= EPOLLOUT;
+    epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void start_connect(worker* w, conn* c) {
+    c->fd = socket(g_addr->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->connected = false;
+    c->in_len = 0;
+    c->in_body = false;
+    if (connect(c->fd, g_addr->ai_addr, g_addr->ai_addrlen) < 0 && errno != EINPROGRESS) {
+        w->connect_errors++;
+        close(c->fd);
+        c->fd = -1;
+        c->retry_at = now_ns() + RETRY_MS * 1000000ULL;
+        return;
+    }
+    epoll_event ev;
+    ev.data.ptr = c;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void fill_closed(worker* w, conn* c);
+
+// 关闭连接，之后重新连接。已经发出、没有收到响应的请求记为丢失；连接没有建立时请求还没有发出，
+// 开环模式下放回积压队列（保留计划发送时间），闭环模式下直接丢弃
+static void reset_conn(worker* w, conn* c, bool error) {
+    if (c->fd >= 0) {
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+    }
+    if (c->connected) {
+        w->io_errors += c->inflight.size();
+    } else if (g_opt.rate > 0) {
+        w->backlog.insert(w->backlog.begin(), c->inflight.begin(), c->inflight.end());
+    }
+    c->inflight.clear();
+    c->out.clear();
+    c->out_off = 0;
+    if (error && !c->connected) {
+        w->connect_errors++;
+        c->retry_at = now_ns() + RETRY_MS * 1000000ULL;
+    } else if (!g_stop) {
+        start_connect(w, c);
+        if (g_opt.rate == 0) fill_closed(w, c);
+    }
+}
+
+// 在连接上发出一个计划在intended时刻发送的请求
+static void send_request(worker* w, conn* c, uint64_t intended) {
+    build_request(w, c->out);
+    c->inflight.push_back(intended);
+}
+
+static void flush_out(worker* w, conn* c) {
+    while (c->out_off < c->out.size()) {
+        ssize_t n = send(c->fd, c->out.data() + c->out_off, c->out.size() - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            reset_conn(w, c, true);
+            return;
+        }
+        c->out_off += n;
+    }
+    if (c->out_off == c->out.size()) {
+        c->out.clear();
+        c->out_off = 0;
+    }
+    update_events(w, c);
+}
+
+// 闭环模式：把连接上未完成的请求补足到流水线深度
+static void fill_closed(worker* w, conn* c) {
+    if (g_stop || c->fd < 0) return;
+    int depth = g_opt.keep_alive ? g_opt.depth : 1;
+    if (c->inflight.size() >= (size_t)depth) return;
+    uint64_t now = now_ns();
+    while (c->inflight.size() < (size_t)depth) send_request(w, c, now);
+    if (c->connected) flush_out(w, c);
+}
+
+// 开环模式：产生到了计划时间的请求，分配给有空位的连接，没有空位的留在积压队列中
+static void dispatch_open(worker* w) {
+    uint64_t now = now_ns();
+    while (w->next_send <= (double)now) {
+        if (w->backlog.size() < MAX_BACKLOG) w->backlog.push_back((uint64_t)w->next_send);
+        else w->dropped++;
+        w->next_send += w->interval;
+    }
+
+    int depth = g_opt.keep_alive ? g_opt.depth : 1;
+    size_t n = w->conns.size();
+    for (size_t k = 0; k < n && !w->backlog.empty(); ++k) {
+        conn* c = w->conns[(w->next_conn + k) % n];
+        if (c->fd < 0) continue;
+        bool added = false;
+        while (!w->backlog.empty() && c->inflight.size() < (size_t)depth) {
+            send_request(w, c, w->backlog.front());
+            w->backlog.pop_front();
+            added = true;
+        }
+        if (added && c->connected) flush_out(w, c);
+    }
+    w->next_conn = (w->next_conn + 1) % n;
+}
+
+// 解析响应头部，返回头部长度，头部不完整返回0，出错返回-1
+static int parse_header(conn* c) {
+    char* end = NULL;
+    for (int i = 3; i < c->in_len; ++i) {
+        if (c->in[i] == '\n' && c->in[i - 1] == '\r' && c->in[i - 2] == '\n' && c->in[i - 3] == '\r') {
+            end = c->in + i + 1;
+            break;
+        }
+    }
+    if (!end) return c->in_len >= IN_SIZE ? -1 : 0;
+    c->in[c->in_len] = '\0';
+    if (strncmp(c->in, "HTTP/1.", 7) != 0) return -1;
+
+    c->status = atoi(c->in + 9);
+    c->body_left = 0;
+    // 请求中带了Connection: close或者HTTP/1.0默认短连接时，服务器在响应之后关闭连接
+    c->close_after = !g_opt.keep_alive || c->in[7] == '0';
+    for (char* line = strstr(c->in, "\r\n") + 2; line < end - 2; line = strstr(line, "\r\n") + 2) {
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            c->body_left = atoll(line + 15);
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            char* v = line + 11;
+            while (*v == ' ') ++v;
+            if (strncasecmp(v, "close", 5) == 0) c->close_after = true;
+        }
+    }
+    return end - c->in;
+}
+
+// 一个响应接收完毕
+static void complete(worker* w, conn* c) {
+    uint64_t now = now_ns();
+    if (!c->inflight.empty()) {
+        w->latency.record(now - c->inflight.front());
+        c->inflight.pop_front();
+    }
+    w->completed++;
+    w->status[c->status >= 100 && c->status < 600 ? c->status / 100 : 0]++;
+}
+
+static void on_readable(worker* w, conn* c) {
+    while (true) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, IN_SIZE - c->in_len, 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            reset_conn(w, c, true);
+            return;
+        }
+        if (n == 0) {
+            // 服务器关闭了连接
+            reset_conn(w, c, !c->inflight.empty());
+            return;
+        }
+        w->bytes += n;
+        c->in_len += n;
+
+        // 依次处理缓冲区中的响应（流水线时可能有多个）
+        int pos = 0;
+        while (pos < c->in_len) {
+            if (!c->in_body) {
+                memmove(c->in, c->in + pos, c->in_len - pos);
+                c->in_len -= pos;
+                pos = 0;
+                int len = parse_header(c);
+                if (len < 0) {
+                    reset_conn(w, c, true);
+                    return;
+                }
+                if (len == 0) break;
+                pos = len;
+                c->in_body = true;
+            }
+            // 正文不需要保存，直接跳过
+            long long take = c->in_len - pos < c->body_left ? c->in_len - pos : c->body_left;
+            pos += take;
+            c->body_left -= take;
+            if (c->body_left > 0) break;
+
+            c->in_body = false;
+            complete(w, c);
+            if (c->close_after) {
+                reset_conn(w, c, false);
+                return;
+            }
+        }
+        if (pos >= c->in_len) c->in_len = 0;
+        else if (pos > 0) {
+            memmove(c->in, c->in + pos, c->in_len - pos);
+            c->in_len -= pos;
+        }
+    }
+    if (g_opt.rate == 0) fill_closed(w, c);
+}
+
+static void on_writable(worker* w, conn* c) {
+    if (!c->connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            reset_conn(w, c, true);
+            return;
+        }
+        c->connected = true;
+    }
+    flush_out(w, c);
+}
+
+static void* run(void* arg) {
+    worker* w = (worker*)arg;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < w->conns.size(); ++i) start_connect(w, w->conns[i]);
+    if (g_opt.rate == 0) {
+        for (size_t i = 0; i < w->conns.size(); ++i) fill_closed(w, w->conns[i]);
+    } else {
+        w->next_send = now_ns();
+    }
+
+    epoll_event events[256];
+    while (!g_stop) {
+        int timeout = 100;
+        if (g_opt.rate > 0) {
+            dispatch_open(w);
+            double wait = (w->next_send - (double)now_ns()) / 1e6;
+            timeout = wait <= 0 ? 0 : (wait < 100 ? (int)wait : 100);
+            if (!w->backlog.empty()) timeout = timeout < 1 ? timeout : 1;
+        }
+        int n = epoll_wait(w->epfd, events, 256, timeout);
+        for (int i = 0; i < n; ++i) {
+            conn* c = (conn*)events[i].data.ptr;
+            if (c->fd < 0) continue;
+            if (events[i].events & EPOLLOUT) on_writable(w, c);
+            if (c->fd >= 0 && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                if (!c->connected) on_writable(w, c);
+                if (c->fd >= 0) on_readable(w, c);
+            }
+        }
+
+        // 重试连接失败的连接
+        uint64_t now = now_ns();
+        for (size_t i = 0; i < w->conns.size(); ++i) {
+            conn* c = w->conns[i];
+            if (c->fd < 0 && c->retry_at <= now) {
+                start_connect(w, c);
+                if (g_opt.rate == 0) fill_closed(w, c);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < w->conns.size(); ++i) {
+        if (w->conns[i]->fd >= 0) close(w->conns[i]->fd);
+    }
+    close(w->epfd);
+    return NULL;
+}
+
+// 解析 http://host[:port][/path]
+static bool parse_url(const char* url) {
+    if (strncmp(url, "http://", 7) != 0) return false;
+    const char* host = url + 7;
+    const char* slash = strchr(host, '/');
+    std::string hostport = slash ? std::string(host, slash - host) : std::string(host);
+    g_opt.path = slash ? slash : "/";
+    size_t colon = hostport.rfind(':');
+    if (colon != std::string::npos) {
+        g_opt.host = hostport.substr(0, colon);
+        g_opt.port = hostport.substr(colon + 1);
+    } else {
+        g_opt.host = hostport;
+        g_opt.port = "80";
+    }
+    return !g_opt.host.empty();
+}
+
+static void usage(const char* prog) {
+    printf("usage: %s [options] http://host:port/path\n"
+           "  -c N      connections (default 100)\n"
+           "  -t N      threads (default 1)\n"
+           "  -d SEC    duration in seconds (default 10)\n"
+           "  -p N      pipeline depth per connection (default 1)\n"
+           "  -r RATE   open loop: requests per second across all threads, latency measured from the\n"
+           "            scheduled send time (default 0: closed loop)\n"
+           "  -k        new connection for every request (Connection: close)\n"
+           "  -m METHOD request method (default GET, POST when -b is given)\n"
+           "  -b BODY   form body, {n} is replaced by a unique request number\n"
+           "  -J        print the results as one JSON object\n",
+           prog);
+}
+
+static void on_alarm(int) {
+    g_stop = true;
+}
+
+int main(int argc, char* argv[]) {
+    g_opt.connections = 100;
+    g_opt.threads = 1;
+    g_opt.duration = 10;
+    g_opt.depth = 1;
+    g_opt.rate = 0;
+    g_opt.keep_alive = true;
+    g_opt.json = false;
+    g_opt.method = NULL;
+    g_opt.body = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:p:r:km:b:Jh")) != -1) {
+        switch (opt) {
+            case 'c': g_opt.connections = atoi(optarg); break;
+            case 't': g_opt.threads = atoi(optarg); break;
+            case 'd': g_opt.duration = atoi(optarg); break;
+            case 'p': g_opt.depth = atoi(optarg); break;
+            case 'r': g_opt.rate = atof(optarg); break;
+            case 'k': g_opt.keep_alive = false; break;
+            case 'm': g_opt.method = optarg; break;
+            case 'b': g_opt.body = optarg; break;
+            case 'J': g_opt.json = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || !parse_url(argv[optind])) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (g_opt.connections <= 0 || g_opt.threads <= 0 || g_opt.duration <= 0 || g_opt.depth <= 0 || g_opt.rate < 0) {
+        printf("connections, threads, duration and depth must be positive\n");
+        return 1;
+    }
+    if (g_opt.threads > g_opt.connections) g_opt.threads = g_opt.connections;
+    if (!g_opt.method) g_opt.method = g_opt.body ? "POST" : "GET";
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(g_opt.host.c_str(), g_opt.port.c_str(), &hints, &g_addr) != 0) {
+        printf("cannot resolve %s\n", g_opt.host.c_str());
+        return 1;
+    }
+
+    // 连接平均分给各个线程，开环的速率同样平均分配
+    std::vector<worker*> workers(g_opt.threads);
+    for (int i = 0; i < g_opt.threads; ++i) {
+        worker* w = new worker();
+        w->id = i;
+        int n = g_opt.connections / g_opt.threads + (i < g_opt.connections % g_opt.threads ? 1 : 0);
+        for (int k = 0; k < n; ++k) {
+            conn* c = new conn();
+            c->fd = -1;
+            w->conns.push_back(c);
+        }
+        if (g_opt.rate > 0) w->interval = 1e9 * g_opt.threads / g_opt.rate;
+        workers[i] = w;
+    }
+
+    if (!g_opt.json) {
+        printf("%s %s%s, %d connections, %d threads, %d s, depth %d, %s\n", g_opt.method, g_opt.host.c_str(),
+               g_opt.path.c_str(), g_opt.connections, g_opt.threads, g_opt.duration,
+               g_opt.keep_alive ? g_opt.depth : 1, g_opt.keep_alive ? "keep-alive" : "new connection per request");
+        if (g_opt.rate > 0) printf("open loop at %.0f req/s\n", g_opt.rate);
+        else printf("closed loop\n");
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGALRM, on_alarm);
+    uint64_t start = now_ns();
+    for (int i = 0; i < g_opt.threads; ++i) pthread_create(&workers[i]->tid, NULL, run, workers[i]);
+    alarm(g_opt.duration);
+    for (int i = 0; i < g_opt.threads; ++i) pthread_join(workers[i]->tid, NULL);
+    double elapsed = (now_ns() - start) / 1e9;
+
+    // 合并所有线程的统计
+    histogram* latency = new histogram;
+    uint64_t completed = 0, bytes = 0, connect_errors = 0, io_errors = 0, dropped = 0, backlog = 0;
+    uint64_t status[6] = {0};
+    for (int i = 0; i < g_opt.threads; ++i) {
+        worker* w = workers[i];
+        latency->merge(w->latency);
+        completed += w->completed;
+        bytes += w->bytes;
+        connect_errors += w->connect_errors;
+        io_errors += w->io_errors;
+        dropped += w->dropped;
+        backlog += w->backlog.size();
+        for (int k = 0; k < 6; ++k) status[k] += w->status[k];
+    }
+
+    if (g_opt.json) {
+        printf("{\"requests\": %llu, \"seconds\": %.3f, \"rps\": %.1f, \"mb_per_s\": %.3f, "
+               "\"status\": {\"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu, \"other\": %llu}, "
+               "\"connect_errors\": %llu, \"lost\": %llu, \"unsent\": %llu, \"dropped\": %llu, "
+               "\"latency_us\": {\"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+               "\"max\": %.1f}}\n",
+               (unsigned long long)completed, elapsed, completed / elapsed, bytes / elapsed / (1 << 20),
+               (unsigned long long)status[2], (unsigned long long)status[3], (unsigned long long)status[4],
+               (unsigned long long)status[5], (unsigned long long)(status[0] + status[1]),
+               (unsigned long long)connect_errors, (unsigned long long)io_errors, (unsigned long long)backlog,
+               (unsigned long long)dropped, latency->mean() / 1e3, latency->percentile(50) / 1e3,
+               latency->percentile(90) / 1e3, latency->percentile(99) / 1e3, latency->percentile(99.9) / 1e3,
+               latency->max() / 1e3);
+        delete latency;
+        freeaddrinfo(g_addr);
+        return 0;
+    }
+
+    printf("%llu requests in %.2f s, %.1f req/s, %.2f MB/s\n", (unsigned long long)completed, elapsed,
+           completed / elapsed, bytes / elapsed / (1 << 20));
+    printf("status 2xx %llu 3xx %llu 4xx %llu 5xx %llu other %llu\n", (unsigned long long)status[2],
+           (unsigned long long)status[3], (unsigned long long)status[4], (unsigned long long)status[5],
+           (unsigned long long)(status[0] + status[1]));
+    printf("errors: connect %llu, lost requests %llu", (unsigned long long)connect_errors,
+           (unsigned long long)io_errors);
+    if (g_opt.rate > 0) printf(", unsent at end %llu, dropped %llu", (unsigned long long)backlog,
+                               (unsigned long long)dropped);
+    printf("\n");
+    printf("latency (us): mean %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n", latency->mean() / 1e3,
+           latency->percentile(50) / 1e3, latency->percentile(90) / 1e3, latency->percentile(99) / 1e3,
+           latency->percentile(99.9) / 1e3, latency->max() / 1e3);
+
+    delete latency;
+    freeaddrinfo(g_addr);
+    return 0;
+}
@@ -0,0 +1,322 @@
+// 核心数据结构和解析函数的微基准测试：定时器链表、阻塞队列、线程池、日志，以及http请求的解析。
+// 每项测试把被测操作重复执行到至少MIN_TIME_NS，输出每次操作的耗时和每秒操作数，参数（如链表长度、线程数）
+// 写在名字后面，例如timer_adjust/10000。日志是单例，每种模式在单独的子进程中测试。
+// http请求解析的测试链接整个http_conn，用mysql_stub目录下的替身代替MySQL客户端库（不访问数据库），
+// 编译（在bench目录下，不需要安装MySQL）：
+//   g++ -O2 -I.. -Imysql_stub micro_bench.cpp ../http_conn.cpp ../startup.cpp ../log.cpp ../log_archiver.cpp ../metrics.cpp
+//       ../latency.cpp ../access_log.cpp ../sql_connection_pool.cpp ../sql_async.cpp ../sql_batch.cpp
+//       ../user_cache.cpp ../session_store.cpp -lpthread -lz -o micro_bench
+// 运行（参数为名字的子串，只运行匹配的测试）：
+//   ./micro_bench
+//   ./micro_bench timer_
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <vector>
+
+#include "lst_timer.h"
+#include "block_queue.h"
+#include "threadpool.h"
+#include "log.h"
+#include "http_conn.h"
+
+static const uint64_t MIN_TIME_NS = 200000000ULL;  // 每项测试至少运行的时间
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 被测函数执行iters次操作，返回测量区间的耗时（纳秒），准备工作不计入
+typedef uint64_t (*bench_fn)(long long iters, int arg);
+
+struct bench {
+    const char* name;
+    bench_fn fn;
+    int arg;
+};
+
+// 逐步增加次数，直到运行时间足够长
+static void run_bench(const bench& b) {
+    long long iters = 1;
+    uint64_t ns = 0;
+    while (true) {
+        ns = b.fn(iters, b.arg);
+        if (ns >= MIN_TIME_NS || iters >= (1LL << 30)) break;
+        // 按目前的速度估计需要的次数，多估计一些，每次至少翻倍、最多放大100倍
+        double scale = ns > 0 ? MIN_TIME_NS * 1.4 / ns : 100;
+        if (scale < 2) scale = 2;
+        if (scale > 100) scale = 100;
+        iters = (long long)(iters * scale);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s/%d", b.name, b.arg);
+    printf("%-28s %12lld %12.1f ns/op %14.0f op/s\n", name, iters, (double)ns / iters, iters * 1e9 / ns);
+    fflush(stdout);
+}
+
+/*------------定时器链表----------*/
+static void timer_cb(client_data*) {}
+
+static client_data g_client;
+
+// 定时器由调用者持有（与服务器中嵌入在连接资源里相同），链表不负责释放
+static util_timer* init_timer(util_timer* t, time_t expire) {
+    t->user_data = &g_client;
+    t->cb_func = timer_cb;
+    t->expire = expire;
+    t->prev = NULL;
+    t->next = NULL;
+    return t;
+}
+
+// 准备工作按超时时间从大到小插入，每次都插在头部，避免准备工作本身是O(n^2)
+
+// 链表中已有n个定时器，插入一个超时时间随机的定时器再删除
+static uint64_t bm_timer_add(long long iters, int n) {
+    sort_timer_lst lst;
+    std::vector<util_timer> timers(n);
+    for (int i = n - 1; i >= 0; --i) lst.add_timer(init_timer(&timers[i], 2 * i));
+    srand(1);
+
+    util_timer timer;
+    uint64_t start = now_ns();
+    for (long long i = 0; i < iters; ++i) {
+        util_timer* t = init_timer(&timer, rand() % (2 * n) | 1);
+        lst.add_timer(t);
+        lst.del_timer(t);
+    }
+    return now_ns() - start;
+}
+
+// 链表中已有n个定时器，随机选一个延长到最晚的超时时间（与服务器收到数据时延长定时器相同，需要移到链表尾部）
+static uint64_t bm_timer_adjust(long long iters, int n) {
+    sort_timer_lst lst;
+    std::vector<util_timer> timers(n);
+    for (int i = n - 1; i >= 0; --i) lst.add_timer(init_timer(&timers[i], i));
+    srand(1);
+    time_t clock = n;
+
+    uint64_t start = now_ns();
+    for (long long i = 0; i < iters; ++i) {
+        util_timer* t = &timers[rand() % n];
+        t->expire = ++clock;
+        lst.adjust_timer(t);
+    }
+    return now_ns() - start;
+}
+
+// 链表中的n个定时器全部到期，一次tick处理完；每次操作为处理一个到期的定时器
+static uint64_t bm_timer_tick(long long iters, int n) {
+    long long rounds = (iters + n - 1) / n;
+    uint64_t total = 0;
+    std::vector<util_timer> timers(n);
+    for (long long r = 0; r < rounds; ++r) {
+        sort_timer_lst lst;
+        for (int i = n; i > 0; --i) lst.add_timer(init_timer(&timers[i - 1], i));
+        uint64_t start = now_ns();
+        lst.tick();
+        total += now_ns() - start;
+    }
+    return total * iters / (rounds * n);
+}
+
+/*------------阻塞队列----------*/
+struct queue_args {
+    block_queue<long>* queue;
+    long long count;
+};
+
+static void* queue_producer(void* arg) {
+    queue_args* a = (queue_args*)arg;
+    for (long long i = 0; i < a->count; ++i) {
+        while (!a->queue->push(i)) sched_yield();  // 队列满时重试
+    }
+    return NULL;
+}
+
+static void* queue_consumer(void* arg) {
+    queue_args* a = (queue_args*)arg;
+    long item;
+    while (a->queue->pop(item) && item >= 0) {
+    }
+    return NULL;
+}
+
+// threads个生产者和threads个消费者通过一个容量为1024的阻塞队列传递iters个元素
+static uint64_t bm_block_queue(long long iters, int threads) {
+    block_queue<long> queue(1024);
+    queue_args producer = {&queue, iters / threads};
+    queue_args consumer = {&queue, 0};
+    std::vector<pthread_t> producers(threads), consumers(threads);
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < threads; ++i) pthread_create(&consumers[i], NULL, queue_consumer, &consumer);
+    for (int i = 0; i < threads; ++i) pthread_create(&producers[i], NULL, queue_producer, &producer);
+    for (int i = 0; i < threads; ++i) pthread_join(producers[i], NULL);
+    // 每个消费者收到一个负数后退出
+    for (int i = 0; i < threads; ++i) {
+        while (!queue.push(-1)) sched_yield();
+    }
+    for (int i = 0; i < threads; ++i) pthread_join(consumers[i], NULL);
+    return now_ns() - start;
+}
+
+/*------------线程池----------*/
+static long long g_jobs_done = 0;
+
+// 只计数的任务，测量线程池本身的开销
+struct job {
+    void process() {
+        __atomic_add_fetch(&g_jobs_done, 1, __ATOMIC_RELAXED);
+    }
+};
+
+// 主线程向有threads个工作线程的线程池提交iters个任务，直到全部执行完毕
+static uint64_t bm_threadpool(long long iters, int threads) {
+    // 线程池没有退出机制，每种线程数只创建一次
+    static threadpool<job>* pools[65] = {NULL};
+    if (!pools[threads]) pools[threads] = new threadpool<job>(threads, 10000);
+    threadpool<job>* pool = pools[threads];
+    static job j;
+
+    __atomic_store_n(&g_jobs_done, 0, __ATOMIC_RELAXED);
+    uint64_t start = now_ns();
+    for (long long i = 0; i < iters; ++i) {
+        while (!pool->append(&j)) sched_yield();  // 队列满时重试
+    }
+    while (__atomic_load_n(&g_jobs_done, __ATOMIC_RELAXED) < iters) sched_yield();
+    return now_ns() - start;
+}
+
+/*------------日志----------*/
+struct log_args {
+    long long count;
+};
+
+static void* log_writer(void* arg) {
+    log_args* a = (log_args*)arg;
+    for (long long i = 0; i < a->count; ++i) {
+        LOG_INFO("deal with the client(%s) fd %d bytes %lld", "192.168.1.100", 17, i);
+    }
+    return NULL;
+}
+
+// threads个线程合计写iters行INFO日志（每次操作为一次LOG_INFO调用），结束后等待写入文件
+static uint64_t bm_log(long long iters, int threads) {
+    log_args args = {iters / threads};
+    std::vector<pthread_t> tids(threads);
+    uint64_t start = now_ns();
+    for (int i = 0; i < threads; ++i) pthread_create(&tids[i], NULL, log_writer, &args);
+    for (int i = 0; i < threads; ++i) pthread_join(tids[i], NULL);
+    Log::get_instance()->flush();
+    return now_ns() - start;
+}
+
+// 日志是单例，每种模式在子进程中初始化并测试
+static void run_log_bench(const char* name, int max_queue_size, bool binary, const char* filter) {
+    static const int threads[] = {1, 4};
+    if (filter && !strstr(name, filter)) return;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        char file[64];
+        snprintf(file, sizeof(file), "/tmp/micro_bench_%s", name);
+        Log::get_instance()->init(file, 8192, 5000000, max_queue_size, binary);
+        for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+            bench b = {name, bm_log, threads[i]};
+            run_bench(b);
+        }
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+/*------------http请求解析----------*/
+// 浏览器发出的请求
+static const char* http_requests[] = {
+    "GET /judge.html HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 "
+    "Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Referer: http://192.168.1.10:9006/\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: sid=0123456789abcdef0123456789abcdef\r\n"
+    "\r\n",
+
+    "POST /2CGISQL.cgi HTTP/1.1\r\n"
+    "Host: 192.168.1.10:9006\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 29\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Origin: http://192.168.1.10:9006\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 "
+    "Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Referer: http://192.168.1.10:9006/log.html\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9\r\n"
+    "\r\n"
+    "user=zhangsan&password=123456",
+};
+
+// 解析一个浏览器请求（0为GET，1为POST登录），包括重置连接状态和把请求拷贝到读缓冲区
+static uint64_t bm_http_parse(long long iters, int which) {
+    static http_conn* conn = new http_conn;
+    const char* request = http_requests[which];
+    int len = strlen(request);
+
+    uint64_t start = now_ns();
+    for (long long i = 0; i < iters; ++i) {
+        if (conn->parse(request, len) != http_conn::GET_REQUEST) {
+            printf("parse error\n");
+            exit(1);
+        }
+    }
+    return now_ns() - start;
+}
+
+int main(int argc, char* argv[]) {
+    const char* filter = argc > 1 ? argv[1] : NULL;
+
+    static const bench benches[] = {
+        {"timer_add", bm_timer_add, 100},
+        {"timer_add", bm_timer_add, 1000},
+        {"timer_add", bm_timer_add, 10000},
+        {"timer_adjust", bm_timer_adjust, 100},
+        {"timer_adjust", bm_timer_adjust, 1000},
+        {"timer_adjust", bm_timer_adjust, 10000},
+        {"timer_tick", bm_timer_tick, 100},
+        {"timer_tick", bm_timer_tick, 10000},
+        {"block_queue", bm_block_queue, 1},
+        {"block_queue", bm_block_queue, 2},
+        {"block_queue", bm_block_queue, 4},
+        {"threadpool_append", bm_threadpool, 1},
+        {"threadpool_append", bm_threadpool, 4},
+        {"threadpool_append", bm_threadpool, 8},
+        {"http_parse", bm_http_parse, 0},
+        {"http_parse", bm_http_parse, 1},
+    };
+
+    printf("%-28s %12s %15s %19s\n", "benchmark", "iterations", "time", "throughput");
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        if (filter && !strstr(benches[i].name, filter)) continue;
+        run_bench(benches[i]);
+    }
+
+    run_log_bench("log_sync", 0, false, filter);
+    run_log_bench("log_async", 1000, false, filter);
+    run_log_bench("log_binary_async", 1000, true, filter);
+    return 0;
+}
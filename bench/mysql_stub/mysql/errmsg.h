@@ -0,0 +1,9 @@
+#ifndef BENCH_MYSQL_STUB_ERRMSG_H
+#define BENCH_MYSQL_STUB_ERRMSG_H
+
+// 客户端错误码（见mysql.h）
+#define CR_UNKNOWN_ERROR 2000
+#define CR_SERVER_GONE_ERROR 2006
+#define CR_SERVER_LOST 2013
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef BENCH_MYSQL_STUB_H
+#define BENCH_MYSQL_STUB_H
+
+// 微基准测试使用的MySQL客户端库替身：只提供服务器代码用到的类型和函数，所有操作都失败（没有数据库）。
+// 用-Imysql_stub编译时代替系统的<mysql/mysql.h>，不需要安装MySQL就可以编译并链接http_conn，
+// 测试其中不访问数据库的部分（请求解析）
+#include <stddef.h>
+
+typedef char my_bool;
+typedef char** MYSQL_ROW;
+typedef struct st_mysql { int fd; } MYSQL;
+typedef struct st_mysql_res { int unused; } MYSQL_RES;
+typedef struct st_mysql_stmt { int unused; } MYSQL_STMT;
+
+enum enum_field_types { MYSQL_TYPE_LONG, MYSQL_TYPE_STRING, MYSQL_TYPE_VAR_STRING };
+enum mysql_option {
+    MYSQL_OPT_CONNECT_TIMEOUT,
+    MYSQL_OPT_READ_TIMEOUT,
+    MYSQL_OPT_WRITE_TIMEOUT,
+    MYSQL_OPT_RECONNECT,
+    MYSQL_OPT_NONBLOCK
+};
+
+typedef struct st_mysql_bind {
+    unsigned long* length;
+    my_bool* is_null;
+    void* buffer;
+    my_bool* error;
+    enum enum_field_types buffer_type;
+    unsigned long buffer_length;
+} MYSQL_BIND;
+
+// 非阻塞接口等待的事件
+#define MYSQL_WAIT_READ 1
+#define MYSQL_WAIT_WRITE 2
+#define MYSQL_WAIT_EXCEPT 4
+#define MYSQL_WAIT_TIMEOUT 8
+
+#define MYSQL_NO_DATA 100
+#define MYSQL_DATA_TRUNCATED 101
+
+static const unsigned int STUB_ERRNO = 2002;  // CR_CONNECTION_ERROR
+static const char* const STUB_ERROR = "mysql stub: no database";
+
+static inline MYSQL* mysql_init(MYSQL*) { return NULL; }
+static inline int mysql_options(MYSQL*, enum mysql_option, const void*) { return 1; }
+static inline MYSQL* mysql_real_connect(MYSQL*, const char*, const char*, const char*, const char*, unsigned int,
+                                        const char*, unsigned long) {
+    return NULL;
+}
+static inline void mysql_close(MYSQL*) {}
+static inline int mysql_ping(MYSQL*) { return 1; }
+static inline int mysql_get_socket(const MYSQL* mysql) { return mysql->fd; }
+static inline unsigned int mysql_get_timeout_value(const MYSQL*) { return 0; }
+static inline unsigned int mysql_errno(MYSQL*) { return STUB_ERRNO; }
+static inline const char* mysql_error(MYSQL*) { return STUB_ERROR; }
+
+static inline my_bool mysql_autocommit(MYSQL*, my_bool) { return 1; }
+static inline my_bool mysql_commit(MYSQL*) { return 1; }
+static inline my_bool mysql_rollback(MYSQL*) { return 1; }
+
+static inline int mysql_query(MYSQL*, const char*) { return 1; }
+static inline int mysql_real_query_start(int* ret, MYSQL*, const char*, unsigned long) {
+    *ret = 1;
+    return 0;
+}
+static inline int mysql_real_query_cont(int* ret, MYSQL*, int) {
+    *ret = 1;
+    return 0;
+}
+static inline MYSQL_RES* mysql_store_result(MYSQL*) { return NULL; }
+static inline MYSQL_RES* mysql_use_result(MYSQL*) { return NULL; }
+static inline int mysql_store_result_start(MYSQL_RES** ret, MYSQL*) {
+    *ret = NULL;
+    return 0;
+}
+static inline int mysql_store_result_cont(MYSQL_RES** ret, MYSQL*, int) {
+    *ret = NULL;
+    return 0;
+}
+static inline MYSQL_ROW mysql_fetch_row(MYSQL_RES*) { return NULL; }
+static inline void mysql_free_result(MYSQL_RES*) {}
+
+static inline MYSQL_STMT* mysql_stmt_init(MYSQL*) { return NULL; }
+static inline int mysql_stmt_prepare(MYSQL_STMT*, const char*, unsigned long) { return 1; }
+static inline my_bool mysql_stmt_bind_param(MYSQL_STMT*, MYSQL_BIND*) { return 1; }
+static inline my_bool mysql_stmt_bind_result(MYSQL_STMT*, MYSQL_BIND*) { return 1; }
+static inline int mysql_stmt_execute(MYSQL_STMT*) { return 1; }
+static inline int mysql_stmt_execute_start(int* ret, MYSQL_STMT*) {
+    *ret = 1;
+    return 0;
+}
+static inline int mysql_stmt_execute_cont(int* ret, MYSQL_STMT*, int) {
+    *ret = 1;
+    return 0;
+}
+static inline int mysql_stmt_store_result(MYSQL_STMT*) { return 1; }
+static inline int mysql_stmt_store_result_start(int* ret, MYSQL_STMT*) {
+    *ret = 1;
+    return 0;
+}
+static inline int mysql_stmt_store_result_cont(int* ret, MYSQL_STMT*, int) {
+    *ret = 1;
+    return 0;
+}
+static inline int mysql_stmt_fetch(MYSQL_STMT*) { return 1; }
+static inline my_bool mysql_stmt_free_result(MYSQL_STMT*) { return 1; }
+static inline my_bool mysql_stmt_close(MYSQL_STMT*) { return 0; }
+static inline unsigned int mysql_stmt_errno(MYSQL_STMT*) { return STUB_ERRNO; }
+static inline const char* mysql_stmt_error(MYSQL_STMT*) { return STUB_ERROR; }
+
+#endif
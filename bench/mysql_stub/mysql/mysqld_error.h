@@ -0,0 +1,7 @@
+#ifndef BENCH_MYSQL_STUB_MYSQLD_ERROR_H
+#define BENCH_MYSQL_STUB_MYSQLD_ERROR_H
+
+// 服务器错误码（见mysql.h）
+#define ER_DUP_ENTRY 1062
+
+#endif
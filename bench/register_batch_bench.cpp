@@ -0,0 +1,105 @@
+// 注册批量写入的吞吐测试：同时挂起concurrency个注册，统计不同批大小下每秒完成的注册数
+// 编译（在bench目录下，一条命令）：
+//   g++ -O2 -I.. register_batch_bench.cpp ../sql_batch.cpp ../sql_async.cpp ../sql_connection_pool.cpp ../log.cpp
+//       ../log_archiver.cpp -lpthread -lmariadb -lz -o register_batch_bench
+// 运行（每次用新的用户名前缀，不会与之前的数据重名）：
+//   for b in 1 2 4 8 16 32 64 128; do ./register_batch_bench localhost root 123456 yourdb 20000 256 $b; done
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <mysql/mysqld_error.h>
+
+#include "../log.h"
+#include "../sql_connection_pool.h"
+#include "../sql_async.h"
+#include "../sql_batch.h"
+
+// 一个挂起的注册，完成后用于提交下一个注册
+struct slot {
+    sql_task task;
+    char name[32];
+    char passwd[16];
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 8) {
+        printf("usage: %s host user passwd db total concurrency batch [max_delay_ms]\n", argv[0]);
+        return 1;
+    }
+    int total = atoi(argv[5]);
+    int concurrency = atoi(argv[6]);
+    int batch = atoi(argv[7]);
+    int delay = argc > 8 ? atoi(argv[8]) : 2;
+    if (total <= 0 || concurrency <= 0 || batch < 1) {
+        printf("total, concurrency and batch must be positive\n");
+        return 1;
+    }
+    if (concurrency > total) concurrency = total;
+
+    Log::get_instance()->init("./BenchLog", 8192, 5000000, 0);
+
+    connection_pool* connPool = connection_pool::GetInstance();
+    connPool->init(argv[1], argv[2], argv[3], argv[4], 3306, 8, 4, 2);
+
+    int epollfd = epoll_create(5);
+    sql_async::get_instance()->init(epollfd, 65535);  // 与服务器max_fd的默认值相同
+    if (!sql_batch::get_instance()->init(connPool, batch, delay)) {
+        printf("start sql batch failed\n");
+        return 1;
+    }
+
+    // 用户名前缀区分每次运行
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "b%x%lx", (unsigned)getpid() & 0xffff, (long)time(NULL) & 0xffffff);
+
+    slot* slots = new slot[concurrency];
+    int sent = 0, finished = 0, dup = 0, failed = 0;
+    double start = now_sec();
+
+    for (int i = 0; i < concurrency; ++i) {
+        memset(&slots[i].task, 0, sizeof(sql_task));
+        slots[i].task.arg = &slots[i];
+        snprintf(slots[i].name, sizeof(slots[i].name), "%s_%d", prefix, sent++);
+        snprintf(slots[i].passwd, sizeof(slots[i].passwd), "pw");
+        sql_batch::get_instance()->submit(&slots[i].task, slots[i].name, slots[i].passwd);
+    }
+
+    epoll_event events[16];
+    while (finished < total) {
+        int number = epoll_wait(epollfd, events, 16, 1000);
+        for (int i = 0; i < number; ++i) {
+            sql_task* task = sql_async::get_instance()->on_event(events[i].data.fd, events[i].events);
+            while (task) {
+                sql_task* next = task->next;
+                ++finished;
+                if (task->err == ER_DUP_ENTRY) ++dup;
+                else if (task->err) ++failed;
+
+                if (sent < total) {
+                    slot* s = (slot*) task->arg;
+                    snprintf(s->name, sizeof(s->name), "%s_%d", prefix, sent++);
+                    sql_batch::get_instance()->submit(task, s->name, s->passwd);
+                }
+                task = next;
+            }
+        }
+    }
+
+    double elapsed = now_sec() - start;
+    printf("batch %d delay %dms: %d registrations in %.3f s, %.0f reg/s (dup %d, failed %d)\n",
+           batch, delay, finished, elapsed, finished / elapsed, dup, failed);
+
+    sql_batch::get_instance()->stop();
+    delete[] slots;
+    close(epollfd);
+    return 0;
+}
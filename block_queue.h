@@ -29,7 +29,7 @@ public:
     void clear() {
         m_mutex.lock();
         m_size = 0;
-        m_front - -1;
+        m_front = -1;
         m_back = -1;
         m_mutex.unlock();
     }
@@ -39,7 +39,7 @@ public:
         m_mutex.lock();
         if (m_size >= m_max_size) {
             m_mutex.unlock();
-            return false;
+            return true;
         }
         m_mutex.unlock();
         return false;
@@ -110,7 +110,7 @@ public:
         m_array[m_back] = item;
         m_size++;
         m_cond.broadcast();
-        m_mutex.lock();
+        m_mutex.unlock();
         return true;
     }
 
@@ -127,7 +127,7 @@ public:
         m_front = (m_front + 1) % m_max_size;
         item = m_array[m_front];  // 传出参数
         m_size--;
-        m_mutex.lock();
+        m_mutex.unlock();
         return true;
     }
 private:
@@ -0,0 +1,173 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+// 分块布隆过滤器（blocked Bloom filter）：每个键只落在一个64字节（一条缓存行）的块内，k个比特都在这个块中，
+// 查询只访问一次内存；块内按8个64位字分别计算掩码再逐字比较，循环固定8次，便于编译器向量化。
+// 返回false表示键一定不存在，返回true表示可能存在（存在误判）。
+// 插入用原子或操作，可以和查询并发进行，不需要加锁；未初始化时查询总是返回true，调用者退回到精确检查
+class bloom_filter {
+public:
+    static const int BLOCK_WORDS = 8;  // 每块8个64位字
+    static const int BLOCK_BITS = BLOCK_WORDS * 64;  // 每块512比特
+    static const int MAX_HASHES = 16;  // 每个键最多设置的比特数
+
+    bloom_filter() : m_blocks(NULL), m_nblocks(0), m_k(0), m_fp_rate(1), m_count(0), m_fp_sum(0) {}
+
+    ~bloom_filter() {
+        free(m_blocks);
+    }
+
+    // 按预计的键个数和目标误判率分配空间，只能在并发使用前调用
+    bool init(uint64_t expected, double fp_rate) {
+        if (expected < 1) expected = 1;
+        if (fp_rate <= 0 || fp_rate >= 1) fp_rate = 0.01;
+
+        // 标准布隆过滤器每个键需要-ln(p)/ln2^2个比特，分块后各块的键数不均匀，误判率更高，
+        // 所以从标准值开始每次增加5%，直到按块内键数的分布估计的误判率达到目标
+        double bits_per_key = -log(fp_rate) / (log(2.0) * log(2.0));
+        int k = hashes_for(bits_per_key);
+        while (blocked_fp(bits_per_key, k) > fp_rate && bits_per_key < 64) {
+            bits_per_key *= 1.05;
+            k = hashes_for(bits_per_key);
+        }
+
+        uint64_t nblocks = (uint64_t)(expected * bits_per_key / BLOCK_BITS) + 1;
+        void* blocks = NULL;
+        if (posix_memalign(&blocks, 64, nblocks * BLOCK_WORDS * sizeof(uint64_t)) != 0) return false;
+        memset(blocks, 0, nblocks * BLOCK_WORDS * sizeof(uint64_t));
+
+        free(m_blocks);
+        m_blocks = (uint64_t*)blocks;
+        m_nblocks = nblocks;
+        m_k = k;
+        m_fp_rate = fp_rate;
+        m_count = 0;
+        for (int set = 0; set <= BLOCK_BITS; ++set) m_block_fp[set] = llround(pow((double)set / BLOCK_BITS, k) * FP_SCALE);
+        m_fp_sum = 0;
+        return true;
+    }
+
+    // 释放空间，回到未初始化状态（之后的查询都返回true），只能在并发使用前调用
+    void clear() {
+        free(m_blocks);
+        m_blocks = NULL;
+        m_nblocks = 0;
+        m_count = 0;
+        m_fp_sum = 0;
+    }
+
+    // 插入一个键（线程安全）
+    void add(const char* key) {
+        if (!m_blocks) return;
+        uint64_t mask[BLOCK_WORDS];
+        uint64_t* block = locate(key, mask);
+        int added = 0;  // 这次新置位的比特数
+        for (int i = 0; i < BLOCK_WORDS; ++i) {
+            if (mask[i]) added += __builtin_popcountll(mask[i] & ~__atomic_fetch_or(&block[i], mask[i], __ATOMIC_RELAXED));
+        }
+        __atomic_fetch_add(&m_count, 1, __ATOMIC_RELAXED);
+        if (!added) return;
+
+        // 增量更新误判率之和：这个块的置位数从set - added变为set（块在同一条缓存行中，重新数一遍很便宜；
+        // 多个线程同时插入同一块时估计会有很小的偏差）
+        int set = 0;
+        for (int i = 0; i < BLOCK_WORDS; ++i) set += __builtin_popcountll(__atomic_load_n(&block[i], __ATOMIC_RELAXED));
+        __atomic_fetch_add(&m_fp_sum, m_block_fp[set] - m_block_fp[set - added], __ATOMIC_RELAXED);
+    }
+
+    // 键是否可能存在
+    bool may_contain(const char* key) const {
+        if (!m_blocks) return true;
+        uint64_t mask[BLOCK_WORDS];
+        const uint64_t* block = locate(key, mask);
+        uint64_t miss = 0;
+        for (int i = 0; i < BLOCK_WORDS; ++i) miss |= mask[i] & ~__atomic_load_n(&block[i], __ATOMIC_RELAXED);
+        return miss == 0;
+    }
+
+    // 按当前各块的置位比例估计的误判率（查询落在每个块的概率相同，对各块的误判率取平均）。
+    // 各块误判率之和在插入时增量维护，这里不需要扫描所有块，可以在主线程中定期调用
+    double estimated_fp() const {
+        if (!m_blocks) return 1;
+        return __atomic_load_n(&m_fp_sum, __ATOMIC_RELAXED) / FP_SCALE / m_nblocks;
+    }
+
+    double target_fp() const { return m_fp_rate; }
+    uint64_t count() const { return __atomic_load_n(&m_count, __ATOMIC_RELAXED); }
+    uint64_t bytes() const { return m_nblocks * BLOCK_WORDS * sizeof(uint64_t); }
+    int hashes() const { return m_k; }
+
+private:
+    // 每个键的比特数对应的最优哈希个数
+    static int hashes_for(double bits_per_key) {
+        int k = (int)(bits_per_key * log(2.0) + 0.5);
+        if (k < 1) k = 1;
+        if (k > MAX_HASHES) k = MAX_HASHES;
+        return k;
+    }
+
+    // 分块布隆过滤器的误判率：块内键数近似服从均值为BLOCK_BITS/bits_per_key的泊松分布，对每种键数的误判率加权求和
+    static double blocked_fp(double bits_per_key, int k) {
+        double lambda = BLOCK_BITS / bits_per_key;
+        double prob = exp(-lambda), fp = 0;
+        for (int n = 0; n < lambda * 4 + 64; ++n) {
+            fp += prob * pow(1 - pow(1 - 1.0 / BLOCK_BITS, (double)k * n), k);
+            prob *= lambda / (n + 1);
+        }
+        return fp;
+    }
+
+    // 64位FNV-1a，再打散
+    static uint64_t hash(const char* key) {
+        uint64_t h = 14695981039346656037ULL;
+        for (const unsigned char* p = (const unsigned char*)key; *p; ++p) {
+            h ^= *p;
+            h *= 1099511628211ULL;
+        }
+        return mix(h);
+    }
+
+    // murmur3的finalizer
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // 高32位选择块，块内的k个比特位置每个取9位（512比特），一个64位值用完后由哈希值生成下一个，按字存入mask
+    uint64_t* locate(const char* key, uint64_t* mask) const {
+        uint64_t h = hash(key);
+        uint64_t index = ((h >> 32) * m_nblocks) >> 32;
+        uint64_t bits = h;
+
+        memset(mask, 0, sizeof(uint64_t) * BLOCK_WORDS);
+        for (int i = 0; i < m_k; ++i) {
+            if (i % 7 == 0) bits = mix(h + (i + 1) * 0x9e3779b97f4a7c15ULL);
+            uint32_t bit = (uint32_t)(bits >> 55);
+            bits <<= 9;
+            mask[bit >> 6] |= (uint64_t)1 << (bit & 63);
+        }
+        return m_blocks + index * BLOCK_WORDS;
+    }
+
+private:
+    uint64_t* m_blocks;  // 按64字节对齐的块数组
+    uint64_t m_nblocks;  // 块数
+    int m_k;  // 每个键设置的比特数
+    double m_fp_rate;  // 初始化时的目标误判率
+    uint64_t m_count;  // 插入的键个数
+
+    static constexpr double FP_SCALE = 4294967296.0;  // 误判率用定点数（乘以2^32）累加，可以用原子加法更新
+    uint64_t m_fp_sum;  // 各块误判率之和（定点数）
+    uint64_t m_block_fp[BLOCK_BITS + 1];  // 块内置位数对应的误判率（定点数），初始化时计算
+};
+
+#endif
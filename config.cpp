@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include "config.h"
+#include "log.h"
+
+static const char* const trigger_names[] = {"LT", "ET", NULL};
+static const char* const log_mode_names[] = {"sync", "async", NULL};
+static const char* const format_names[] = {"common", "combined", NULL};  // 与access_log::COMMON、COMBINED对应
+
+config* config::get_instance() {
+    static config instance;
+    return &instance;
+}
+
+// 原来编译时写死的配置项（max_fd、max_events、timeslot、缓冲区大小、数据库、日志等）默认值不变；listen_backlog从5改为1024，
+// defer_accept默认等待5秒（原来不开启），其余是后来新增的配置项
+config::config()
+    : port(0), listen_trigger(LT), conn_trigger(ET), max_fd(65535), max_conn(0), ip_max_conn(0), ip_rate(0),
+      ip_burst(0), max_events(10000), listen_backlog(1024),
+      accept_batch(64), defer_accept(5), fast_open(0), timeslot(5),
+      read_buffer_size(2048), write_buffer_size(1024), doc_root("/home/chaopro/webServer/myWebServer/root"),
+      warm_file_bytes(256LL << 20), thread_number(8), max_requests(10000),
+      queue_target(5), queue_interval(100), retry_after(1),
+      db_host("localhost"), db_port(3306), db_user("root"), db_password("123456"), db_name("yourdb"),
+      db_max_conn(8), db_min_conn(4), db_spare_conn(2), batch_size(32), batch_delay(2),
+      log_file("ServerLog"), log_mode(SYNC), log_binary(false), log_buf_size(2000), log_split_lines(800000),
+      log_queue_size(256), stats_interval(60), access_log_file("AccessLog"), access_log_sample(1),
+      access_log_format(1), access_log_split(256LL << 20), archive_max_bytes(1LL << 30), archive_max_days(30),
+      archive_level(6), user_cache_size(1048576), user_filter_fp(0.01), session_capacity(65536), session_ttl(1800) {
+    add("port", INT, &port, 1, 65535, "监听端口（也可以作为第一个参数）");
+    add("listen_trigger", CHOICE, &listen_trigger, 0, 0, "监听socket的触发模式（LT或ET）", trigger_names);
+    add("conn_trigger", CHOICE, &conn_trigger, 0, 0, "连接socket的触发模式（LT或ET）", trigger_names);
+    add("max_fd", INT, &max_fd, 16, 1 << 24, "最大的文件描述符个数");
+    add("max_conn", INT, &max_conn, 0, 1 << 24, "最多同时保持的连接数，0表示只受max_fd限制");
+    add("ip_max_conn", INT, &ip_max_conn, 0, 1 << 24, "每个客户端IP最多同时保持的连接数，0表示不限制");
+    add("ip_rate", INT, &ip_rate, 0, 1 << 24, "每个客户端IP每秒的请求数，0表示不限制");
+    add("ip_burst", INT, &ip_burst, 0, 1 << 24, "每个客户端IP允许的突发请求数，0表示与ip_rate相同");
+    add("max_events", INT, &max_events, 1, 1 << 20, "每次epoll_wait最多返回的事件数");
+    add("listen_backlog", INT, &listen_backlog, 1, 1 << 20, "等待accept的连接队列长度");
+    add("accept_batch", INT, &accept_batch, 1, 1 << 16, "监听socket每次就绪时最多接受的连接数");
+    add("defer_accept", INT, &defer_accept, 0, 3600, "收到数据后才接受连接，最多等待的秒数，0表示不开启");
+    add("fast_open", INT, &fast_open, 0, 1 << 20, "TCP Fast Open的队列长度，0表示不开启");
+    add("timeslot", INT, &timeslot, 1, 3600, "最小超时单位（秒）");
+    add("read_buffer_size", INT, &read_buffer_size, 256, 1 << 20, "每个连接的读缓冲区大小");
+    add("write_buffer_size", INT, &write_buffer_size, 256, 1 << 20, "每个连接的写缓冲区大小");
+    add("doc_root", STRING, &doc_root, 0, 0, "网站根目录");
+    add("warm_file_bytes", LLONG, &warm_file_bytes, 0, 1LL << 40, "启动时预读的静态文件总大小上限，0表示不预读");
+    add("thread_number", INT, &thread_number, 1, 1024, "工作线程数");
+    add("max_requests", INT, &max_requests, 1, 1 << 24, "请求队列的最大长度");
+    add("queue_target", INT, &queue_target, 1, 10000, "排队时间的目标（毫秒），持续超过时判断为过载");
+    add("queue_interval", INT, &queue_interval, 1, 60000, "判断是否过载的间隔（毫秒），也是未过载时排队时间的上限");
+    add("retry_after", INT, &retry_after, 0, 3600, "过载和超过客户端限制时响应中Retry-After的秒数");
+    add("db_host", STRING, &db_host, 0, 0, "数据库地址");
+    add("db_port", INT, &db_port, 1, 65535, "数据库端口");
+    add("db_user", STRING, &db_user, 0, 0, "数据库用户名");
+    add("db_password", STRING, &db_password, 0, 0, "数据库密码");
+    add("db_name", STRING, &db_name, 0, 0, "数据库名");
+    add("db_max_conn", INT, &db_max_conn, 1, 1024, "连接池的最大连接数");
+    add("db_min_conn", INT, &db_min_conn, 0, 1024, "连接池至少保持的连接数");
+    add("db_spare_conn", INT, &db_spare_conn, 0, 1024, "预热的空闲连接数");
+    add("batch_size", INT, &batch_size, 1, 1024, "注册批量写入每批最多的条数");
+    add("batch_delay", INT, &batch_delay, 0, 1000, "每批第一条最多等待的毫秒数");
+    add("log_file", STRING, &log_file, 0, 0, "服务器日志文件名");
+    add("log_mode", CHOICE, &log_mode, 0, 0, "同步（sync）或者异步（async）写日志", log_mode_names);
+    add("log_binary", BOOL, &log_binary, 0, 0, "写二进制日志");
+    add("log_buf_size", INT, &log_buf_size, 128, 1 << 20, "单条日志的最大长度");
+    add("log_split_lines", INT, &log_split_lines, 1000, 1 << 30, "单个日志文件的最大行数");
+    add("log_queue_size", INT, &log_queue_size, 1, 1 << 20, "异步模式下每个线程暂存的日志条数");
+    add("stats_interval", INT, &stats_interval, 1, 86400, "统计信息写入日志的间隔（秒）");
+    add("access_log_file", STRING, &access_log_file, 0, 0, "访问日志文件名");
+    add("access_log_sample", INT, &access_log_sample, 0, 1 << 30, "访问日志的采样率，0表示不写访问日志");
+    add("access_log_format", CHOICE, &access_log_format, 0, 0, "访问日志格式（common或combined）", format_names);
+    add("access_log_split", LLONG, &access_log_split, 1 << 20, 1LL << 40, "单个访问日志文件的最大字节数");
+    add("archive_max_bytes", LLONG, &archive_max_bytes, 0, 1LL << 50, "压缩后的旧日志的总大小上限，0表示不限制");
+    add("archive_max_days", INT, &archive_max_days, 0, 36500, "压缩后的旧日志的保留天数，0表示不限制");
+    add("archive_level", INT, &archive_level, 1, 9, "gzip压缩级别");
+    add("user_cache_size", INT, &user_cache_size, 1, 1 << 28, "内存中最多缓存的用户数");
+    add("user_filter_fp", DOUBLE, &user_filter_fp, 1e-6, 0.5, "用户名布隆过滤器的目标误判率");
+    add("session_capacity", INT, &session_capacity, 1, 1 << 26, "最多同时存在的登录会话数");
+    add("session_ttl", INT, &session_ttl, 1, 86400 * 30, "登录会话的有效期（秒）");
+}
+
+void config::add(const char* name, TYPE type, void* value, double min, double max, const char* desc,
+                 const char* const* choices) {
+    option opt;
+    opt.name = name;
+    opt.type = type;
+    opt.value = value;
+    opt.min = min;
+    opt.max = max;
+    opt.choices = choices;
+    opt.desc = desc;
+    opt.source = FROM_DEFAULT;
+    m_options.push_back(opt);
+}
+
+config::option* config::find(const char* name) {
+    for (size_t i = 0; i < m_options.size(); ++i) {
+        if (strcmp(m_options[i].name, name) == 0) return &m_options[i];
+    }
+    return NULL;
+}
+
+// 解析整数，允许K、M、G后缀（1024的倍数）
+static bool parse_integer(const char* value, long long* out) {
+    char* end = NULL;
+    errno = 0;
+    long long v = strtoll(value, &end, 10);
+    if (errno || end == value) return false;
+    int shift = 0;
+    switch (toupper(*end)) {
+        case 'K': shift = 10; ++end; break;
+        case 'M': shift = 20; ++end; break;
+        case 'G': shift = 30; ++end; break;
+    }
+    if (*end != '\0') return false;
+    // 乘上单位后超出long long范围的值拒绝（左移溢出或者负数左移都是未定义行为）
+    if (v > (LLONG_MAX >> shift) || v < (LLONG_MIN >> shift)) return false;
+    v *= 1LL << shift;
+    *out = v;
+    return true;
+}
+
+bool config::set(const char* name, const char* value, SOURCE source, const char* where) {
+    option* opt = find(name);
+    if (!opt) {
+        fprintf(stderr, "%s: unknown option '%s'\n", where, name);
+        return false;
+    }
+
+    switch (opt->type) {
+        case INT:
+        case LLONG: {
+            long long v;
+            if (!parse_integer(value, &v)) {
+                fprintf(stderr, "%s: %s expects an integer, got '%s'\n", where, name, value);
+                return false;
+            }
+            if (v < opt->min || v > opt->max) {
+                fprintf(stderr, "%s: %s must be in [%.0f, %.0f], got %lld\n", where, name, opt->min, opt->max, v);
+                return false;
+            }
+            if (opt->type == INT) *(int*)opt->value = (int)v;
+            else *(long long*)opt->value = v;
+            break;
+        }
+        case DOUBLE: {
+            char* end = NULL;
+            double v = strtod(value, &end);
+            if (end == value || *end != '\0') {
+                fprintf(stderr, "%s: %s expects a number, got '%s'\n", where, name, value);
+                return false;
+            }
+            if (v < opt->min || v > opt->max) {
+                fprintf(stderr, "%s: %s must be in [%g, %g], got %g\n", where, name, opt->min, opt->max, v);
+                return false;
+            }
+            *(double*)opt->value = v;
+            break;
+        }
+        case BOOL: {
+            if (!strcasecmp(value, "1") || !strcasecmp(value, "true") || !strcasecmp(value, "yes") ||
+                !strcasecmp(value, "on")) {
+                *(bool*)opt->value = true;
+            } else if (!strcasecmp(value, "0") || !strcasecmp(value, "false") || !strcasecmp(value, "no") ||
+                       !strcasecmp(value, "off")) {
+                *(bool*)opt->value = false;
+            } else {
+                fprintf(stderr, "%s: %s expects true or false, got '%s'\n", where, name, value);
+                return false;
+            }
+            break;
+        }
+        case STRING:
+            *(std::string*)opt->value = value;
+            break;
+        case CHOICE: {
+            int i = 0;
+            for (; opt->choices[i]; ++i) {
+                if (!strcasecmp(value, opt->choices[i])) break;
+            }
+            if (!opt->choices[i]) {
+                fprintf(stderr, "%s: invalid value '%s' for %s\n", where, value, name);
+                return false;
+            }
+            *(int*)opt->value = i;
+            break;
+        }
+    }
+    opt->source = source;
+    return true;
+}
+
+// 去掉首尾的空白字符
+static char* trim(char* s) {
+    while (isspace((unsigned char)*s)) ++s;
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) --end;
+    *end = '\0';
+    return s;
+}
+
+bool config::load_file(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "cannot open config file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char line[1024], where[512];
+    bool ok = true;
+    for (int n = 1; fgets(line, sizeof(line), fp); ++n) {
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        char* text = trim(line);
+        if (*text == '\0') continue;
+
+        snprintf(where, sizeof(where), "%s:%d", path, n);
+        char* eq = strchr(text, '=');
+        if (!eq) {
+            fprintf(stderr, "%s: expected key = value\n", where);
+            ok = false;
+            continue;
+        }
+        *eq = '\0';
+        // 继续检查后面的行，一次输出文件中所有的错误
+        if (!set(trim(text), trim(eq + 1), FROM_FILE, where)) ok = false;
+    }
+    fclose(fp);
+    return ok;
+}
+
+bool config::load(int argc, char* argv[]) {
+    // 先读配置文件，命令行中的其他参数无论位置如何都覆盖配置文件
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return false;
+        }
+        if (strcmp(argv[i], "-f") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "-f requires a file name\n");
+                return false;
+            }
+            if (!load_file(argv[++i])) return false;
+        }
+    }
+
+    bool ok = true;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-f") == 0) {
+            ++i;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            // --key=value或者--key value，key中的-等同于_
+            std::string name = argv[i] + 2;
+            const char* value = NULL;
+            size_t eq = name.find('=');
+            if (eq != std::string::npos) {
+                value = argv[i] + 2 + eq + 1;
+                name.resize(eq);
+            } else if (i + 1 < argc) {
+                value = argv[++i];
+            } else {
+                fprintf(stderr, "command line: %s requires a value\n", argv[i]);
+                ok = false;
+                continue;
+            }
+            for (size_t k = 0; k < name.size(); ++k) {
+                if (name[k] == '-') name[k] = '_';
+            }
+            if (!set(name.c_str(), value, FROM_CLI, "command line")) ok = false;
+        } else if (argv[i][0] != '-' && find("port")->source != FROM_CLI) {
+            // 兼容之前的用法：第一个参数是端口号
+            if (!set("port", argv[i], FROM_CLI, "command line")) ok = false;
+        } else {
+            fprintf(stderr, "command line: unexpected argument '%s'\n", argv[i]);
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "run %s -h for the list of options\n", argv[0]);
+        return false;
+    }
+    return validate();
+}
+
+// 单个配置项的取值范围在set中检查，这里检查配置项之间的关系和外部条件
+bool config::validate() {
+    bool ok = true;
+    if (port == 0) {
+        fprintf(stderr, "port is required (first argument, --port or port in the config file)\n");
+        ok = false;
+    }
+    if (max_conn > max_fd) {
+        fprintf(stderr, "max_conn (%d) must not exceed max_fd (%d)\n", max_conn, max_fd);
+        ok = false;
+    }
+    if (queue_target >= queue_interval) {
+        fprintf(stderr, "queue_target (%d) must be less than queue_interval (%d)\n", queue_target, queue_interval);
+        ok = false;
+    }
+    if (db_min_conn > db_max_conn) {
+        fprintf(stderr, "db_min_conn (%d) must not exceed db_max_conn (%d)\n", db_min_conn, db_max_conn);
+        ok = false;
+    }
+    if (db_spare_conn > db_max_conn) {
+        fprintf(stderr, "db_spare_conn (%d) must not exceed db_max_conn (%d)\n", db_spare_conn, db_max_conn);
+        ok = false;
+    }
+
+    struct stat st;
+    if (doc_root.empty() || doc_root.size() > (size_t)MAX_DOC_ROOT) {
+        fprintf(stderr, "doc_root must be 1 to %d characters long\n", MAX_DOC_ROOT);
+        ok = false;
+    } else if (stat(doc_root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "doc_root %s is not a directory\n", doc_root.c_str());
+        ok = false;
+    }
+    // 去掉末尾的/，请求的url以/开头
+    while (doc_root.size() > 1 && doc_root[doc_root.size() - 1] == '/') doc_root.resize(doc_root.size() - 1);
+
+    if (log_file.empty() || access_log_file.empty()) {
+        fprintf(stderr, "log_file and access_log_file must not be empty\n");
+        ok = false;
+    }
+    return ok;
+}
+
+std::string config::format(const option& opt) {
+    char buf[64];
+    switch (opt.type) {
+        case INT:
+            snprintf(buf, sizeof(buf), "%d", *(int*)opt.value);
+            return buf;
+        case LLONG:
+            snprintf(buf, sizeof(buf), "%lld", *(long long*)opt.value);
+            return buf;
+        case DOUBLE:
+            snprintf(buf, sizeof(buf), "%g", *(double*)opt.value);
+            return buf;
+        case BOOL:
+            return *(bool*)opt.value ? "true" : "false";
+        case STRING:
+            return *(std::string*)opt.value;
+        case CHOICE:
+            return opt.choices[*(int*)opt.value];
+    }
+    return "";
+}
+
+void config::log_values() {
+    static const char* const source_names[] = {"default", "file", "command line"};
+    for (size_t i = 0; i < m_options.size(); ++i) {
+        const option& opt = m_options[i];
+        if (opt.value == &db_password) {
+            LOG_INFO("config: %s = *** (%s)", opt.name, source_names[opt.source]);
+        } else {
+            LOG_INFO("config: %s = %s (%s)", opt.name, format(opt).c_str(), source_names[opt.source]);
+        }
+    }
+
+    // 文件描述符超过进程的限制时accept会失败，连接数到不了max_fd
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)max_fd) {
+        LOG_WARN("config: max_fd %d exceeds the open file limit %llu", max_fd, (unsigned long long)limit.rlim_cur);
+    }
+    // listen的队列长度超过somaxconn时内核直接截断，不报错
+    FILE* fp = fopen("/proc/sys/net/core/somaxconn", "r");
+    if (fp) {
+        int somaxconn = 0;
+        if (fscanf(fp, "%d", &somaxconn) == 1 && somaxconn < listen_backlog) {
+            LOG_WARN("config: listen_backlog %d exceeds net.core.somaxconn %d", listen_backlog, somaxconn);
+        }
+        fclose(fp);
+    }
+}
+
+void config::usage(const char* prog) {
+    printf("usage: %s [-f config_file] [--key=value ...] [port]\n\n", prog);
+    printf("options (config file: key = value):\n");
+    for (size_t i = 0; i < m_options.size(); ++i) {
+        const option& opt = m_options[i];
+        printf("  %-20s %s (default %s)\n", opt.name, opt.desc, opt.value == &db_password ? "***" : format(opt).c_str());
+    }
+}
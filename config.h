@@ -0,0 +1,140 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include <vector>
+
+// 运行时配置：启动时先读配置文件（-f指定），再用命令行的--key=value覆盖，校验通过后各模块按这里的值初始化，
+// 调整参数不需要重新编译。配置文件每行一个key = value，#开头的行和行尾#之后的内容是注释。
+// 日志在读取配置之后才初始化，所以读取和校验的错误输出到stderr，生效的配置在日志初始化后写入日志
+class config {
+public:
+    // 触发模式
+    enum TRIGGER {
+        LT = 0,  // 水平触发
+        ET  // 边缘触发
+    };
+
+    // 日志写入方式
+    enum LOG_MODE {
+        SYNC = 0,  // 同步写日志
+        ASYNC  // 异步写日志，由后台线程写入文件
+    };
+
+    // 局部静态变量单例模式
+    static config* get_instance();
+
+    // 读取配置文件和命令行参数并校验，失败时输出原因并返回false
+    bool load(int argc, char* argv[]);
+
+    // 将生效的配置（以及来源）写入日志，密码不输出
+    void log_values();
+
+    // 网络
+    int port;  // 监听端口
+    int listen_trigger;  // 监听socket的触发模式
+    int conn_trigger;  // 连接socket的触发模式
+    int max_fd;  // 最大的文件描述符个数
+    int max_conn;  // 最多同时保持的连接数，超过时新连接直接回复503，0表示只受max_fd限制
+    int ip_max_conn;  // 每个客户端IP最多同时保持的连接数，超过时回复429，0表示不限制
+    int ip_rate;  // 每个客户端IP每秒的请求数（令牌桶），超过时回复429，0表示不限制
+    int ip_burst;  // 每个客户端IP允许的突发请求数，0表示与ip_rate相同
+    int max_events;  // 每次epoll_wait最多返回的事件数
+    int listen_backlog;  // 已完成握手、等待accept的连接队列长度（受net.core.somaxconn限制）
+    int accept_batch;  // 监听socket每次就绪时最多接受的连接数
+    int defer_accept;  // TCP_DEFER_ACCEPT：收到数据后才交给accept，最多等待的秒数，0表示不开启
+    int fast_open;  // TCP Fast Open的队列长度，0表示不开启
+    int timeslot;  // 最小超时单位（秒），连接空闲3个单位后关闭
+    int read_buffer_size;  // 每个连接的读缓冲区大小
+    int write_buffer_size;  // 每个连接的写缓冲区大小（响应头）
+    std::string doc_root;  // 网站根目录
+    long long warm_file_bytes;  // 启动时预读到页面缓存的静态文件的总大小上限，0表示不预读
+
+    // 线程池
+    int thread_number;  // 工作线程数
+    int max_requests;  // 请求队列的最大长度
+    int queue_target;  // 排队时间的目标（毫秒），一个间隔内的最小排队时间都超过目标时判断为过载
+    int queue_interval;  // 判断是否过载的间隔（毫秒），未过载时排队时间的上限
+    int retry_after;  // 过载（503）和超过客户端限制（429）时响应中Retry-After的秒数
+
+    // 数据库
+    std::string db_host;
+    int db_port;
+    std::string db_user;
+    std::string db_password;
+    std::string db_name;
+    int db_max_conn;  // 连接池的最大连接数
+    int db_min_conn;  // 连接池至少保持的连接数
+    int db_spare_conn;  // 预热的空闲连接数
+    int batch_size;  // 注册批量写入每批最多的条数
+    int batch_delay;  // 每批第一条最多等待的毫秒数
+
+    // 日志
+    std::string log_file;  // 服务器日志文件名（可以带路径）
+    int log_mode;  // 同步或者异步
+    bool log_binary;  // 写二进制日志（用tools/log_decode转换为文本）
+    int log_buf_size;  // 单条日志的最大长度
+    int log_split_lines;  // 单个日志文件的最大行数
+    int log_queue_size;  // 异步模式下每个线程暂存的日志条数
+    int stats_interval;  // 统计信息写入日志的间隔（秒）
+    std::string access_log_file;  // 访问日志文件名
+    int access_log_sample;  // 访问日志的采样率（每N个成功的响应记录一条，错误总是记录），0表示不写访问日志
+    int access_log_format;  // 访问日志格式（access_log::COMMON或COMBINED）
+    long long access_log_split;  // 单个访问日志文件的最大字节数
+    long long archive_max_bytes;  // 每种日志压缩后的旧文件的总大小上限，0表示不限制
+    int archive_max_days;  // 压缩后的旧文件的保留天数，0表示不限制
+    int archive_level;  // gzip压缩级别
+
+    // 缓存
+    int user_cache_size;  // 内存中最多缓存的用户数
+    double user_filter_fp;  // 用户名布隆过滤器的目标误判率
+    int session_capacity;  // 最多同时存在的登录会话数
+    int session_ttl;  // 登录会话的有效期（秒）
+
+private:
+    static const int MAX_DOC_ROOT = 100;  // 网站根目录的最大长度，请求的文件路径（200字节）中剩余的部分留给url
+
+    config();
+
+    // 配置项的类型
+    enum TYPE {
+        INT = 0,
+        LLONG,
+        DOUBLE,
+        BOOL,
+        STRING,
+        CHOICE  // 取值为choices中的一个，保存其下标
+    };
+
+    // 配置项的来源
+    enum SOURCE {
+        FROM_DEFAULT = 0,
+        FROM_FILE,
+        FROM_CLI
+    };
+
+    struct option {
+        const char* name;
+        TYPE type;
+        void* value;  // 指向对应的成员变量
+        double min, max;  // 数值的取值范围
+        const char* const* choices;  // CHOICE的可选值，以NULL结尾
+        const char* desc;
+        SOURCE source;
+    };
+
+    void add(const char* name, TYPE type, void* value, double min, double max, const char* desc,
+             const char* const* choices = NULL);
+    option* find(const char* name);
+
+    // 设置一个配置项，where用于错误信息（文件名和行号或者命令行）
+    bool set(const char* name, const char* value, SOURCE source, const char* where);
+    bool load_file(const char* path);
+    bool validate();
+    std::string format(const option& opt);
+    void usage(const char* prog);
+
+    std::vector<option> m_options;
+};
+
+#endif
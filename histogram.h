@@ -0,0 +1,94 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <string.h>
+#include <stdint.h>
+
+// 对数分桶直方图（HDR风格）：每个2的幂区间再均分为SUB_BUCKETS个子桶，记录值的相对误差不超过1/SUB_BUCKETS
+// 记录只是一次数组自增，不加锁，由使用者保证同一时刻只有一个线程写入；多个直方图可以通过merge合并后再统计分位数。
+// 与metrics的计数器分片一样，写入线程用relaxed原子写更新，merge用relaxed原子读，其他线程可以在写入的同时合并
+class histogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;  // 每个2的幂区间的子桶数
+    static const int MAX_BITS = 48;  // 可以记录的最大值为2^48-1，超过的按最大值记录
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;  // 桶的总数
+
+    histogram() {
+        reset();
+    }
+
+    // 清空所有记录
+    void reset() {
+        memset(m_counts, 0, sizeof(m_counts));
+        m_total = 0;
+        m_sum = 0;
+        m_max = 0;
+    }
+
+    // 记录一个值
+    void record(uint64_t value) {
+        if (value >= ((uint64_t)1 << MAX_BITS)) value = ((uint64_t)1 << MAX_BITS) - 1;
+        int i = index(value);
+        __atomic_store_n(&m_counts[i], m_counts[i] + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_total, m_total + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&m_sum, m_sum + value, __ATOMIC_RELAXED);
+        if (value > m_max) __atomic_store_n(&m_max, value, __ATOMIC_RELAXED);
+    }
+
+    // 将另一个直方图的记录合并进来（other可以正在被它的写入线程记录）
+    void merge(const histogram& other) {
+        for (int i = 0; i < BUCKETS; ++i) m_counts[i] += __atomic_load_n(&other.m_counts[i], __ATOMIC_RELAXED);
+        m_total += __atomic_load_n(&other.m_total, __ATOMIC_RELAXED);
+        m_sum += __atomic_load_n(&other.m_sum, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&other.m_max, __ATOMIC_RELAXED);
+        if (max > m_max) m_max = max;
+    }
+
+    // 返回百分位p（0-100）对应的值（所在子桶的上界）
+    uint64_t percentile(double p) const {
+        if (m_total == 0) return 0;
+        uint64_t target = (uint64_t)(p / 100.0 * m_total + 0.5);
+        if (target == 0) target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += m_counts[i];
+            if (seen >= target) {
+                uint64_t upper = upper_bound(i);
+                return upper < m_max ? upper : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    uint64_t count() const { return m_total; }
+    uint64_t sum() const { return m_sum; }
+    uint64_t max() const { return m_max; }
+    uint64_t mean() const { return m_total ? m_sum / m_total : 0; }
+
+private:
+    // 小于SUB_BUCKETS的值直接作为下标，其余按最高位所在的区间和其后SUB_BITS位确定子桶
+    static int index(uint64_t value) {
+        if (value < (uint64_t)SUB_BUCKETS) return (int)value;
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BITS;
+        int sub = (int)((value >> shift) & (SUB_BUCKETS - 1));
+        return (shift + 1) * SUB_BUCKETS + sub;
+    }
+
+    // 子桶i能表示的最大值
+    static uint64_t upper_bound(int i) {
+        if (i < SUB_BUCKETS) return i;
+        int shift = i / SUB_BUCKETS - 1;
+        uint64_t lower = (uint64_t)(SUB_BUCKETS + i % SUB_BUCKETS) << shift;
+        return lower + ((uint64_t)1 << shift) - 1;
+    }
+
+private:
+    uint64_t m_counts[BUCKETS];  // 每个子桶的记录数
+    uint64_t m_total;  // 记录总数
+    uint64_t m_sum;  // 记录值之和
+    uint64_t m_max;  // 最大记录值
+};
+
+#endif
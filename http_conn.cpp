@@ -1,12 +1,7 @@
 #include <fstream>
 #include "http_conn.h"
 #include "log.h"
-
-// #define listenfdLT // 设置监听文件描述符为水平触发模式
-#define listenfdET  // 设置监听文件描述符为边缘触发模式
-
-// #define connfdLT // 设置连接文件描述符为水平触发模式
-#define connfdET  // 设置连接文件描述符为边缘触发模式
+#include "startup.h"
 
 // http状态码
 const char* ok_200_title = "OK";  // 请求成功
@@ -18,66 +13,48 @@ const char* error_404_title = "Not Found";  // 没有找到资源
 const char* error_404_form = "The request file was not found on this server.\n";  // 在此服务器上找不到请求文件
 const char* error_500_title = "Internal Error";  // 内部错误
 const char* error_500_form = "There was an unusual problem serving the request file.\n";  // 在处理请求文件时出现了一个不寻常的问题
+const char* error_503_title = "Service Unavailable";  // 服务不可用
+const char* error_503_form = "The server is temporarily unable to serve your request, please try again later.\n";  // 服务器暂时无法处理请求，请稍后重试
+const char* error_429_title = "Too Many Requests";  // 请求过多
+const char* error_429_form = "You have sent too many requests or opened too many connections, please try again later.\n";  // 客户端超过了连接数或者请求速率的限制
 
 // 静态成员变量需要初始化
 int http_conn::m_epollfd = -1;  // 所有socket上的事件都被注册到同一个epoll
 int http_conn::m_user_count = 0;  // 统计用户数量
+connection_pool* http_conn::m_connPool = NULL;  // 数据库连接池
+bloom_filter http_conn::m_user_filter;  // 用户名的布隆过滤器
+uint64_t http_conn::m_filter_skips = 0;  // 跳过重名查询的注册数
+uint64_t http_conn::m_filter_false_pos = 0;  // 布隆过滤器误判的注册数
+bool http_conn::m_filter_ready = false;  // 布隆过滤器是否已经载入
+bool http_conn::m_filter_loading = false;  // 是否正在载入布隆过滤器
+std::vector<std::string> http_conn::m_filter_pending;  // 载入期间新增的用户名
+mutex http_conn::m_filter_lock;  // 保护载入状态和载入期间新增的用户名
+int http_conn::m_read_buf_size = 2048;  // 读缓冲区的大小
+int http_conn::m_write_buf_size = 1024;  // 写缓冲区的大小
+bool http_conn::m_conn_et = true;  // 连接socket默认使用边缘触发
+char http_conn::m_busy_response[512];  // 过载时回复的503响应
+int http_conn::m_busy_len = 0;  // 503响应的长度
+char http_conn::m_limited_response[512];  // 超过客户端限制时回复的429响应
+int http_conn::m_limited_len = 0;  // 429响应的长度
 
 // 网站根目录，文件中存放请求的资源和跳转的html文件
-<<<<<<< HEAD
-const char* doc_root = "/home/chaopro/webServer/myWebServer/root";  
-=======
-const char* doc_root = "/home/chaopro/TinyWebServer/myWebServer/root";  
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
+const char* doc_root = NULL;  // 启动时设置为配置中的doc_root
 
 /*------------文件描述符操作----------*/
-// 设置文件描述符非阻塞
-void setnonblocking(int fd) {
-    // 获取文件描述符文件状态flag
-    int old_flag = fcntl(fd, F_GETFL); 
-    // 添加非阻塞 
-    int new_flag = old_flag | O_NONBLOCK;  
-    // 设置文件描述符文件状态flag
-    fcntl(fd, F_SETFL, new_flag);  
-}
-
-// 添加文件描述符到epoll
-int addfd(int epollfd, int fd, bool one_shot) {
+// 添加文件描述符到epoll，et表示使用边缘触发
+void addfd(int epollfd, int fd, bool one_shot, bool et) {
     // 事件设置
     epoll_event event;
     event.data.fd = fd;
-
-#ifdef listenfdLT
     event.events = EPOLLIN | EPOLLRDHUP;  // 默认是水平触发，EPOLLIN表示对应的文件描述符可以读（包括对端SOCKET正常关闭），EPOLLHUP表示对应的文件描述符被挂断
-#endif
-
-#ifdef listenfdET
-    event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-#endif
+    if (et) event.events |= EPOLLET;
 
-#ifdef connfdLT
-    event.events = EPOLLIN | EPOLLRDHUP;
-#endif
-
-#ifdef connfdET
-    event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-#endif
-
-<<<<<<< HEAD
     if (one_shot) event.events |= EPOLLONESHOT;  // 注册epolloneshot事件，一个线程处理socket时，其他线程将无法处理（listenfd不用开启）
-=======
-    if (one_shot) event.events |= EPOLLONESHOT;  // 注册epolloneshot事件，一个线程处理socket时，其他线程将无法处理
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
     
     // 注册内核事件表监控的文件描述符上的事件
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);  
     
-<<<<<<< HEAD
-    // 设置文件描述符非阻塞（ET模式只支持非阻塞）
-=======
-    // 设置文件描述符非阻塞（因为ET模式只支持非阻塞）
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
-    setnonblocking(fd);  
+    // 所有注册的文件描述符在创建时已经设置为非阻塞（accept4、socket和socketpair的SOCK_NONBLOCK），ET模式只支持非阻塞
 }
 
 // 从epoll中删除文件描述符
@@ -90,39 +67,110 @@ void removefd(int epollfd, int fd) {
 void modfd(int epollfd, int fd, int ev) {
     epoll_event event;
     event.data.fd = fd;
-
-#ifdef connfdLT
     event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
-#endif
-
-#ifdef connfdET
-    event.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;
-#endif
+    if (http_conn::m_conn_et) event.events |= EPOLLET;
 
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
 }
 
 
 /*------------载入数据库表----------*/
-void http_conn::initmysql_result(connection_pool* connPool) {
-    // 从连接池中取出一个连接
+bool http_conn::initmysql_result(connection_pool* connPool, int limit, double fp_rate) {
+    // 从连接池中取出一个连接，载入结束后离开作用域归还连接
     MYSQL* mysql = NULL;
     connectionRAII mysqlcon(&mysql, connPool);
+    if (!mysql) {
+        LOG_ERROR("%s", "no mysql connection available");
+        return false;
+    }
+
+    // 从这里开始记下新增的用户名：之前注册成功的用户已经写入数据库，会被下面的查询读到
+    m_filter_lock.lock();
+    m_filter_loading = true;
+    m_filter_lock.unlock();
+
+    // 按现有用户数的两倍建立布隆过滤器，为之后的注册留出空间
+    uint64_t rows = 0;
+    if (mysql_query(mysql, "SELECT COUNT(*) FROM user")) {
+        LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
+    } else if (MYSQL_RES* count = mysql_store_result(mysql)) {
+        MYSQL_ROW row = mysql_fetch_row(count);
+        if (row && row[0]) rows = strtoull(row[0], NULL, 10);
+        mysql_free_result(count);
+    }
+    // 载入期间请求处理线程不访问布隆过滤器（filter_ready为false），可以重新分配
+    uint64_t expected = rows * 2 > USER_FILTER_MIN ? rows * 2 : USER_FILTER_MIN;
+    if (!m_user_filter.init(expected, fp_rate)) {
+        LOG_ERROR("%s", "user filter alloc error");
+        filter_abort();
+        return false;
+    }
 
-    // 在user表中检索username，passwd数据
-    if (mysql_query(mysql, "SELECT username, passwd FROM user")) LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
-    // 从表中检索出完整的结果集
-    MYSQL_RES* result = mysql_store_result(mysql);
-    // 返回结果集中的列数
-    int num_fields = mysql_num_fields(result);
-    // 返回所有字段结构的数组
-    MYSQL_FIELD* fields = mysql_fetch_fields(result);
-    // 从结果集中获取下一行，将对应的用户名和密码存入map中
+    // 在user表中检索username，passwd数据，逐行取回而不是一次取回整个结果集，用户数很多时也不会占用大量内存
+    // 没有完整载入所有用户名时布隆过滤器会误报用户名不存在，所以载入失败就不使用布隆过滤器
+    if (mysql_query(mysql, "SELECT username, passwd FROM user")) {
+        LOG_ERROR("SELECT error:%s\n", mysql_error(mysql));
+        filter_abort();
+        return false;
+    }
+    MYSQL_RES* result = mysql_use_result(mysql);
+    if (!result) {
+        filter_abort();
+        return false;
+    }
+    // 每个用户名都加入布隆过滤器，前limit个用户同时放入用户缓存，其余的在登录时按需载入
+    int loaded = 0;
     while (MYSQL_ROW row = mysql_fetch_row(result)) {
-        string temp1(row[0]);
-        string temp2(row[1]);
-        users[temp1] = temp2;
+        if (!row[0] || !row[1]) continue;
+        m_user_filter.add(row[0]);
+        if (loaded < limit) {
+            user_cache::get_instance()->put(row[0], row[1]);
+            ++loaded;
+        }
+    }
+    bool ok = !mysql_errno(mysql);
+    if (!ok) {
+        LOG_ERROR("fetch user error:%s\n", mysql_error(mysql));
+        filter_abort();
+    }
+    mysql_free_result(result);
+    if (!ok) return false;
+
+    // 补充载入期间注册成功的用户名，在同一把锁内切换为已载入，之后的用户名直接加入布隆过滤器，不会遗漏
+    m_filter_lock.lock();
+    for (size_t i = 0; i < m_filter_pending.size(); ++i) m_user_filter.add(m_filter_pending[i].c_str());
+    size_t pending = m_filter_pending.size();
+    std::vector<std::string>().swap(m_filter_pending);
+    m_filter_loading = false;
+    __atomic_store_n(&m_filter_ready, true, __ATOMIC_RELEASE);
+    m_filter_lock.unlock();
+    if (pending) LOG_INFO("user filter: added %zu users registered during the load", pending);
+
+    LOG_INFO("user filter: %llu users, %llu bytes, %d hashes, target fp %.4f, estimated fp %.4f",
+             (unsigned long long)m_user_filter.count(), (unsigned long long)m_user_filter.bytes(),
+             m_user_filter.hashes(), m_user_filter.target_fp(), m_user_filter.estimated_fp());
+    return true;
+}
+
+
+// 载入失败，不使用布隆过滤器，也不再记下新增的用户名
+void http_conn::filter_abort() {
+    m_filter_lock.lock();
+    m_user_filter.clear();
+    m_filter_loading = false;
+    std::vector<std::string>().swap(m_filter_pending);
+    m_filter_lock.unlock();
+}
+
+void http_conn::filter_add(const char* name) {
+    if (filter_ready()) {
+        m_user_filter.add(name);
+        return;
     }
+    m_filter_lock.lock();
+    if (filter_ready()) m_user_filter.add(name);  // 在加锁前刚刚载入完成
+    else if (m_filter_loading) m_filter_pending.push_back(name);
+    m_filter_lock.unlock();
 }
 
 
@@ -137,10 +185,16 @@ void http_conn::init(int sockfd, const sockaddr_in& addr) {
     // setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
     // 添加到epoll对象中
-    addfd(m_epollfd, sockfd, true);
+    addfd(m_epollfd, sockfd, true, m_conn_et);
 
     // 用户数量加1
-    m_user_count++;  
+    __atomic_add_fetch(&m_user_count, 1, __ATOMIC_RELAXED);
+
+    // 缓冲区在第一次使用这个位置时分配，连接关闭后保留给之后复用同一个文件描述符的连接
+    if (!m_read_buf) {
+        m_read_buf = new char[m_read_buf_size];
+        m_write_buf = new char[m_write_buf_size];
+    }
 
     // 初始化其他信息
     init();  
@@ -160,103 +214,80 @@ void http_conn::init() {
     m_content_length = 0;
     m_host = 0;
     m_linger = false;
+    m_start_time = 0;
+    m_path[0] = '\0';
+    m_referer = NULL;
+    m_user_agent = NULL;
+    m_status = 0;
+    m_body_bytes = 0;
+    m_body_address = NULL;
+    memset(m_stage_ns, 0, sizeof(m_stage_ns));
+    m_stage_mask = 0;
+    m_route = latency::OTHER;
+    m_queue_time = 0;
+    m_work_time = 0;
+    m_sql_time = 0;
+    m_write_time = 0;
 
     mysql = NULL;
     cgi = 0;
+    m_sql_pending = false;
+    m_sql_step = SQL_NONE;
+    m_cookie_sid[0] = '\0';
+    m_set_sid[0] = '\0';
 
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
+    memset(m_read_buf, '\0', m_read_buf_size);
+    memset(m_write_buf, '\0', m_write_buf_size);
     memset(m_read_file, '\0', FILENAME_LEN);
 
     bytes_to_send = 0;
     bytes_have_send = 0;
 }
 
-// 关闭连接
+// 关闭连接（工作线程调用）：不直接关闭文件描述符，只关闭socket的读写并重新注册事件，主线程收到EPOLLHUP后
+// 由定时器回调关闭。文件描述符在此之前不会被复用，连接数、定时器和连接对象都只在主线程中释放一次
 void http_conn::close_conn(bool real_close) {
     if (m_sockfd != -1 && real_close) {
-        removefd(m_epollfd, m_sockfd);  // 从epoll中移除
-        m_sockfd = -1;
-        m_user_count--;  // 客户数量减1
+        shutdown(m_sockfd, SHUT_RDWR);
+        modfd(m_epollfd, m_sockfd, EPOLLIN);
     }
 }
 
 
 /*------------读----------*/
-<<<<<<< HEAD
 // 服务器主线程循环读取客户数据，直到无数据可读或对方关闭连接，如果时ET模式，则需要循环读取，而LT不需要
-=======
-// 循环读取客户数据，直到无数据可读或对方关闭连接，如果时ET模式，则需要循环读取，而LT不需要
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
 bool http_conn::read() {
     // 如果读缓冲区满了，则返回false
-    if (m_read_idx >= READ_BUFFER_SIZE) return false;  
+    if (m_read_idx >= m_read_buf_size) return false;  
 
     // 读取到的字节
     int bytes_read = 0;
 
-#ifdef connfdLT
-    bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
-    m_read_idx += bytes_read;
-    if (bytes_read <= 0) return false;
-    printf("读取到了数据：%s\n", m_read_buf);
-    return true;
-#endif
+    // 新请求的第一次读取，记录开始时间用于统计总耗时和访问日志
+    if (m_read_idx == 0) m_start_time = latency::now();
 
+    if (!m_conn_et) {
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_buf_size - m_read_idx, 0);
+        if (bytes_read <= 0) return false;
+        m_read_idx += bytes_read;
+        metrics::add(metrics::BYTES_IN, bytes_read);
+        return true;
+    }
 
-#ifdef connfdET
     while (true) {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_buf_size - m_read_idx, 0);
         if (bytes_read == -1) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) break;  // 没有数据
             return false;
         } else if (bytes_read == 0) return false;  // 客户端已经断开连接
         m_read_idx += bytes_read;
+        metrics::add(metrics::BYTES_IN, bytes_read);
     }
-    
-    printf("读取到了数据：%s\n", m_read_buf);
-    
     return true;
-#endif
-}
-
-<<<<<<< HEAD
-=======
-// 从状态机读取一行，分析是请求报文的哪一部分
-http_conn::LINE_STATUS http_conn::parse_line() {
-    char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx)
-    {
-        temp = m_read_buf[m_checked_idx];
-        if (temp == '\r')
-        {
-            if ((m_checked_idx + 1) == m_read_idx)
-                return LINE_OPEN;
-            else if (m_read_buf[m_checked_idx + 1] == '\n')
-            {
-                m_read_buf[m_checked_idx++] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-        else if (temp == '\n')
-        {
-            if (m_checked_idx > 1 && m_read_buf[m_checked_idx - 1] == '\r')
-            {
-                m_read_buf[m_checked_idx - 1] = '\0';
-                m_read_buf[m_checked_idx++] = '\0';
-                return LINE_OK;
-            }
-            return LINE_BAD;
-        }
-    }
-    return LINE_OPEN;
 }
 
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
-// 从m_read_buf读取，并处理请求报文
-http_conn::HTTP_CODE http_conn::process_read() {
+// 从m_read_buf读取并解析请求报文，不处理请求
+http_conn::HTTP_CODE http_conn::parse_request() {
     LINE_STATUS line_status = LINE_OK;  // line_state初始化为LINE_OK
     HTTP_CODE ret =  NO_REQUEST;
     char* text = 0;
@@ -272,8 +303,7 @@ http_conn::HTTP_CODE http_conn::process_read() {
         text = get_line();
         m_start_line = m_checked_idx;
         // 日志
-        LOG_INFO("%s", text);
-        Log::get_instance()->flush();
+        LOG_DEBUG("%s", text);
         // 主状态机的三种状态转移逻辑
         switch (m_check_state) {
             case CHECK_STATE_REQUESTLINE: {
@@ -285,16 +315,13 @@ http_conn::HTTP_CODE http_conn::process_read() {
             case CHECK_STATE_HEADER: {
                 // 解析请求头
                 ret = parse_headers(text);
-                if (ret == BAD_REQUEST) return BAD_REQUEST;
-                else if (ret == GET_REQUEST) return do_request();  // 完整解析请求后，跳转到报文响应函数
+                if (ret != NO_REQUEST) return ret;  // 出错或者完整解析了没有请求体的请求
                 break;
             }
             case CHECK_STATE_CONTENT: {
-                // 解析请求体
-                ret = parse_content(text);
-                if (ret == GET_REQUEST) return do_request();  // 完整解析请求后，跳转到报文响应函数
-                line_status = LINE_OPEN;  // 解析完消息体即完成报文解析，避免再次进入循环，更新line_status
-                break;
+                // 解析请求体，请求体还不完整时返回NO_REQUEST等待继续读取。不能回到循环条件中的parse_line，否则它会按行扫描
+                // 已经读到的请求体并移动m_checked_idx，下次就找不到请求体的开头，分多次到达的请求体永远不完整
+                return parse_content(text);
             }
             default: return INTERNAL_ERROR;
         }
@@ -302,7 +329,26 @@ http_conn::HTTP_CODE http_conn::process_read() {
     return NO_REQUEST;
 }
 
-<<<<<<< HEAD
+// 从m_read_buf读取，并处理请求报文
+http_conn::HTTP_CODE http_conn::process_read() {
+    HTTP_CODE ret = parse_request();
+    if (ret == GET_REQUEST) return do_request();  // 完整解析请求后，跳转到报文响应函数
+    return ret;
+}
+
+// 与新连接一样分配缓冲区（init(sockfd, addr)之外的唯一入口，不注册socket），按新请求解析
+http_conn::HTTP_CODE http_conn::parse(const char* request, int len) {
+    if (!m_read_buf) {
+        m_read_buf = new char[m_read_buf_size];
+        m_write_buf = new char[m_write_buf_size];
+    }
+    init();
+    if (len >= m_read_buf_size) return BAD_REQUEST;
+    memcpy(m_read_buf, request, len);
+    m_read_idx = len;
+    return parse_request();
+}
+
 // 从状态机读取一行，标识解析一行的读取状态。
 http_conn::LINE_STATUS http_conn::parse_line() {
     char temp;
@@ -347,7 +393,7 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text) {
     // GET和POST请求报文的区别之一是有无消息体部分，GET请求没有消息体，当解析完空行之后，便完成了报文的解析。
     if (strcasecmp(method, "GET") == 0) m_method = GET;  // strcasecmp忽略大小写比较字符串
     else if (strcasecmp(method, "POST") == 0) {
-        m_method == POST;
+        m_method = POST;
         cgi = 1;
     }
     else return BAD_REQUEST;
@@ -375,6 +421,14 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char* text) {
     // 通常不会有http和https符号，如果三种情况均不符，则返回错误
     if(!m_url || m_url[0] != '/') return BAD_REQUEST;
 
+    // 记录原始路径，下面和do_request会就地改写m_url
+    if (access_log::get_instance()->enabled()) {
+        size_t n = strlen(m_url);
+        if (n >= FILENAME_LEN) n = FILENAME_LEN - 1;
+        memcpy(m_path, m_url, n);
+        m_path[n] = '\0';
+    }
+
     // 当url为/时，显示欢迎界面
     if (strlen(m_url) == 1) strcat(m_url, "judge.html");
     // 请求行处理完毕，将主状态机转移到请求头
@@ -409,10 +463,32 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
         text += 5;
         text += strspn(text, " \t");
         m_host = text;
+    } else if (strncasecmp(text, "Referer:", 8) == 0) {
+        // Referer和User-Agent只用于访问日志
+        text += 8;
+        m_referer = text + strspn(text, " \t");
+    } else if (strncasecmp(text, "User-Agent:", 11) == 0) {
+        text += 11;
+        m_user_agent = text + strspn(text, " \t");
+    } else if (strncasecmp(text, "Cookie:", 7) == 0) {
+        // 解析Cookie字段，Cookie: a=1; sid=会话ID; b=2，只取出会话ID
+        text += 7;
+        while (*text) {
+            text += strspn(text, " \t;");
+            if (strncmp(text, "sid=", 4) == 0) {
+                text += 4;
+                size_t n = strcspn(text, "; \t");
+                if (n == session_store::ID_LEN) {
+                    memcpy(m_cookie_sid, text, n);
+                    m_cookie_sid[n] = '\0';
+                }
+                break;
+            }
+            text += strcspn(text, ";");
+        }
     } else {
         // 日志
-        LOG_INFO("oop!unknow header: %s", text);
-        Log::get_instance()->flush();
+        LOG_DEBUG("oop!unknow header: %s", text);
     }
     return NO_REQUEST;
 }
@@ -432,10 +508,19 @@ http_conn::HTTP_CODE http_conn::parse_content(char* text) {
 
 
 /*------------根据请求报文生成响应正文----------*/
-=======
-// 生成响应报文 
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
 http_conn::HTTP_CODE http_conn::do_request() {
+    // 运行指标不对应文件，由process_write生成正文
+    if (strncmp(m_url, "/metrics", 8) == 0 && (m_url[8] == '\0' || m_url[8] == '?')) {
+        m_route = latency::METRICS;
+        return METRICS_REQUEST;
+    }
+    // 就绪状态同样由主线程直接处理，计入运行指标的路由
+    if (strncmp(m_url, "/ready", 6) == 0 && (m_url[6] == '\0' || m_url[6] == '?')) {
+        m_route = latency::METRICS;
+        return READY_REQUEST;
+    }
+    m_route = latency::STATIC;
+
     // 将初始化的m_read_file赋值为网站根目录
     strcpy(m_read_file, doc_root);
     int len = strlen(doc_root);  // doc_root字符串长度
@@ -445,7 +530,8 @@ http_conn::HTTP_CODE http_conn::do_request() {
 
     // 登录和注册校验（'/2'为登录校验，'/3'为注册校验）
     if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3')) {
-        
+        m_route = *(p + 1) == '2' ? latency::LOGIN : latency::REGISTER;
+
         // 将"/"赋值给m_url_real
         //根据标志判断是登录检测还是注册检测
         char flag = m_url[1];
@@ -460,43 +546,210 @@ http_conn::HTTP_CODE http_conn::do_request() {
         // 提取用户名和密码（原格式如下：user=123&password=123，以&分割，前面为用户名，后面是密码）
         char name[100], password[100];
         int i;
-        for (i = 5; m_string[i] != '&'; ++i) name[i - 5] = m_string[i];  // 从下标5开始提取（下标0-4为user=）
+        for (i = 5; m_string[i] != '&' && m_string[i] != '\0'; ++i) {  // 从下标5开始提取（下标0-4为user=）
+            if (i - 5 >= (int)sizeof(name) - 1) return BAD_REQUEST;  // 用户名过长
+            name[i - 5] = m_string[i];
+        }
         name[i - 5] = '\0';  // 结束标志位
+        if (m_string[i] == '\0') return BAD_REQUEST;  // 没有密码字段
         int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j) password[j] = m_string[i];
+        for (i = i + 10; m_string[i] != '\0'; ++i, ++j) {
+            if (j >= (int)sizeof(password) - 1) return BAD_REQUEST;  // 密码过长
+            password[j] = m_string[i];
+        }
         password[j] = '\0';
 
 
         // 校验
         // 注册校验
         if (*(p + 1) == '3') {
-
-            // 拼接SQL语句
-            char* sql_insert = (char*)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            // 如果数据库没有有重名的用户名则加入数据库，并更新users map表
-            if (users.find(name) == users.end()) {
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if (!res) strcpy(m_url, "/log.html");
-                else strcpy(m_url, "/registerError.html");
+            // 用户缓存中已经有该用户名则直接返回注册失败，否则加入数据库（由数据库判断是否重名），成功后放入用户缓存
+            if (!user_cache::get_instance()->contains(name)) {
+                // 用户名和密码作为预编译语句的参数，不拼接SQL
+                strcpy(m_sql_name, name);
+                strcpy(m_sql_passwd, password);
+                // 布隆过滤器判断用户名一定不存在时跳过重名查询，直接插入（启动时载入完成之前总是查询）
+                m_sql_checked = !filter_ready() || m_user_filter.may_contain(name);
+                if (!m_sql_checked) __atomic_fetch_add(&m_filter_skips, 1, __ATOMIC_RELAXED);
+
+                // 启用了批量写入则交给批量写入线程，和其他注册在同一个事务中写入，不占用连接
+                if (sql_batch::get_instance()->enabled()) {
+                    m_sql_task.arg = this;
+                    m_sql_step = SQL_BATCH_INSERT;
+                    // 提交后其他线程随时可能继续处理该连接，所以先设置挂起标志，提交之后不能再访问成员变量
+                    m_sql_time = latency::now();
+                    end_work(m_sql_time);
+                    m_sql_pending = true;
+                    sql_batch::get_instance()->submit(&m_sql_task, m_sql_name, m_sql_passwd, m_sql_checked);
+                    return SQL_PENDING;
+                }
+
+                // 从连接池中取出一个连接，由异步查询独占，查询完成后在finish_sql中归还
+                mysql = get_connection();
+                if (!mysql) return SERVICE_UNAVAILABLE;  // 在等待时间内没有获得连接，快速失败
+
+                // 用户名可能存在时先查询是否已经存在，不存在再插入
+                return start_sql(m_sql_checked ? SQL_CHECK_USER : SQL_INSERT_USER);
             } else strcpy(m_url, "/registerError.html");
         }
         else if (*(p + 1) == '2') {  // 登录校验
-            // 判断浏览器输入的用户名和密码是否可以查到
-            if (users.find(name) != users.end() && users[name] == password) strcpy(m_url, "/welcome.html");
+            // 先查用户缓存，未命中再从数据库查询该用户的密码并放入缓存
+            user_cache::LOOKUP ret = user_cache::get_instance()->check(name, password);
+            if (ret == user_cache::USER_MATCH) start_session(name);
+            else if (ret == user_cache::USER_MISMATCH) strcpy(m_url, "/logError.html");
+            else {
+                strcpy(m_sql_name, name);
+                strcpy(m_sql_passwd, password);
+                mysql = get_connection();
+                if (!mysql) return SERVICE_UNAVAILABLE;
+                return start_sql(SQL_LOGIN_USER);
+            }
+        }
+    } else if (*(p + 1) == '5' || *(p + 1) == '6' || *(p + 1) == '7' || strcmp(p, "/welcome.html") == 0) {
+        // 登录后才能访问的页面凭会话Cookie校验，没有有效的会话则跳转登录界面
+        if (!session_store::get_instance()->lookup(m_cookie_sid, NULL)) strcpy(m_url, "/1");
+    }
+    return do_file_request();
+}
+
+// 登录成功，创建会话并在响应中通过Set-Cookie发给浏览器，跳转欢迎界面
+void http_conn::start_session(const char* user) {
+    if (!session_store::get_instance()->create(user, m_set_sid)) {
+        LOG_WARN("%s", "session table is full");
+        m_set_sid[0] = '\0';
+    }
+    strcpy(m_url, "/welcome.html");
+}
+
+// 在当前持有的连接上执行一步数据库操作，使用连接上缓存的预编译语句，参数通过缓冲区绑定
+http_conn::HTTP_CODE http_conn::start_sql(SQL_STEP step) {
+    MYSQL_STMT* stmt = m_connPool->GetStatement(mysql, step == SQL_INSERT_USER ? STMT_INSERT_USER : STMT_SELECT_USER);
+    if (!stmt) {
+        m_connPool->ReleaseConnection(mysql);
+        mysql = NULL;
+        return INTERNAL_ERROR;
+    }
+
+    // 绑定参数：用户名（插入时还有密码）
+    memset(m_sql_param, 0, sizeof(m_sql_param));
+    m_sql_name_len = strlen(m_sql_name);
+    m_sql_param[0].buffer_type = MYSQL_TYPE_STRING;
+    m_sql_param[0].buffer = m_sql_name;
+    m_sql_param[0].buffer_length = m_sql_name_len;
+    m_sql_param[0].length = &m_sql_name_len;
+    if (step == SQL_INSERT_USER) {
+        m_sql_passwd_len = strlen(m_sql_passwd);
+        m_sql_param[1].buffer_type = MYSQL_TYPE_STRING;
+        m_sql_param[1].buffer = m_sql_passwd;
+        m_sql_param[1].buffer_length = m_sql_passwd_len;
+        m_sql_param[1].length = &m_sql_passwd_len;
+    }
+    mysql_stmt_bind_param(stmt, m_sql_param);
+
+    // 绑定结果：查询到的密码
+    if (step != SQL_INSERT_USER) {
+        memset(m_sql_bind, 0, sizeof(m_sql_bind));
+        m_sql_bind[0].buffer_type = MYSQL_TYPE_STRING;
+        m_sql_bind[0].buffer = m_sql_result;
+        m_sql_bind[0].buffer_length = sizeof(m_sql_result);
+        m_sql_bind[0].length = &m_sql_result_len;
+        m_sql_bind[0].is_null = &m_sql_result_null;
+        mysql_stmt_bind_result(stmt, m_sql_bind);
+    }
+
+    m_sql_task.conn = mysql;
+    m_sql_task.stmt = stmt;
+    m_sql_task.arg = this;
+    m_sql_task.store_result = (step != SQL_INSERT_USER);
+    m_sql_step = step;
+
+    // 提交后其他线程随时可能继续处理该连接，所以先设置挂起标志，提交之后不能再访问成员变量
+    m_sql_time = latency::now();
+    end_work(m_sql_time);
+    m_sql_pending = true;
+    if (!sql_async::get_instance()->submit_stmt(&m_sql_task)) return SQL_PENDING;
+    return finish_sql();
+}
+
+// 异步数据库操作完成（在提交查询的线程或者被主线程重新放入请求队列后调用）
+http_conn::HTTP_CODE http_conn::finish_sql() {
+    m_sql_pending = false;
+    // 在提交的线程中同步完成时没有经过queued，在这里结束数据库操作阶段
+    if (m_sql_time) {
+        uint64_t now = latency::now();
+        add_stage(latency::DB_QUERY, now - m_sql_time);
+        m_sql_time = 0;
+        m_work_time = now;
+    }
+    int err = m_sql_task.err;
+
+    if (m_sql_step == SQL_CHECK_USER || m_sql_step == SQL_LOGIN_USER) {
+        // 结果已经缓存在本地，读取后释放，否则连接上无法执行下一条语句
+        bool exists = false;
+        if (!err) {
+            int ret = mysql_stmt_fetch(m_sql_task.stmt);
+            exists = (ret == 0 || ret == MYSQL_DATA_TRUNCATED) && !m_sql_result_null;
+        }
+        mysql_stmt_free_result(m_sql_task.stmt);
+        if (err) LOG_ERROR("SELECT error:%s", mysql_stmt_error(m_sql_task.stmt));
+
+        // 查到的用户放入用户缓存，之后的登录和重名检查不再访问数据库
+        if (exists) {
+            if (m_sql_result_len >= sizeof(m_sql_result)) m_sql_result_len = sizeof(m_sql_result) - 1;
+            m_sql_result[m_sql_result_len] = '\0';
+            user_cache::get_instance()->put(m_sql_name, m_sql_result);
+            filter_add(m_sql_name);
+        }
+
+        if (m_sql_step == SQL_CHECK_USER) {
+            // 用户名不存在，在同一条连接上继续插入
+            if (!err && !exists) return start_sql(SQL_INSERT_USER);
+            strcpy(m_url, "/registerError.html");
+        } else {
+            if (exists && strcmp(m_sql_result, m_sql_passwd) == 0) start_session(m_sql_name);
             else strcpy(m_url, "/logError.html");
         }
+    } else if (m_sql_step == SQL_INSERT_USER || m_sql_step == SQL_BATCH_INSERT) {
+        if (err == sql_batch::BATCH_UNAVAILABLE) {
+            // 批量写入线程没有获得数据库连接
+            m_sql_step = SQL_NONE;
+            return SERVICE_UNAVAILABLE;
+        }
+        if (!err) {
+            user_cache::get_instance()->put(m_sql_name, m_sql_passwd);
+            filter_add(m_sql_name);
+            // 布隆过滤器判断可能存在但实际不存在，即一次误判
+            if (m_sql_checked) __atomic_fetch_add(&m_filter_false_pos, 1, __ATOMIC_RELAXED);
+            strcpy(m_url, "/log.html");
+        } else {
+            if (m_sql_step == SQL_INSERT_USER) LOG_ERROR("INSERT error:%s", mysql_stmt_error(m_sql_task.stmt));
+            strcpy(m_url, "/registerError.html");
+        }
     }
+    m_sql_step = SQL_NONE;
+
+    // 数据库操作全部结束后立即归还连接
+    m_connPool->ReleaseConnection(mysql);
+    mysql = NULL;
+
+    return do_file_request();
+}
+
+// 从连接池获取连接，等待的时间计入等待连接阶段，不计入解析阶段
+MYSQL* http_conn::get_connection() {
+    uint64_t start = latency::now();
+    MYSQL* conn = m_connPool->GetConnection();
+    uint64_t wait = latency::now() - start;
+    add_stage(latency::DB_WAIT, wait);
+    m_work_time += wait;
+    return conn;
+}
+
+// 根据m_url拼接目标文件路径，并将文件映射到内存
+http_conn::HTTP_CODE http_conn::do_file_request() {
+    int len = strlen(doc_root);  // doc_root字符串长度
+    const char* p = strrchr(m_url, '/');
+
     // 如果请求资源为'/0'，表示跳转注册界面
     if (*(p + 1) == '0') {
         // 将"/register.html"赋值给m_url_real
@@ -566,113 +819,51 @@ http_conn::HTTP_CODE http_conn::do_request() {
     return FILE_REQUEST;
 }
 
-<<<<<<< HEAD
-=======
-// 解析请求行，获得请求方法、目标url，http版本
-http_conn::HTTP_CODE http_conn::parse_request_line(char* text) {
-    // 在http报文中，请求行用来说明请求类型，要访问的资源以及所使用的http版本，其中各个部分通过空格和\t分割
-    
-    // 1.请求方法提取（请求行中最先含有空格和\t任意字符的位置并返回）
-    m_url = strpbrk(text, " \t");  // strpbrk是在源字符串（text）中找出最先含有搜索字符串（" \t"）中任一字符的位置并返回
-    if (!m_url) return BAD_REQUEST;  // 如果没有空格和\t，则报文格式错误
-    *m_url++ = '\0';  // 将当前位置改为\0，用于将前面数据取出
-    char* method = text; 
-    // GET和POST请求报文的区别之一是有无消息体部分，GET请求没有消息体，当解析完空行之后，便完成了报文的解析。
-    if (strcasecmp(method, "GET") == 0) m_method = GET;  // strcasecmp忽略大小写比较字符串
-    else if (strcasecmp(method, "POST") == 0) {
-        m_method == POST;
-        cgi = 1;
-    }
-    else return BAD_REQUEST;
-
-    // 2.version提取
-    m_url += strspn(m_url, " \t");
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version) return BAD_REQUEST;
-    *m_version++ = '\0';
-    m_version += strspn(m_version, " \t");
-    if (strcasecmp(m_version, "HTTP/1.1") != 0) return BAD_REQUEST;
 
-    // 3.目标url提取（http）
-    if (strncasecmp(m_url, "http://", 7) == 0) {
-        m_url += 7;
-        m_url = strchr(m_url, '/');  // 返回字符'/'第一次在字符串m_url中出现的位置，如果未找到字符，则返回 NULL
-    }
-    
-    // 3.目标url提取（https)
-    if (strncasecmp(m_url, "https://", 8) == 0) {
-        m_url += 8;
-        m_url = strchr(m_url, '/');
+// 由主线程在放入请求队列之前调用（新请求或者异步查询完成），此时没有其他线程访问该连接
+void http_conn::queued() {
+    m_queue_time = latency::now();
+    // 异步查询完成，结束数据库操作阶段
+    if (m_sql_time) {
+        add_stage(latency::DB_QUERY, m_queue_time - m_sql_time);
+        m_sql_time = 0;
     }
+}
 
-    // 通常不会有http和https符号，如果三种情况均不符，则返回错误
-    if(!m_url || m_url[0] != '/') return BAD_REQUEST;
-
-    // 当url为/时，显示欢迎界面
-    if (strlen(m_url) == 1) strcat(m_url, "judge.html");
-    // 请求行处理完毕，将主状态机转移到请求头
-    m_check_state = CHECK_STATE_HEADER;  
-
-    return NO_REQUEST;
+/*------------过载和超过限制时的响应----------*/
+void http_conn::init_reject_responses(int retry_after) {
+    const char* format = "HTTP/1.1 %d %s\r\nContent-Length:%d\r\nRetry-After:%d\r\nConnection:close\r\n\r\n%s";
+    m_busy_len = snprintf(m_busy_response, sizeof(m_busy_response), format, 503, error_503_title,
+                          (int)strlen(error_503_form), retry_after, error_503_form);
+    m_limited_len = snprintf(m_limited_response, sizeof(m_limited_response), format, 429, error_429_title,
+                             (int)strlen(error_429_form), retry_after, error_429_form);
 }
 
-// 解析http请求头
-//解析http请求的一个头部信息
-http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
-    if (text[0] == '\0') {
-        // 如果遇到空行，表示头部字段解析完毕
-        // 判断时GET请求还是POST请求
-        if (m_content_length != 0) {
-            // POST请求需要跳转到消息体处理状态
-            m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST;
-        }
-        return GET_REQUEST;
-    } else if (strncasecmp(text, "Connection:", 11) == 0) {
-        // 解析Connection头部字段，Connection: keep-alive
-        text += 11;
-        text += strspn(text, " \t");  // 跳过空格和\t字符（检索字符串text中第一个不在字符串" \t"中出现的字符下标）
-        if (strcasecmp(text, "keep-alive") == 0)  m_linger = true;  // 如果是长连接，则将linger标志设置为true
-    } else if (strncasecmp(text, "Content-length:", 15) == 0) {
-        // 解析Content-length头部字段
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    } else if (strncasecmp(text, "Host:", 5) == 0) {
-        // 解析HOST字段
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
-    } else {
-        // 日志
-        LOG_INFO("oop!unknow header: %s", text);
-        Log::get_instance()->flush();
-    }
-    return NO_REQUEST;
+void http_conn::send_busy(int sockfd) {
+    send_reject(sockfd, m_busy_response, m_busy_len, 503);
 }
 
-// 解析http请求体，判断http请求是否被完整读入
-http_conn::HTTP_CODE http_conn::parse_content(char* text) {
-    // 判断buffer中是否读入了消息体
-    if (m_read_idx >= (m_content_length + m_checked_idx)) {
-        text[m_content_length] = '\0';
+void http_conn::send_limited(int sockfd) {
+    send_reject(sockfd, m_limited_response, m_limited_len, 429);
+}
 
-        // POST请求中最后为输入的用户名和密码
-        m_string = text;
-        return GET_REQUEST;
+void http_conn::send_reject(int sockfd, const char* response, int len, int status) {
+    // 先读掉已经到达的请求数据，关闭时接收缓冲区中还有数据会发送RST，客户端可能收不到响应
+    char buf[1024];
+    for (int i = 0; i < 4 && recv(sockfd, buf, sizeof(buf), MSG_DONTWAIT) > 0; ++i) {}
+    // 响应很短，非阻塞地发送一次，发送失败也直接关闭
+    if (send(sockfd, response, len, MSG_DONTWAIT | MSG_NOSIGNAL) > 0) {
+        metrics::add(metrics::BYTES_OUT, len);
     }
-    return NO_REQUEST;
+    metrics::request(status);
 }
 
-
-
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
-
 /*------------写----------*/
 // 服务器主线程检测写事件，并调用http_conn::write函数将响应报文发送给浏览器端
 bool http_conn::write() {
     int temp = 0;  // 发送字节数
 
+    if (m_write_time == 0) m_write_time = latency::now();
     // 若要发送数据长度为0，表示响应报文为空，一般不会出现这种情况
     if (bytes_to_send == 0) {
         modfd(m_epollfd, m_sockfd, EPOLLIN);
@@ -690,13 +881,14 @@ bool http_conn::write() {
             unmap();
             return false;
         }
+        metrics::add(metrics::BYTES_OUT, temp);
         bytes_have_send += temp;
         bytes_to_send -= temp;
         // 第一个iovec头部信息的数据已发送完，发送第二个iovec数据
         if (bytes_have_send >= m_iv[0].iov_len) {
             // 不再继续发送头部信息
             m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + bytes_have_send - m_write_idx;
+            m_iv[1].iov_base = m_body_address + bytes_have_send - m_write_idx;
             m_iv[1].iov_len = bytes_to_send;
         } else {
             // 继续发送第一个iovec头部信息数据
@@ -705,6 +897,14 @@ bool http_conn::write() {
         }
         // 若数据全部发送完毕
         if (bytes_to_send <= 0) {
+            // 记录各阶段的耗时
+            uint64_t now = latency::now();
+            add_stage(latency::WRITE, now - m_write_time);
+            if (m_start_time) add_stage(latency::TOTAL, now - m_start_time);
+            latency::record(m_route, m_stage_ns, m_stage_mask);
+
+            metrics::request(m_status);
+            log_access();
             unmap();  // 取消映射
             // 重新注册写事件
             modfd(m_epollfd, m_sockfd, EPOLLIN);
@@ -717,6 +917,27 @@ bool http_conn::write() {
     }
 }
 
+// 写一行访问日志
+void http_conn::log_access() {
+    static const char* const method_names[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATH"};
+    access_log* log = access_log::get_instance();
+    if (!log->enabled()) return;
+
+    access_log::record r;
+    r.ip = m_address.sin_addr.s_addr;
+    r.method = method_names[m_method];
+    r.path = m_path[0] ? m_path : NULL;
+    r.path_len = -1;
+    r.version = m_version;
+    r.user = NULL;
+    r.status = m_status;
+    r.bytes = m_body_bytes;
+    r.usec = (m_stage_mask & (1u << latency::TOTAL)) ? m_stage_ns[latency::TOTAL] / 1000 : 0;
+    r.referer = m_referer;
+    r.agent = m_user_agent;
+    log->write(r);
+}
+
 // 关闭内存映射
 void http_conn::unmap() {
     if (m_file_address) {
@@ -737,6 +958,23 @@ bool http_conn::process_write(HTTP_CODE ret) {
             if (!add_content(error_500_form)) return false;
             break;
         }  
+        // 就绪状态：启动预热完成返回200，否则返回503（负载均衡据此决定是否转发流量）
+        case READY_REQUEST: {
+            bool ready = startup::get_instance()->ready();
+            const char* body = ready ? "ready\n" : "starting\n";
+            if (ready) add_status_line(200, ok_200_title);
+            else add_status_line(503, error_503_title);
+            add_headers(strlen(body));
+            if (!add_content(body)) return false;
+            break;
+        }
+        // 数据库连接池繁忙：503
+        case SERVICE_UNAVAILABLE: {
+            add_status_line(503, error_503_title);
+            add_headers(strlen(error_503_form));
+            if (!add_content(error_503_form)) return false;
+            break;
+        }
         // 语法错误：404
         case BAD_REQUEST: {
             add_status_line(404, error_404_title);
@@ -751,6 +989,24 @@ bool http_conn::process_write(HTTP_CODE ret) {
             if (!add_content(error_403_form)) return false;
             break;
         }
+        // 运行指标：200，正文由metrics生成，和文件一样用第二个iovec发送
+        case METRICS_REQUEST: {
+            m_body.clear();
+            metrics::render(m_body);
+            add_status_line(200, ok_200_title);
+            add_content_length(m_body.size());
+            add_response("Content-Type:%s\r\n", "text/plain; version=0.0.4");
+            add_linger();
+            if (!add_blank_line()) return false;
+            m_body_address = &m_body[0];
+            m_iv[0].iov_base = m_write_buf;
+            m_iv[0].iov_len = m_write_idx;
+            m_iv[1].iov_base = m_body_address;
+            m_iv[1].iov_len = m_body.size();
+            m_iv_count = 2;
+            bytes_to_send = m_write_idx + m_body.size();
+            return true;
+        }
         // 文件存在：200
         case FILE_REQUEST: {
             add_status_line(200, ok_200_title);
@@ -762,7 +1018,8 @@ bool http_conn::process_write(HTTP_CODE ret) {
                 // 这时候只申请一个iovec，指向m_write_buf
                 m_iv[0].iov_base = m_write_buf;
                 m_iv[0].iov_len = m_write_idx;
-                m_iv[1].iov_base = m_file_address;
+                m_body_address = m_file_address;
+                m_iv[1].iov_base = m_body_address;
                 m_iv[1].iov_len = m_file_stat.st_size;
                 m_iv_count = 2;
                 
@@ -791,16 +1048,16 @@ bool http_conn::process_write(HTTP_CODE ret) {
 bool http_conn::add_response(const char* format, ...) {
 
     // 如果写入内容超过m_write_buf的大小则报错
-    if (m_write_idx >= WRITE_BUFFER_SIZE) return false;
+    if (m_write_idx >= m_write_buf_size) return false;
 
     // 定义可变参数列表
     va_list arg_list;
     // 将arg_list初始化为传入参数
     va_start(arg_list, format);
     // 将数据format从可变参数列表写入写缓冲区，返回写入数据的长度
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list);
+    int len = vsnprintf(m_write_buf + m_write_idx, m_write_buf_size - 1 - m_write_idx, format, arg_list);
     // 如果写入的数据长度超过缓冲区剩余空间，则报错
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)) {
+    if (len >= (m_write_buf_size - 1 - m_write_idx)) {
         va_end(arg_list);  // 清空可变参数列表
         return false;
     }
@@ -808,26 +1065,27 @@ bool http_conn::add_response(const char* format, ...) {
     m_write_idx += len;
     va_end(arg_list);
     // 日志
-    LOG_INFO("request:%s", m_write_buf);
-    Log::get_instance()->flush(); 
+    LOG_DEBUG("request:%s", m_write_buf);
 
     return true;
 }
 
 // 添加状态行
 bool http_conn::add_status_line(int status, const char* title) {
+    m_status = status;
     return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
 }
 
 // 添加消息报头，具体添加文本长度、文本类型、连接状态和空行
 bool http_conn::add_headers(int content_len) {
-    add_content_length(content_len);
-    add_linger();
-    add_blank_line();
+    if (!add_content_length(content_len) || !add_linger()) return false;
+    if (m_set_sid[0] && !add_set_cookie()) return false;
+    return add_blank_line();
 }
 
 // 添加Content-Length，表示响应报文的长度
 bool http_conn::add_content_length(int content_len) {
+    m_body_bytes = content_len;
     return add_response("Content-Length:%d\r\n", content_len);
 }
 
@@ -841,6 +1099,11 @@ bool http_conn::add_linger() {
     return add_response("Connections:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
 }
 
+// 添加Set-Cookie，下发登录成功后创建的会话ID
+bool http_conn::add_set_cookie() {
+    return add_response("Set-Cookie:sid=%s; Path=/; Max-Age=%d; HttpOnly\r\n", m_set_sid, session_store::get_instance()->ttl());
+}
+
 // 添加空行
 bool http_conn::add_blank_line() {
     return add_response("%s", "\r\n");
@@ -852,22 +1115,33 @@ bool http_conn::add_content(const char* content) {
 }
 
 
-<<<<<<< HEAD
 /*------------子线程处理读写入口----------*/
-=======
-/*------------读写入口----------*/
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
 // 由线程池中的工作线程调用，这是处理http请求的入口函数
 void http_conn::process() {
-    // 解析http请求
-    HTTP_CODE read_ret = process_read();
+    m_work_time = latency::now();
+    if (m_queue_time) {
+        add_stage(latency::QUEUE, m_work_time - m_queue_time);
+        m_queue_time = 0;
+    }
+
+    // 解析http请求（若是异步查询完成后被重新放入请求队列，则继续处理查询结果）
+    HTTP_CODE read_ret = m_sql_pending ? finish_sql() : process_read();
+    // 数据库操作挂起时已经在提交前结束了这一段处理
+    if (read_ret != SQL_PENDING) end_work(latency::now());
     if (read_ret == NO_REQUEST) {
         modfd(m_epollfd, m_sockfd, EPOLLIN);  // 表示请求不完整，需要继续接收请求数据，注册并监听读事件
+        release();
         return;
     }
 
+    // 数据库操作挂起，查询完成后由主线程将该连接重新放入请求队列。挂起期间继续持有该连接，主线程不会关闭它，
+    // 查询完成后一定会回到这里（finish_sql归还数据库连接），异步查询的上下文也不会被新连接覆盖
+    if (read_ret == SQL_PENDING) return;
+
     // 生成响应
     bool write_ret = process_write(read_ret);
     if (!write_ret) close_conn();
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);  // 注册并监听写事件
+    else modfd(m_epollfd, m_sockfd, EPOLLOUT);  // 注册并监听写事件
+    // 重新注册事件之后才释放，主线程在此之前不会关闭该连接；之后不能再访问成员变量
+    release();
 }
\ No newline at end of file
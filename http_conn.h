@@ -16,20 +16,43 @@
 #include <stdarg.h>  // 提供va_list宏
 #include <sys/uio.h>  // 提供writev函数
 #include <map>
+#include <string>
+#include <vector>
 
+#include "lock.h"
 #include "sql_connection_pool.h"
+#include "sql_async.h"
+#include "sql_batch.h"
+#include "user_cache.h"
+#include "bloom_filter.h"
+#include "session_store.h"
+#include "access_log.h"
+#include "metrics.h"
+#include "latency.h"
 class http_conn {
 public:
 
     static int m_epollfd;  // 所有socket上的事件都被注册到同一个epoll
-    static int m_user_count;  // 统计用户数量
-    static const int READ_BUFFER_SIZE = 2048;  // 读缓冲区的大小
-    static const int WRITE_BUFFER_SIZE = 1024;  // 写缓冲区的大小
+    static int m_user_count;  // 统计用户数量（主线程和工作线程都会修改，用原子操作）
+    static connection_pool* m_connPool;  // 数据库连接池，只有访问数据库的请求才会从中获取连接
+    static bloom_filter m_user_filter;  // 所有用户名的布隆过滤器，注册时判断一定不存在的用户名可以跳过重名查询
+    static uint64_t m_filter_skips;  // 布隆过滤器判断用户名一定不存在、跳过重名查询的注册数
+    static uint64_t m_filter_false_pos;  // 布隆过滤器判断可能存在、实际不存在并注册成功的注册数
+    static bool m_filter_ready;  // 布隆过滤器是否已经完整载入（载入期间不使用）
+    static bool m_filter_loading;  // 是否正在后台载入布隆过滤器（m_filter_lock保护）
+    static std::vector<std::string> m_filter_pending;  // 载入期间新增的用户名，载入完成时补充到布隆过滤器
+    static mutex m_filter_lock;  // 保护m_filter_loading和m_filter_pending，以及载入完成的切换
+    static int m_read_buf_size;  // 读缓冲区的大小（启动时按配置设置）
+    static int m_write_buf_size;  // 写缓冲区的大小（启动时按配置设置）
+    static bool m_conn_et;  // 连接socket是否使用边缘触发
+    static char m_busy_response[512];  // 过载时回复的503响应（带Retry-After，回复后关闭连接）
+    static int m_busy_len;  // 503响应的长度
+    static char m_limited_response[512];  // 客户端超过连接数或者请求速率时回复的429响应
+    static int m_limited_len;  // 429响应的长度
     static const int FILENAME_LEN = 200;  // 读取文件名称m_read_file大小
+    static const int USER_FILTER_MIN = 65536;  // 布隆过滤器至少按这么多用户分配
 
-    MYSQL* mysql;  // 数据库
-    map<string, string> users;  // 用户名（key）和密码（value）
-    mutex m_lock;
+    MYSQL* mysql;  // 数据库（只在查询期间持有，查询结束后立即归还连接池）
 
     // http报文请求方法（声明METHOD为新的数据类型，称为枚举，里面的GET，POST...称为枚举量，其值默认分别为0，1，...）
     enum METHOD {
@@ -58,6 +81,15 @@ public:
         LINE_OPEN  // 行数据不完整
     };
 
+    // 挂起的数据库操作
+    enum SQL_STEP {
+        SQL_NONE = 0,  // 没有数据库操作
+        SQL_CHECK_USER,  // 注册时查询用户名是否已经存在
+        SQL_INSERT_USER,  // 注册时插入新用户
+        SQL_BATCH_INSERT,  // 注册交给批量写入线程
+        SQL_LOGIN_USER  // 登录时用户缓存未命中，从数据库查询密码
+    };
+
     // 报文解析结果
     enum HTTP_CODE {
         NO_REQUEST,  // 表示请求不完整，需要继续读取客户数据
@@ -67,11 +99,18 @@ public:
         FORBIDDEN_REQUEST,  // 表示客户对资源没有足够的权限访问
         FILE_REQUEST,  // 表示文件请求，获取文件成功
         INTERNAL_ERROR,  // 表示服务器内部错误
-        CLOSED_CONNECTION  // 表示客户端已经关闭连接
+        CLOSED_CONNECTION,  // 表示客户端已经关闭连接
+        SERVICE_UNAVAILABLE,  // 表示在等待时间内没有获得数据库连接
+        METRICS_REQUEST,  // 表示请求运行指标
+        READY_REQUEST,  // 表示请求就绪状态（启动预热是否完成）
+        SQL_PENDING  // 表示数据库操作已经提交，等待主线程在查询完成后将请求重新放入请求队列
     };
 
-    http_conn() {}  // 构造函数
-    ~http_conn() {}  // 析构函数
+    http_conn() : m_read_buf(NULL), m_write_buf(NULL), m_holds(0) {}  // 构造函数
+    ~http_conn() {  // 析构函数
+        delete[] m_read_buf;
+        delete[] m_write_buf;
+    }
 
 public:
     void process();  // 处理客户端请求
@@ -79,27 +118,71 @@ public:
     void close_conn(bool real_close = true);  // 关闭连接
     bool read();  // 非阻塞读
     bool write();  // 非阻塞写
+    void queued();  // 放入线程池请求队列之前调用，记录入队时间
+    // 把一段请求报文当作连接上的新请求解析，不处理请求、不访问socket（微基准测试bench/micro_bench.cpp使用），
+    // 返回值同process_read的解析部分，完整的请求返回GET_REQUEST
+    HTTP_CODE parse(const char* request, int len);
+
+    // 工作线程持有该连接（已经放入请求队列或者正在处理）期间，主线程不能关闭文件描述符和归还连接对象，否则它们被
+    // 新连接复用后，旧请求会在新连接上继续处理。主线程交给工作线程之前调用hold，process结束时调用release
+    // （数据库操作挂起时不释放，查询完成、重新入队处理结束后才释放）
+    void hold() { __atomic_add_fetch(&m_holds, 1, __ATOMIC_RELAXED); }
+    void release() { __atomic_sub_fetch(&m_holds, 1, __ATOMIC_RELEASE); }
+    bool held() { return __atomic_load_n(&m_holds, __ATOMIC_ACQUIRE) > 0; }
+
+    // 读缓冲区为空，下一次读到的是一个新请求的开头（请求分多次到达时只有第一次读之前为true）
+    bool at_request_start() { return m_read_idx == 0; }
+
+    // 是否是可以由主线程直接处理的请求（运行指标和就绪状态），这类请求不经过线程池的请求队列
+    bool is_local_request() {
+        if (m_sql_pending) return false;
+        if (m_read_idx > 12 && strncmp(m_read_buf, "GET /metrics", 12) == 0) {
+            return m_read_buf[12] == ' ' || m_read_buf[12] == '?';
+        }
+        return m_read_idx > 10 && strncmp(m_read_buf, "GET /ready", 10) == 0 &&
+               (m_read_buf[10] == ' ' || m_read_buf[10] == '?');
+    }
+
+    // 生成过载（503）和超过客户端限制（429）时回复的响应（启动时调用一次），retry_after为建议客户端重试的秒数
+    static void init_reject_responses(int retry_after);
+    // 由主线程直接向sockfd发送预先生成的503或429响应，不经过请求队列，调用者随后关闭连接
+    static void send_busy(int sockfd);
+    static void send_limited(int sockfd);
+
+    // 布隆过滤器载入完成后才可以使用
+    static bool filter_ready() {
+        return __atomic_load_n(&m_filter_ready, __ATOMIC_ACQUIRE);
+    }
+    // 把注册成功或者查到的用户名加入布隆过滤器，载入期间先记下，载入完成时补充
+    static void filter_add(const char* name);
 
     // 为外部获取通信socket地址提供接口
     sockaddr_in* get_address() {
         return &m_address;
     }
 
-    // 载入数据库表
-    void initmysql_result(connection_pool* connPool);
+    // 载入数据库表，建立用户名的布隆过滤器（目标误判率fp_rate），并预热用户缓存（最多载入limit个用户），
+    // 可以在服务器处理请求时在后台调用，布隆过滤器完整载入后返回true
+    static bool initmysql_result(connection_pool* connPool, int limit, double fp_rate);
 
 private:
+    static void filter_abort();  // 载入布隆过滤器失败，清空并停止记下新增的用户名
     void init();  // 初始化连接其他信息
     HTTP_CODE process_read();  // 从m_read_buf读取，并处理请求报文
+    HTTP_CODE parse_request();  // 解析m_read_buf中已经读到的请求报文（process_read和parse共用）
     bool process_write(HTTP_CODE ret);  // 向m_write_buf写入响应报文数据
 
-    // 以下函数被process_read函数调用以分析http请求
+    // 以下函数被parse_request函数调用以分析http请求
     LINE_STATUS parse_line();  // 从状态机读取一行，分析是请求报文的哪一部分
     char* get_line() { return m_read_buf + m_start_line; }  // 获取一行数据，m_start_line是已经解析的字符，get_line用于将指针向后偏移，指向未处理的字符
     HTTP_CODE parse_request_line(char* text);  // 主状态机解析请求报文中的请求行
     HTTP_CODE parse_headers(char* text);  // 主状态机解析请求报文中的请求头
     HTTP_CODE parse_content(char* text);  // 主状态机解析请求报文中的请求体
     HTTP_CODE do_request();  // 生成响应报文
+    HTTP_CODE do_file_request();  // 将请求的文件映射到内存，do_request和异步查询完成后调用
+    HTTP_CODE start_sql(SQL_STEP step);  // 在当前持有的连接上绑定参数并异步执行预编译语句
+    HTTP_CODE finish_sql();  // 异步数据库操作完成，根据结果继续下一步操作或者选择跳转页面并继续生成响应报文
+    void start_session(const char* user);  // 登录成功，创建会话并跳转欢迎界面
 
     // 以下函数被process_write函数调用（根据响应报文格式，生成对应函数）
     bool add_response(const char* format, ...);  // 每次添加到写缓存区时进行判断（在声明不肯定形参的函数时，形参部分可使用省略号"..."代替）
@@ -108,46 +191,101 @@ private:
     bool add_content_length(int content_len);  // 添加Content-Length，表示响应报文的长度
     bool add_content_type();  // 添加文本类型
     bool add_linger();  // 添加连接状态，通知浏览器时保持连接还是关闭连接
+    bool add_set_cookie();  // 添加Set-Cookie，下发会话ID
     bool add_blank_line();  // 添加空行
     bool add_content(const char* content);  // 添加文本content
 
+    static void send_reject(int sockfd, const char* response, int len, int status);  // send_busy和send_limited调用
     void unmap();  // 关闭内存映射 
+    void log_access();  // 响应发送完毕，写一行访问日志
+    MYSQL* get_connection();  // 从连接池获取连接，记录等待的时间
+
+    // 累加一个阶段的耗时
+    void add_stage(int stage, uint64_t ns) {
+        m_stage_ns[stage] += ns;
+        m_stage_mask |= 1u << stage;
+    }
+    // 工作线程的一段处理结束（请求不完整、提交了数据库操作或者生成了响应），计入解析阶段
+    void end_work(uint64_t now) {
+        add_stage(latency::PARSE, now - m_work_time);
+    }
 
 private:
+    // 热数据：主线程每次处理读写事件都会访问的字段放在对象开头，对象从slab中按缓存行对齐分配，
+    // 这些字段（连同mysql）正好占前两条缓存行；解析请求、生成响应和数据库操作用到的字段在后面
     int m_sockfd;  // 该http连接的socket
+    int m_read_idx;  // 读缓冲区m_read_buf中已经读入的客户端数据的最后一个字节的下一个位置
+    char* m_read_buf;  // 读缓冲区（第一次使用该连接时按m_read_buf_size分配，之后一直重用）
+    bool m_linger;  // 判断http请求是否保持连接
+    bool m_sql_pending;  // 是否有挂起的数据库操作，工作线程据此判断是继续处理查询结果还是解析新的请求
+    int m_iv_count;  // 结构体的个数，几块内存
+    struct iovec m_iv[2];  // io向量机制iovec，里面有两个元素，指针成员iov_base指向一个缓冲区，存放的是writev将要发送的数据，成员iov_len表示实际写入的长度，该变量用于writev函数
+    int bytes_to_send;  // 剩余发送字节数
+    int bytes_have_send;  // 已发送字节数
+    char* m_write_buf;  // 写缓冲区（同上，按m_write_buf_size分配）
+    int m_write_idx;  // 指示buffer中的长度
+    char* m_body_address;  // 响应正文的地址（文件的内存映射或者m_body）
+    uint64_t m_start_time;  // 开始读取这个请求的时间（单调时钟，纳秒）
+    uint64_t m_write_time;  // 第一次writev的时间
     sockaddr_in m_address;  // 通信的socket地址
 
+    // 以下为冷数据
     CHECK_STATE m_check_state;  // 主状态机当前所处的状态
     METHOD m_method;  // 请求方法
 
-    // 存储读取的请求报文数据
-    char m_read_buf[READ_BUFFER_SIZE];  // 读缓冲区
-    int m_read_idx;  // 读缓冲区m_read_buf中已经读入的客户端数据的最后一个字节的下一个位置
+    // 解析读缓冲区中的请求报文的位置
     int m_checked_idx;  // 当前正在分析的字符在读缓冲的位置
     int m_start_line;  // 当前正在解析的行在buf中的起始位置，将该位置后面的数据赋给text
-    
-    // 存储发出的响应报文数据
-    char m_write_buf[WRITE_BUFFER_SIZE];  // 写缓冲区
-    int m_write_idx;  // 指示buffer中的长度
 
     // 以下为解析请求报文中对应的变量
     char* m_url;  // 请求目标文件的文件名
     char* m_version;  // 协议版本
     char* m_host;  // 主机名
-    bool m_linger;  // 判断http请求是否保持连接
     int m_content_length;  // 请求体长度
     char m_read_file[FILENAME_LEN];  // 存储读取文件名称
 
+    // 访问日志相关变量
+    char m_path[FILENAME_LEN];  // 请求行中的原始路径（m_url之后会被就地改写，需要拷贝）
+    char* m_referer;  // Referer头部字段
+    char* m_user_agent;  // User-Agent头部字段
+    int m_status;  // 响应状态码
+    int m_body_bytes;  // 响应正文的字节数
+
+    // 各阶段耗时相关变量（单调时钟，纳秒）
+    uint64_t m_stage_ns[latency::STAGES];  // 各阶段累计的耗时
+    unsigned m_stage_mask;  // 经过了哪些阶段
+    int m_route;  // 请求的路由，在do_request中确定
+    uint64_t m_queue_time;  // 放入请求队列的时间
+    uint64_t m_work_time;  // 工作线程开始这一段处理的时间（扣除等待数据库连接的时间）
+    uint64_t m_sql_time;  // 提交数据库操作的时间
+
     // 操作m_read_file相关变量
     struct stat m_file_stat;  // m_read_file的文件属性（stat函数的传出参数），stat结构体中有st_mode（文件类型和权限），st_size（文件大小，字节数）
     char* m_file_address;  // 读服务器上的文件地址（m_read_file内存映射地址）
+    std::string m_body;  // 生成的响应正文（运行指标）
     
     char* m_string;  // 存储请求数据
     int cgi;  // 是否启用的POST
-    struct iovec m_iv[2];  // io向量机制iovec，里面有两个元素，指针成员iov_base指向一个缓冲区，存放的是writev将要发送的数据，成员iov_len表示实际写入的长度，该变量用于writev函数
-    int m_iv_count;  // 结构体的个数，几块内存
-    int bytes_to_send;  // 剩余发送字节数
-    int bytes_have_send;  // 已发送字节数
+    int m_holds;  // 持有该连接的次数（hold加1，release减1），对象复用时不重置
+
+    // 会话相关变量
+    char m_cookie_sid[session_store::ID_LEN + 1];  // 请求Cookie中的会话ID
+    char m_set_sid[session_store::ID_LEN + 1];  // 登录成功后新建的会话ID，通过Set-Cookie发给浏览器
+
+    // 异步数据库操作相关变量
+    sql_task m_sql_task;  // 异步查询上下文
+    SQL_STEP m_sql_step;  // 挂起的是哪一步数据库操作
+    bool m_sql_checked;  // 注册时是否需要查询用户名是否已经存在（布隆过滤器判断可能存在）
+    // 预编译语句绑定的参数和结果缓冲区，执行完成前必须保持有效
+    char m_sql_name[100];  // 查询对应的用户名
+    char m_sql_passwd[100];  // 查询对应的密码
+    unsigned long m_sql_name_len;
+    unsigned long m_sql_passwd_len;
+    char m_sql_result[100];  // 查询结果（密码）
+    unsigned long m_sql_result_len;
+    my_bool m_sql_result_null;
+    MYSQL_BIND m_sql_param[2];  // 语句参数
+    MYSQL_BIND m_sql_bind[1];  // 语句结果
 
 };
 
@@ -0,0 +1,146 @@
+#include <string.h>
+#include <unistd.h>
+
+#include "ip_limiter.h"
+#include "latency.h"
+#include "metrics.h"
+
+// murmur3的finalizer
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+ip_limiter* ip_limiter::get_instance() {
+    static ip_limiter instance;
+    return &instance;
+}
+
+ip_limiter::ip_limiter() : m_max_conn(0), m_rate(0), m_burst(0), m_seed(0), m_window_end(0) {
+    memset(m_conns, 0, sizeof(m_conns));
+    memset(m_requests, 0, sizeof(m_requests));
+    memset(m_table, 0, sizeof(m_table));
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void ip_limiter::init(int max_conn, int rate, int burst) {
+    m_max_conn = max_conn;
+    m_rate = rate;
+    m_burst = burst > 0 ? burst : rate;  // 不设置突发数时允许一秒的请求量
+    m_seed = mix(latency::now() ^ ((uint64_t)getpid() << 32));
+}
+
+uint64_t ip_limiter::hash(uint32_t ip) {
+    return mix(ip ^ m_seed);
+}
+
+bool ip_limiter::acquire(uint32_t ip) {
+    if (m_max_conn <= 0) return true;
+    uint64_t h = hash(ip);
+    uint32_t est = UINT32_MAX;
+    for (int r = 0; r < DEPTH; ++r) {
+        uint32_t c = m_conns[r][index(h, r)];
+        if (c < est) est = c;
+    }
+    if (est >= (uint32_t)m_max_conn) {
+        ++m_stats.conn_rejects;
+        return false;
+    }
+    for (int r = 0; r < DEPTH; ++r) ++m_conns[r][index(h, r)];
+    return true;
+}
+
+void ip_limiter::release(uint32_t ip) {
+    if (m_max_conn <= 0) return;
+    uint64_t h = hash(ip);
+    for (int r = 0; r < DEPTH; ++r) {
+        uint32_t& c = m_conns[r][index(h, r)];
+        if (c > 0) --c;
+    }
+}
+
+bool ip_limiter::allow(uint32_t ip, uint64_t now) {
+    if (m_rate <= 0) return true;
+    uint64_t h = hash(ip);
+
+    entry* e = find(ip, h);
+    if (!e) {
+        // 每秒清零一次请求数
+        if (now >= m_window_end) {
+            memset(m_requests, 0, sizeof(m_requests));
+            m_window_end = now + 1000000000ULL;
+        }
+        // 保守更新：只增加等于最小值的计数器，减少其他客户端的碰撞带来的高估
+        uint32_t est = UINT32_MAX;
+        for (int r = 0; r < DEPTH; ++r) {
+            uint32_t c = m_requests[r][index(h, r)];
+            if (c < est) est = c;
+        }
+        ++est;
+        for (int r = 0; r < DEPTH; ++r) {
+            uint32_t& c = m_requests[r][index(h, r)];
+            if (c < est) c = est;
+        }
+        if (est <= (uint32_t)m_burst) return true;
+
+        // 一秒内超过了突发数，放入精确表，突发的额度已经用完，令牌从0开始
+        e = insert(ip, h, now);
+        ++m_stats.promotions;
+    }
+
+    // 令牌桶：按经过的时间补充令牌，最多burst个，每个请求消耗一个
+    double tokens = e->tokens + (now - e->last) / 1e9 * m_rate;
+    if (tokens > m_burst) tokens = m_burst;
+    e->last = now;
+    if (tokens < 1) {
+        e->tokens = tokens;
+        ++m_stats.rate_rejects;
+        return false;
+    }
+    e->tokens = tokens - 1;
+    return true;
+}
+
+ip_limiter::entry* ip_limiter::find(uint32_t ip, uint64_t h) {
+    uint32_t start = (uint32_t)(h >> 40);
+    for (int i = 0; i < PROBES; ++i) {
+        entry* e = &m_table[(start + i) & (TABLE_SIZE - 1)];
+        if (!e->used) return NULL;  // 插入时从前往后找空位，遇到空位说明不在表中
+        if (e->ip == ip) return e;
+    }
+    return NULL;
+}
+
+ip_limiter::entry* ip_limiter::insert(uint32_t ip, uint64_t h, uint64_t now) {
+    uint32_t start = (uint32_t)(h >> 40);
+    entry* victim = NULL;
+    for (int i = 0; i < PROBES; ++i) {
+        entry* e = &m_table[(start + i) & (TABLE_SIZE - 1)];
+        if (!e->used) {
+            victim = e;
+            ++m_stats.tracked;
+            break;
+        }
+        // 探测范围内都被占用时替换最久没有请求的客户端（它的令牌桶多半已经补满）
+        if (!victim || e->last < victim->last) victim = e;
+    }
+    victim->ip = ip;
+    victim->used = true;
+    victim->tokens = 0;
+    victim->last = now;
+    return victim;
+}
+
+void ip_limiter::render(std::string& out) {
+    metrics::append(out, "webserver_ip_connections_rejected_total", "counter",
+                    "Connections refused because the client IP had too many open connections.",
+                    m_stats.conn_rejects);
+    metrics::append(out, "webserver_ip_requests_limited_total", "counter",
+                    "Requests refused because the client IP exceeded its request rate.", m_stats.rate_rejects);
+    metrics::append(out, "webserver_ip_tracked_clients", "gauge",
+                    "Client IPs tracked individually after exceeding the burst.", m_stats.tracked);
+}
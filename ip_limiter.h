@@ -0,0 +1,77 @@
+#ifndef IP_LIMITER_H
+#define IP_LIMITER_H
+
+#include <stdint.h>
+#include <string>
+
+// 按客户端IP限制同时保持的连接数和请求速率，防止单个客户端占满连接数组和请求队列。
+// 连接数用count-min sketch统计：每行用不同的哈希选一个计数器，估计值取各行的最小值（只会高估，不会低估），
+// 不需要为每个IP分配表项。请求数先记入每秒清零的sketch，一秒内不超过burst个请求的客户端只需要更新sketch；
+// 超过的客户端放入精确表（少数的高频客户端），之后按令牌桶（每秒补充rate个，最多burst个）限制。
+// 接受连接、分发请求和关闭连接（定时器回调）都在主线程中进行，所有数据只由主线程访问，不需要锁
+class ip_limiter {
+public:
+    static const int DEPTH = 4;  // sketch的行数
+    static const int WIDTH = 4096;  // 每行的计数器个数（2的幂）
+    static const int TABLE_SIZE = 1024;  // 精确表的槽位数（2的幂）
+    static const int PROBES = 8;  // 精确表线性探测的最大长度，满时替换其中最久没有请求的客户端
+
+    // 统计信息
+    struct limit_stats {
+        uint64_t conn_rejects;  // 超过连接数上限而拒绝的连接数
+        uint64_t rate_rejects;  // 超过速率而拒绝的请求数
+        uint64_t promotions;  // 放入精确表的次数
+        unsigned int tracked;  // 精确表中的客户端数
+    };
+
+    // 局部静态变量单例模式
+    static ip_limiter* get_instance();
+
+    // max_conn为每个IP最多同时保持的连接数，rate为每个IP每秒的请求数，burst为允许的突发请求数，为0时不限制
+    void init(int max_conn, int rate, int burst);
+
+    // 接受连接时调用，超过连接数上限时返回false（不计数）；返回true的连接关闭时需要调用release
+    bool acquire(uint32_t ip);
+    void release(uint32_t ip);
+
+    // 分发请求时调用，超过速率时返回false，now为单调时钟（纳秒）
+    bool allow(uint32_t ip, uint64_t now);
+
+    // 按Prometheus文本格式输出拒绝的连接数、请求数和精确表中的客户端数
+    void render(std::string& out);
+
+private:
+    // 精确表中的客户端（令牌桶）
+    struct entry {
+        uint32_t ip;
+        bool used;
+        double tokens;  // 当前的令牌数
+        uint64_t last;  // 上次补充令牌的时间
+    };
+
+    ip_limiter();
+
+    uint64_t hash(uint32_t ip);
+    // 第row行的计数器下标（双重哈希：低32位加上行号乘以高32位）
+    static uint32_t index(uint64_t h, int row) {
+        return (uint32_t)(h + row * ((h >> 32) | 1)) & (WIDTH - 1);
+    }
+
+    entry* find(uint32_t ip, uint64_t h);
+    entry* insert(uint32_t ip, uint64_t h, uint64_t now);
+
+private:
+    int m_max_conn;
+    int m_rate;
+    int m_burst;
+    uint64_t m_seed;  // 哈希种子，启动时随机生成，客户端无法构造碰撞的地址
+
+    uint32_t m_conns[DEPTH][WIDTH];  // 连接数的sketch
+    uint32_t m_requests[DEPTH][WIDTH];  // 当前一秒内请求数的sketch
+    uint64_t m_window_end;  // 当前一秒结束的时间
+    entry m_table[TABLE_SIZE];  // 精确表
+
+    limit_stats m_stats;
+};
+
+#endif
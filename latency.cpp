@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "latency.h"
+#include "metrics.h"
+
+__thread latency::shard* latency::t_shard = NULL;
+
+// 所有线程的直方图
+static latency::shard* g_shards = NULL;
+static pthread_mutex_t g_shards_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* const stage_names[latency::STAGES] = {"queue", "parse", "db_wait", "db_query", "write", "total"};
+static const char* const route_names[latency::ROUTES] = {"static", "login", "register", "metrics", "other"};
+
+// 输出的分位数
+static const double quantiles[] = {50, 90, 99, 99.9};
+static const char* const quantile_labels[] = {"0.5", "0.9", "0.99", "0.999"};
+
+const char* latency::stage_name(int stage) {
+    return stage_names[stage];
+}
+
+const char* latency::route_name(int route) {
+    return route_names[route];
+}
+
+latency::shard* latency::register_thread() {
+    // 线程结束后直方图保留（记录仍然有效）
+    shard* s = new shard;
+
+    pthread_mutex_lock(&g_shards_lock);
+    s->next = g_shards;
+    __atomic_store_n(&g_shards, s, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_shards_lock);
+
+    t_shard = s;
+    return s;
+}
+
+void latency::record(int route, const uint64_t* stage_ns, unsigned mask) {
+    shard* s = t_shard;
+    if (!s) s = register_thread();
+    histogram* hist = s->hist[route];
+    for (int i = 0; i < STAGES; ++i) {
+        if (mask & (1u << i)) hist[i].record(stage_ns[i]);
+    }
+}
+
+void latency::merge(int route, int stage, histogram* out) {
+    out->reset();
+    for (shard* s = __atomic_load_n(&g_shards, __ATOMIC_ACQUIRE); s; s = s->next) {
+        if (route < ROUTES) {
+            out->merge(s->hist[route][stage]);
+        } else {
+            for (int r = 0; r < ROUTES; ++r) out->merge(s->hist[r][stage]);
+        }
+    }
+}
+
+void latency::render(std::string& out) {
+    static const char* name = "webserver_request_stage_seconds";
+    out += "# HELP webserver_request_stage_seconds Time spent in each request processing stage by route.\n"
+           "# TYPE webserver_request_stage_seconds summary\n";
+
+    histogram* h = new histogram;  // 直方图较大，不放在栈上
+    char metric[64], labels[96];
+    for (int route = 0; route < ROUTES; ++route) {
+        for (int stage = 0; stage < STAGES; ++stage) {
+            merge(route, stage, h);
+            if (h->count() == 0) continue;
+            for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q) {
+                snprintf(labels, sizeof(labels), "stage=\"%s\",route=\"%s\",quantile=\"%s\"", stage_names[stage],
+                         route_names[route], quantile_labels[q]);
+                metrics::append_sample(out, name, h->percentile(quantiles[q]) / 1e9, labels);
+            }
+            snprintf(labels, sizeof(labels), "stage=\"%s\",route=\"%s\"", stage_names[stage], route_names[route]);
+            snprintf(metric, sizeof(metric), "%s_sum", name);
+            metrics::append_sample(out, metric, h->sum() / 1e9, labels);
+            snprintf(metric, sizeof(metric), "%s_count", name);
+            metrics::append_sample(out, metric, h->count(), labels);
+        }
+    }
+    delete h;
+}
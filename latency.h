@@ -0,0 +1,67 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+#include "histogram.h"
+
+// 请求各阶段的耗时分布：每个请求在处理过程中把各阶段的耗时（单调时钟，纳秒）累加到连接对象上，响应发送完毕后
+// 一次性记入当前线程的直方图（按路由和阶段区分），热路径上没有锁；抓取或者定时统计时合并所有线程的直方图，
+// 输出各阶段的p50、p90、p99、p99.9。直方图只由所属线程写入，合并时读到的可能是正在更新的值，分位数只是近似
+class latency {
+public:
+    // 阶段
+    enum STAGE {
+        QUEUE = 0,  // 在线程池请求队列中等待（异步查询完成后重新入队的等待也计入）
+        PARSE,  // 工作线程中解析请求并生成响应（process_read，不含等待数据库连接）
+        DB_WAIT,  // 等待数据库连接池的连接
+        DB_QUERY,  // 数据库操作从提交到完成
+        WRITE,  // 从第一次writev到响应发送完毕（包括等待socket可写）
+        TOTAL,  // 从读到请求的第一个字节到响应发送完毕
+        STAGES
+    };
+
+    // 路由
+    enum ROUTE {
+        STATIC = 0,  // 静态页面
+        LOGIN,  // 登录校验
+        REGISTER,  // 注册校验
+        METRICS,  // 运行指标
+        OTHER,  // 解析失败等没有到达do_request的请求
+        ROUTES
+    };
+
+    // 每个线程的直方图，第一次记录时创建，之后一直保留
+    struct shard {
+        histogram hist[ROUTES][STAGES];
+        shard* next;  // 所有线程的直方图串成链表
+    };
+
+    // 单调时钟（纳秒）
+    static uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // 记录一个完成的请求，stage_ns为各阶段的耗时，mask中对应位为1的阶段才记录
+    static void record(int route, const uint64_t* stage_ns, unsigned mask);
+
+    // 合并所有线程中某个路由、某个阶段的直方图，route为ROUTES时合并所有路由（各线程可以同时记录，见histogram::merge）
+    static void merge(int route, int stage, histogram* out);
+
+    // 按Prometheus文本格式输出各阶段、各路由的分位数（秒）
+    static void render(std::string& out);
+
+    static const char* stage_name(int stage);
+    static const char* route_name(int route);
+
+private:
+    static shard* register_thread();
+
+    static __thread shard* t_shard;  // 当前线程的直方图
+};
+
+#endif
@@ -27,6 +27,28 @@ private:
     pthread_mutex_t m_mutex;
 };
 
+// 读写锁（读多写少的场景下多个读者可以同时持有）
+class rwlock {
+public:
+    rwlock() {
+        if (pthread_rwlock_init(&m_rwlock, NULL) != 0) throw std::exception();  // 初始化读写锁
+    }
+    ~rwlock() {
+        pthread_rwlock_destroy(&m_rwlock);  // 销毁读写锁
+    }
+    bool rdlock() {
+        return pthread_rwlock_rdlock(&m_rwlock) == 0;  // 加读锁
+    }
+    bool wrlock() {
+        return pthread_rwlock_wrlock(&m_rwlock) == 0;  // 加写锁
+    }
+    bool unlock() {
+        return pthread_rwlock_unlock(&m_rwlock) == 0;  // 解锁
+    }
+private:
+    pthread_rwlock_t m_rwlock;
+};
+
 // 条件变量
 class cond {
 public:
@@ -76,6 +98,9 @@ public:
     bool wait() {
         return sem_wait(&m_sem) == 0;  // 信号量加锁，调用一次对信号量值-1，若值等于0，则阻塞（相当于P）
     }
+    bool timedwait(struct timespec t) {
+        return sem_timedwait(&m_sem, &t) == 0;  // 同wait，但最多阻塞到绝对时间t（CLOCK_REALTIME）
+    }
     bool post() {
         return sem_post(&m_sem) == 0;  // 信号量解锁，调用一次对信号量的值+1，唤醒调用sem_post的线程（相当于V）
     }
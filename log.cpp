@@ -1,162 +1,430 @@
 #include <pthread.h>
 #include <string.h>  // 提供memest函数
 #include <sys/time.h>  // 提供gettimeofday函数
+#include <sys/uio.h>  // 提供writev函数
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>  // 提供IOV_MAX
 #include <stdarg.h>  // 提供va_start函数
 #include "log.h"
+#include "log_archiver.h"
 
-Log::Log() {
+// 当前线程的日志缓冲区
+static __thread void* t_buffer = NULL;
+
+// 默认输出Info及以上级别的日志
+int Log::m_level = Log::LEVEL_INFO;
+
+// 各级别的标签
+static const char* const level_tags[] = {"[debug]:", "[info]:", "[warn]:", "[erro]:"};
+static const int level_tag_lens[] = {8, 7, 7, 7};
+
+Log::Log() : m_wakeup(0) {
+    m_fp = NULL;
     m_count = 0;
+    m_today = 0;
     m_is_async = false;
+    m_binary = false;
+    m_drop_site = -1;
+    m_last_flush = 0;
+    m_buffer_size = 0;
+    m_buffers = NULL;
+    m_stop = false;
+    m_reported = 0;
+    dir_name[0] = '\0';
+    log_name[0] = '\0';
+    m_file_name[0] = '\0';
 }
 
 Log::~Log() {
+    // 结束后台线程，剩余的日志会在退出前写入
+    if (m_is_async) {
+        __atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+        m_wakeup.post();
+        pthread_join(m_tid, NULL);
+    }
     if (m_fp != NULL) fclose(m_fp);
 }
 
 
 // 调用init方法，初始化生成日志文件，服务器启动按当前时刻创建日志，前缀为时间，
-// 后缀为自定义log文件名，并记录创建日志的时间day和行数count。异步需要设置阻塞队列的长度，同步不需要
-bool Log::init(const char* file_name, int log_buf_size, int split_lines, int max_queue_size) {
-    // 如果max_queue_size不为0则为异步
-    if (max_queue_size >= 1) {
-        m_is_async = true;
-
-        // 创建并设置阻塞队列长度
-        m_log_queue = new block_queue<string>(max_queue_size);
-        pthread_t tid;
-
-        // flush_log_thread为回调函数，此处表示创建线程异步写数据
-        pthread_create(&tid, NULL, flush_log_thread, NULL);
-    }
-
-    // 缓冲区设置
-    m_log_buf_size= log_buf_size;
-    m_buf = new char[m_log_buf_size];
-    memset(m_buf, '\0', sizeof(m_buf));  // 将m_buf数组元素全部初始化为0
+// 后缀为自定义log文件名，并记录创建日志的时间day和行数count。异步需要设置每个线程暂存的日志条数，同步不需要
+bool Log::init(const char* file_name, int log_buf_size, int split_lines, int max_queue_size, bool binary) {
+    // 单条日志的最大长度（至少要放下时间和级别前缀）
+    m_log_buf_size = log_buf_size < 128 ? 128 : log_buf_size;
+    m_binary = binary;
 
     // 日志最大长度
     m_split_lines = split_lines;
 
     // 获取当前时间
-    time_t t = time(NULL);  
-    struct tm* sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
-    
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+
     // 从后往前找到一个'/'的位置，而strchr是从前往后
     const char* p = strrchr(file_name, '/');
-    char log_full_name[255] = {0};
     // 自定义日志名
     if (p == NULL) {
         // 若输入的文件名没有'/'，则直接将时间+文件名作为日志名
-        // snprintf将可变个参数(...)按照%d_%02d_%02d_%s格式化成字符串（02的意思是如果输出的整型数不足两位，左侧用0补齐），然后将其复制到log_full_name中。
-        snprintf(log_full_name, 255, "%d_%02d_%02d_%s", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, file_name);
+        dir_name[0] = '\0';
+        snprintf(log_name, sizeof(log_name), "%s", file_name);
     } else {
-        // 将p向后移动一个位置，然后复制到log_name中
-        strcpy(log_name, p + 1);
-        // 将路径赋值到dir_name
-        strncpy(dir_name, file_name, p - file_name + 1);
-        snprintf(log_full_name, 255, "%s%d_02%d_02%d_%s", dir_name, my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday, file_name);
+        // 将p向后移动一个位置，然后复制到log_name中，将路径赋值到dir_name
+        snprintf(log_name, sizeof(log_name), "%s", p + 1);
+        snprintf(dir_name, sizeof(dir_name), "%.*s", (int)(p - file_name + 1), file_name);
     }
 
-    m_today = my_tm.tm_mday;
-
-    m_fp = fopen(log_full_name, "a");  // 以追加的方式打开只写文件。若文件不存在，则会建立该文件，如果文件存在，写入的数据会被加到文件尾，即文件原先的内容会被保留
+    open_file(&my_tm, 0);
     if (m_fp == NULL) return false;
-    return true;
+    // 同步模式由文件流缓冲，写满或者超过刷新间隔时才写入文件
+    setvbuf(m_fp, NULL, _IOFBF, 1 << 16);
 
-}
+    // 如果max_queue_size不为0则为异步
+    if (max_queue_size >= 1) {
+        // 每个线程的暂存缓冲区按max_queue_size条最长的日志估算，取2的幂
+        uint64_t want = (uint64_t)max_queue_size * m_log_buf_size;
+        m_buffer_size = 4096;
+        while (m_buffer_size < want) m_buffer_size <<= 1;
+        m_is_async = true;
 
-// 工作线程写日志
-void Log::write_log(int level, const char* format, ...) {
-    
-    // 获取时间
-    struct timeval now = {0, 0};  // now有两个成员，秒数和毫秒数
-    gettimeofday(&now, NULL);  // 返回自1970-01-01 00:00:00到现在经历的秒数
-    time_t t = now.tv_sec;
-    struct tm* sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
-    
-    char s[16] = {0};
-    // 日志分级
-    switch (level) {
-        case 0: {
-            strcpy(s, "[debug]:");
-            break;
-        }
-        case 1: {
-            strcpy(s, "[info]:");
-            break;
-        }
-        case 2: {
-            strcpy(s, "[warn]:");
-            break;
-        }
-        case 3: {
-            strcpy(s, "[erro]:");
-            break;
-        }
-        default: {
-            strcpy(s, "[info]:");
-            break;
+        // flush_log_thread为回调函数，此处表示创建线程异步写数据
+        if (pthread_create(&m_tid, NULL, flush_log_thread, NULL) != 0) {
+            m_is_async = false;
+            return false;
         }
     }
-    
-    m_mutex.lock();
-    m_count++;  // 更新行数
-    // 日志不是今天，或写入的日志行数是最大行的倍数
-    if (m_today != my_tm.tm_mday || m_count % m_split_lines == 0) {
-        char new_log[258] = {0};
-        /*在使用多个输出函数连续进行多次输出到控制台时，有可能下一个数据再上一个数据还没输出完毕，
-        还在输出缓冲区中时，下一个printf就把另一个数据加入输出缓冲区，结果冲掉了原来的数据，出
-        现输出错误。fflush会强迫将缓冲区内的数据写回参数m_fp指定的文件中*/
+    return true;
+}
+
+void Log::open_file(const struct tm* tm, long long part) {
+    // 日志名格式：路径 + 年_月_日_ + 文件名（+ .part）
+    char log_full_name[sizeof(m_file_name)] = {0};
+    if (part > 0) {
+        snprintf(log_full_name, sizeof(log_full_name), "%s%d_%02d_%02d_%s.%lld", dir_name, tm->tm_year + 1900,
+                 tm->tm_mon + 1, tm->tm_mday, log_name, part);
+    } else {
+        snprintf(log_full_name, sizeof(log_full_name), "%s%d_%02d_%02d_%s", dir_name, tm->tm_year + 1900,
+                 tm->tm_mon + 1, tm->tm_mday, log_name);
+    }
+
+    if (m_fp != NULL) {
         fflush(m_fp);
         fclose(m_fp);
+        // 切换掉的文件不会再写入，交给后台线程压缩
+        if (strcmp(m_file_name, log_full_name) != 0) log_archiver::get_instance()->submit(m_file_name);
+    }
+    snprintf(m_file_name, sizeof(m_file_name), "%s", log_full_name);
+    // 以追加的方式打开只写文件。若文件不存在，则会建立该文件，如果文件存在，写入的数据会被加到文件尾，即文件原先的内容会被保留
+    m_fp = fopen(log_full_name, "a");
+    if (m_fp && !m_is_async) setvbuf(m_fp, NULL, _IOFBF, 1 << 16);
+    m_today = tm->tm_mday;
 
-        // 重新定义日志名中的时间部分
-        char tail[16] = {0};
-        snprintf(tail, 16, "%d_%02d_%02d_", my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday);
-        if (m_today != my_tm.tm_mday) {  // 如果时间不是今天，则创建今天的日志，更新m_today和m_count
-            snprintf(new_log, 255, "%s%s%s", dir_name, tail, log_name);
-            m_today = my_tm.tm_mday;
-            m_count = 0;
-        } else {  // 超过了最大行，在之前的日志名后加m_count / m_split_lines
-            snprintf(new_log, 257, "%s%s%s.%lld", dir_name, tail, log_name, m_count / m_split_lines);
+    // 二进制日志的每个文件开头都写入所有调用点的定义，可以单独解码；
+    // MAGIC只写在空文件的开头，同一天重启后追加到已有的文件时只写入定义（覆盖上次运行的同一编号）
+    if (m_fp && m_binary) {
+        if (fseek(m_fp, 0, SEEK_END) == 0 && ftell(m_fp) == 0) fwrite(log_binary::MAGIC, 1, log_binary::MAGIC_LEN, m_fp);
+        char* rec = new char[log_binary::MAX_RECORD];
+        for (size_t i = 0; i < m_sites.size(); ++i) {
+            int len = log_binary::encode_site(rec, log_binary::MAX_RECORD, i, m_sites[i].level, m_sites[i].format);
+            fwrite(rec, 1, len, m_fp);
         }
-        m_fp = fopen(new_log, "a");
+        delete[] rec;
+        // 异步模式之后用write直接写文件描述符，这里先刷新文件流
+        fflush(m_fp);
+    }
+}
+
+int Log::register_site(int level, const char* format, int* site) {
+    if (level < LEVEL_DEBUG || level > LEVEL_ERROR) level = LEVEL_INFO;
+
+    m_mutex.lock();
+    // 其他线程可能已经登记了同一个调用点
+    int id = *site;
+    if (id < 0) {
+        id = m_sites.size();
+        log_site s = {level, format};
+        m_sites.push_back(s);
+
+        // 定义先于这个调用点的任何一条日志写入文件
+        char rec[1024];
+        int len = log_binary::encode_site(rec, sizeof(rec), id, level, format);
+        write_raw(rec, len);
+        __atomic_store_n(site, id, __ATOMIC_RELEASE);
     }
     m_mutex.unlock();
+    return id;
+}
+
+void Log::write_raw(const char* data, size_t len) {
+    if (m_fp == NULL) return;
+    if (!m_is_async) {
+        fwrite(data, 1, len, m_fp);
+        return;
+    }
+    int fd = fileno(m_fp);
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void Log::rotate(const struct tm* tm, long long lines) {
+    // 日志不是今天，则创建今天的日志，行数重新计数
+    if (m_today != tm->tm_mday) {
+        m_count = 0;
+        open_file(tm, 0);
+    }
+
+    // 写入的日志行数超过了最大行的倍数，在日志名后加m_count / m_split_lines
+    long long before = m_count / m_split_lines;
+    m_count += lines;
+    if (m_count / m_split_lines != before) open_file(tm, m_count / m_split_lines);
+}
+
+Log::log_buffer* Log::get_buffer() {
+    if (t_buffer) return (log_buffer*)t_buffer;
+
+    log_buffer* buf = new log_buffer;
+    memset(buf, 0, sizeof(log_buffer));
+    buf->line = new char[m_log_buf_size];
+    if (m_is_async) {
+        buf->size = m_buffer_size;
+        buf->data = new char[buf->size];
+    }
+
+    // 加入链表，后台线程从链表头开始遍历
+    m_mutex.lock();
+    buf->next = m_buffers;
+    __atomic_store_n(&m_buffers, buf, __ATOMIC_RELEASE);
+    m_mutex.unlock();
+
+    t_buffer = buf;
+    return buf;
+}
+
+// 工作线程写日志
+void Log::write_log(int level, const char* format, ...) {
+    if (m_fp == NULL) return;
+    if (level < LEVEL_DEBUG || level > LEVEL_ERROR) level = LEVEL_INFO;
+
+    // 获取时间
+    struct timeval now = {0, 0};  // now有两个成员，秒数和毫秒数
+    gettimeofday(&now, NULL);  // 返回自1970-01-01 00:00:00到现在经历的秒数（vDSO，不陷入内核）
+
+    // 在当前线程自己的缓冲区中格式化，不需要加锁
+    log_buffer* buf = get_buffer();
+    char* line = buf->line;
+    int cap = m_log_buf_size - 1;  // 为结尾的换行符留出位置
+    update_time(buf, now);
+
+    // 写入内容格式：时间+微秒+级别+内容
+    int n = buf->ts_len;
+    memcpy(line, buf->ts, n);
+    long us = now.tv_usec;
+    for (int i = 5; i >= 0; --i) {
+        line[n + i] = '0' + us % 10;
+        us /= 10;
+    }
+    n += 6;
+    line[n++] = ' ';
+    memcpy(line + n, level_tags[level], level_tag_lens[level]);
+    n += level_tag_lens[level];
 
     // 定义可变参数列表
     va_list valst;
     // 将本函数传入的参数format赋值给valst，便于格式化输出
     va_start(valst, format);
-    
-    string log_str;
-    m_mutex.lock();
-    // 写入内容格式：时间+内容
-    // 时间格式化，snprintf返回写字符的总数（不包括结尾的NULL）
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s", my_tm.tm_year, my_tm.tm_mon, my_tm.tm_mday, my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
-    // 内容格式化，用于向字符串中打印数据，并返回写字符总数
-    int m = vsnprintf(m_buf + n, m_log_buf_size - 1, format, valst);
-    m_buf[n + m] = '\n';
-    m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
-    m_mutex.unlock();
+    // 内容格式化，超长的日志被截断
+    int m = vsnprintf(line + n, cap - n, format, valst);
+    va_end(valst);  // 清空可变参数列表
+    if (m < 0) m = 0;
+    if (m > cap - n - 1) m = cap - n - 1;
+    int len = n + m;
+    line[len++] = '\n';
+    append(buf, line, len, now);
+}
 
-    // 若m_is_async为true表示异步写，需要将日志信息加入阻塞队列，否则为同步直接加锁向文件中写
-    if (m_is_async && !m_log_queue->full()) m_log_queue->push(log_str);
-    else {
+void Log::update_time(log_buffer* buf, const struct timeval& now) {
+    // 时间前缀每个线程每秒只格式化一次
+    if (now.tv_sec == buf->ts_sec) return;
+    time_t t = now.tv_sec;
+    localtime_r(&t, &buf->ts_tm);
+    buf->ts_len = snprintf(buf->ts, sizeof(buf->ts), "%d-%02d-%02d %02d:%02d:%02d.", buf->ts_tm.tm_year + 1900,
+                           buf->ts_tm.tm_mon + 1, buf->ts_tm.tm_mday, buf->ts_tm.tm_hour, buf->ts_tm.tm_min,
+                           buf->ts_tm.tm_sec);
+    buf->ts_sec = now.tv_sec;
+}
+
+void Log::append(log_buffer* buf, const char* line, int len, const struct timeval& now) {
+    // 同步写：加锁后写入文件流，由文件流缓冲，距离上次刷新超过刷新间隔时才刷新
+    if (!m_is_async) {
+        long long now_us = (long long)now.tv_sec * 1000000 + now.tv_usec;
+        update_time(buf, now);
         m_mutex.lock();
-        fputs(log_str.c_str(), m_fp);
+        rotate(&buf->ts_tm, 1);
+        fwrite(line, 1, len, m_fp);
+        if (now_us - m_last_flush >= FLUSH_INTERVAL * 1000LL) {
+            fflush(m_fp);
+            m_last_flush = now_us;
+        }
         m_mutex.unlock();
+        return;
     }
 
-    va_end(valst);  // 清空可变参数列表
+    // 异步写：追加到暂存环形缓冲区，剩余空间不足则丢弃这条日志
+    uint64_t head = buf->head;
+    uint64_t tail = __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE);
+    if (buf->size - (head - tail) < (uint64_t)len) {
+        __atomic_fetch_add(&buf->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint64_t off = head & (buf->size - 1);
+    uint64_t first = buf->size - off < (uint64_t)len ? buf->size - off : len;
+    memcpy(buf->data + off, line, first);
+    memcpy(buf->data, line + first, len - first);
+    __atomic_store_n(&buf->head, head + len, __ATOMIC_RELEASE);
+    __atomic_store_n(&buf->records, buf->records + 1, __ATOMIC_RELEASE);
 
+    // 缓冲区刚超过一半时唤醒后台线程，其余情况等待后台线程定期写入
+    uint64_t half = buf->size / 2;
+    if (head - tail < half && head + len - tail >= half) m_wakeup.post();
 }
 
 void Log::flush() {
+    if (m_is_async) {
+        m_wakeup.post();
+        return;
+    }
+    m_mutex.lock();
+    if (m_fp) fflush(m_fp);  // 强制刷新写入缓冲流
+    m_mutex.unlock();
+}
+
+uint64_t Log::dropped() {
+    uint64_t total = 0;
+    for (log_buffer* buf = __atomic_load_n(&m_buffers, __ATOMIC_ACQUIRE); buf; buf = buf->next) {
+        total += __atomic_load_n(&buf->dropped, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+// 异步写日志
+void* Log::async_write_log() {
+    while (true) {
+        // 等待被唤醒或者超时
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += FLUSH_INTERVAL * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        m_wakeup.timedwait(ts);
+
+        bool stop = __atomic_load_n(&m_stop, __ATOMIC_ACQUIRE);
+        while (drain() > 0) {}
+
+        // 有新丢弃的日志则记录一条
+        uint64_t total = dropped();
+        if (total != m_reported) {
+            static const char* const format = "log buffer full, dropped %llu lines";
+            unsigned long long count = total - m_reported;
+            char line[128];
+            time_t t = time(NULL);
+            struct tm my_tm;
+            localtime_r(&t, &my_tm);
+            int len;
+            if (m_binary) {
+                int id = m_drop_site;
+                if (id < 0) id = m_drop_site = register_site(LEVEL_WARN, format, &m_drop_site);
+                len = log_binary::encode_event(line, sizeof(line), id, (uint64_t)t * 1000000, count);
+            } else {
+                len = snprintf(line, sizeof(line), "%d-%02d-%02d %02d:%02d:%02d.%06d [warn]:", my_tm.tm_year + 1900,
+                               my_tm.tm_mon + 1, my_tm.tm_mday, my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, 0);
+                len += snprintf(line + len, sizeof(line) - len, format, count);
+                line[len++] = '\n';
+            }
+            m_mutex.lock();
+            rotate(&my_tm, 1);
+            write_raw(line, len);
+            m_mutex.unlock();
+            m_reported = total;
+        }
+
+        if (stop) break;
+    }
+    return NULL;
+}
+
+size_t Log::drain() {
+    struct iovec iov[IOV_MAX];
+    log_buffer* owners[IOV_MAX / 2];
+    uint64_t heads[IOV_MAX / 2];
+    int niov = 0, nowners = 0;
+    long long lines = 0;  // 用于切换日志文件的行数
+
+    // 收集每个线程已经写入的日志（环形缓冲区回绕时分为两段）
+    for (log_buffer* buf = __atomic_load_n(&m_buffers, __ATOMIC_ACQUIRE); buf && nowners < IOV_MAX / 2; buf = buf->next) {
+        // 先读条数再读写入位置，读到的日志不少于计入的条数，多出的下次再计入
+        uint64_t records = __atomic_load_n(&buf->records, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = buf->tail;
+        lines += records - buf->drained;
+        buf->drained = records;
+        if (head == tail) continue;
+
+        uint64_t off = tail & (buf->size - 1);
+        uint64_t len = head - tail;
+        uint64_t first = buf->size - off < len ? buf->size - off : len;
+        iov[niov].iov_base = buf->data + off;
+        iov[niov++].iov_len = first;
+        if (len > first) {
+            iov[niov].iov_base = buf->data;
+            iov[niov++].iov_len = len - first;
+        }
+        owners[nowners] = buf;
+        heads[nowners++] = head;
+    }
+    if (niov == 0) return 0;
+
+    size_t total = 0;
+    for (int i = 0; i < niov; ++i) total += iov[i].iov_len;
+
+    time_t t = time(NULL);
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
+
+    // 一次writev写入所有线程的日志，写入不完整时继续写剩余部分
     m_mutex.lock();
-    fflush(m_fp);  // 强制刷新写入缓冲流
+    rotate(&my_tm, lines);
+    if (m_fp) {
+        int fd = fileno(m_fp);
+        struct iovec* cur = iov;
+        int left = niov;
+        while (left > 0) {
+            ssize_t n = writev(fd, cur, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            while (left > 0 && (size_t)n >= cur->iov_len) {
+                n -= cur->iov_len;
+                ++cur;
+                --left;
+            }
+            if (left > 0) {
+                cur->iov_base = (char*)cur->iov_base + n;
+                cur->iov_len -= n;
+            }
+        }
+    }
     m_mutex.unlock();
-}
\ No newline at end of file
+
+    // 释放已经写入的空间
+    for (int i = 0; i < nowners; ++i) __atomic_store_n(&owners[i]->tail, heads[i], __ATOMIC_RELEASE);
+    return total;
+}
@@ -1,17 +1,38 @@
 #ifndef LOG_H
-#define LPG_H
+#define LOG_H
 
 #include <stdio.h>  // 提供fputs函数
+#include <stdint.h>
+#include <stdarg.h>
 #include <string>
-#include <stdio.h>
-#include "block_queue.h"
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <vector>
 #include "lock.h"
+#include "log_binary.h"
 
 using namespace std;
 
 // 使用单例模式创建日志系统
+// 同步模式下每个线程在自己的缓冲区中格式化，加锁后写入文件流；
+// 异步模式下每个线程把格式化好的日志追加到自己的暂存环形缓冲区（单生产者单消费者，不加锁），
+// 后台线程定期（或者某个缓冲区超过一半时被唤醒）收集所有缓冲区中的日志，用一次writev写入文件，
+// 缓冲区满时丢弃日志并计数，内存占用有上限，写日志的线程不会因为磁盘慢而阻塞。
+// 二进制模式下不格式化，只记录调用点编号、时间和原始参数（格式见log_binary.h），用tools/log_decode转换为文本
 class Log {
 public:
+    static const int FLUSH_INTERVAL = 100;  // 异步模式后台线程的最长写入间隔，同步模式文件流的最长刷新间隔（毫秒）
+
+    // 日志级别
+    enum LEVEL {
+        LEVEL_DEBUG = 0,
+        LEVEL_INFO,
+        LEVEL_WARN,
+        LEVEL_ERROR,
+        LEVEL_OFF  // 关闭所有日志
+    };
+
     // 使用共有的静态方法获得实例，c++11后使用局部变量懒汉不用加锁
     static Log* get_instance() {
         static Log instance;
@@ -21,58 +42,148 @@ public:
     // 异步写日志公共方法，调用私有方法async_write_log
     static void* flush_log_thread(void* args) {
         Log::get_instance()->async_write_log();
+        return NULL;
     }
 
-    // 日志参数包括日志文件、日志缓冲区大小、最大行数以及最长日志条队列（若队列大小为0，则为同步，否则为异步）
-    bool init(const char* file_name, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0);
+    // 日志参数包括日志文件、单条日志的最大长度、最大行数、每个线程暂存的日志条数（若为0，则为同步，否则为异步）
+    // 以及是否写二进制日志
+    bool init(const char* file_name, int log_buf_size = 8192, int split_lines = 5000000, int max_queue_size = 0,
+              bool binary = false);
 
     // 将输出内容按标准格式整理
     void write_log(int level, const char* format, ...);
 
-    // 强制刷新缓冲区
-    void flush(void);  
+    // LOG_*宏的入口，site是调用点的静态变量，二进制模式下第一次调用时登记格式字符串并保存编号
+    template <typename... Args>
+    void log(int level, int* site, const char* format, Args... args) {
+        if (!m_binary) {
+            write_log(level, format, args...);
+            return;
+        }
+        if (m_fp == NULL) return;
+        int id = __atomic_load_n(site, __ATOMIC_ACQUIRE);
+        if (id < 0) id = register_site(level, format, site);
+
+        struct timeval now = {0, 0};
+        gettimeofday(&now, NULL);
+        log_buffer* buf = get_buffer();
+        int len = log_binary::encode_event(buf->line, m_log_buf_size, id, (uint64_t)now.tv_sec * 1000000 + now.tv_usec,
+                                           args...);
+        append(buf, buf->line, len, now);
+    }
+
+    // 强制刷新缓冲区（异步模式下唤醒后台线程立即写入）
+    void flush(void);
+
+    // 运行时的日志级别，低于该级别的日志在格式化参数之前就被跳过
+    static void set_level(int level) {
+        __atomic_store_n(&m_level, level, __ATOMIC_RELAXED);
+    }
+    static bool enabled(int level) {
+        return level >= __atomic_load_n(&m_level, __ATOMIC_RELAXED);
+    }
+
+    // 异步模式下因为暂存缓冲区已满而丢弃的日志条数
+    uint64_t dropped();
 
 private:
     Log();  // 私有化构造函数，以防外界创建单例类的对象
     virtual ~Log();  // 虚析构函数：当父类指针指向子类对象的时候，把父类的析构函数设置成虚析构，防止内存泄露
 
+    // 每个线程的日志缓冲区，第一次写日志时创建，之后一直保留
+    struct log_buffer {
+        char* line;  // 格式化一条日志的缓冲区
+        time_t ts_sec;  // 缓存的时间前缀对应的秒数，同一秒内的日志只需要补上微秒
+        struct tm ts_tm;  // 缓存的本地时间，用于按日期切换日志文件
+        char ts[32];  // 缓存的时间前缀（年-月-日 时:分:秒.）
+        int ts_len;
+        char* data;  // 异步模式的暂存环形缓冲区（大小为2的幂），同步模式为NULL
+        uint64_t size;
+        uint64_t head;  // 写入位置，只由所属线程修改
+        uint64_t records;  // 写入的日志条数，用于按行数切换日志文件
+        char pad[64];  // head和tail分别由不同线程修改，放在不同的缓存行
+        uint64_t tail;  // 读取位置，只由后台线程修改
+        uint64_t drained;  // 后台线程已经计入行数的日志条数
+        uint64_t dropped;  // 丢弃的日志条数
+        log_buffer* next;  // 所有线程的缓冲区串成链表
+    };
+
+    // 获取当前线程的缓冲区
+    log_buffer* get_buffer();
+    // 更新缓冲区缓存的时间
+    void update_time(log_buffer* buf, const struct timeval& now);
+    // 写入一条已经编码好的日志：同步模式写入文件流，异步模式追加到暂存缓冲区
+    void append(log_buffer* buf, const char* data, int len, const struct timeval& now);
+    // 二进制模式下登记调用点，返回编号
+    int register_site(int level, const char* format, int* site);
+    // 直接写入文件（持有m_mutex）
+    void write_raw(const char* data, size_t len);
+    // 按照当前时间打开日志文件，part大于0时文件名加上.part后缀
+    void open_file(const struct tm* tm, long long part);
+    // 写入了lines行之后，按日期和行数判断是否需要切换日志文件
+    void rotate(const struct tm* tm, long long lines);
+
     // 异步写日志
-    void* async_write_log() {
-        string single_log;
-        // 从阻塞队列中取出一个日志string，写入文件
-        while (m_log_queue->pop(single_log)) {
-            m_mutex.lock();
-            fputs(single_log.c_str(), m_fp);  // 将single_log写入m_fp所指向的文件
-            m_mutex.unlock();
-        }
-    }
+    void* async_write_log();
+    // 收集所有线程暂存的日志并写入文件，返回写入的字节数
+    size_t drain();
 
 private:
-    block_queue<string>* m_log_queue;  // 阻塞队列
-    mutex m_mutex;  // 互斥锁
+    mutex m_mutex;  // 互斥锁，保护文件、行数和缓冲区链表
     FILE* m_fp;  // log文件指针
 
     char dir_name[128];  // 路径名
     char log_name[128];  // log文件名
-    int m_log_buf_size;  // 日志缓冲区的大小
+    // 当前打开的日志文件的完整路径：路径 + 日期 + 文件名 + 分段序号，日期和序号按整数的最大位数预留
+    char m_file_name[sizeof(dir_name) + sizeof(log_name) + 96];
+    int m_log_buf_size;  // 单条日志的最大长度
     int m_split_lines;  // 日志最大行数
     long long m_count;  // 日志行数记录
     int m_today;  // 按天分文件，记录当前时间是哪一天
 
     bool m_is_async;  // 是否异步标志位
-    char* m_buf;  // 要输出的内容
-
-
+    bool m_binary;  // 是否写二进制日志
+
+    // 二进制日志的调用点
+    struct log_site {
+        int level;
+        const char* format;  // 格式字符串都是字面量，保存指针即可
+    };
+    std::vector<log_site> m_sites;  // 按编号保存，受m_mutex保护
+    int m_drop_site;  // 后台线程报告丢弃条数的调用点
+    static int m_level;  // 运行时的日志级别
+    long long m_last_flush;  // 同步模式上次刷新文件流的时间（微秒）
+    uint64_t m_buffer_size;  // 每个线程暂存缓冲区的大小
+    log_buffer* m_buffers;  // 所有线程的缓冲区
+    sem m_wakeup;  // 唤醒后台线程
+    bool m_stop;  // 结束后台线程
+    pthread_t m_tid;  // 后台线程
+    uint64_t m_reported;  // 已经写入日志的丢弃条数
 };
 
-// 日志分级，以下宏定义在其他文件中使用，主要用于不同类型的日志输出（Warn实际并未使用）
-// Debug：调试代码的输出，在系统实际运行时一般不使用
-#define LOG_DEBUG(format, ...) Log::get_instance()->write_log(0, format, ##__VA_ARGS__);
+// 编译期的日志级别，低于该级别的日志调用在编译时被去掉（如-DLOG_COMPILE_LEVEL=1去掉所有Debug日志）
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+// 先判断编译期和运行时的级别，未启用的日志不会求值参数，也不会格式化；
+// 每个调用点有一个静态的编号，二进制日志用它代替格式字符串
+#define LOG_IF(level, format, ...) \
+    do { \
+        if ((level) >= LOG_COMPILE_LEVEL && Log::enabled(level)) { \
+            static int log_site_ = -1; \
+            Log::get_instance()->log(level, &log_site_, format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+// 日志分级，以下宏定义在其他文件中使用，主要用于不同类型的日志输出
+// Debug：调试代码的输出，每个请求的解析过程和读写事件，默认级别下不输出
+#define LOG_DEBUG(format, ...) LOG_IF(Log::LEVEL_DEBUG, format, ##__VA_ARGS__);
 // Info：报告系统当前的状态，当前执行的流程或接收的信息
-#define LOG_INFO(format, ...) Log::get_instance()->write_log(1, format, ##__VA_ARGS__);
+#define LOG_INFO(format, ...) LOG_IF(Log::LEVEL_INFO, format, ##__VA_ARGS__);
 // Warn：与调试时中断的warning类似，调试代码时使用
-#define LOG_WARN(format, ...) Log::get_instance()->write_log(2, format, ##__VA_ARGS__);
+#define LOG_WARN(format, ...) LOG_IF(Log::LEVEL_WARN, format, ##__VA_ARGS__);
 // Error：输出系统的错误
-#define LOG_ERROR(format, ...) Log::get_instance()->write_log(3, format, ##__VA_ARGS__);
+#define LOG_ERROR(format, ...) LOG_IF(Log::LEVEL_ERROR, format, ##__VA_ARGS__);
 
 #endif
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+#include <algorithm>
+
+#include "log_archiver.h"
+#include "log.h"
+
+// ioprio_set的参数（glibc没有提供头文件）
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+log_archiver::log_archiver() : m_wakeup(0) {
+    m_running = false;
+    m_max_bytes = 0;
+    m_max_days = 0;
+    m_level = 6;
+    m_stop = false;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+log_archiver::~log_archiver() {
+    if (!m_running) return;
+    // 退出前处理完已经提交的文件
+    __atomic_store_n(&m_stop, true, __ATOMIC_RELEASE);
+    m_wakeup.post();
+    pthread_join(m_tid, NULL);
+}
+
+// 单例模式
+log_archiver* log_archiver::get_instance() {
+    static log_archiver instance;
+    return &instance;
+}
+
+bool log_archiver::init(long long max_bytes, int max_days, int level) {
+    if (m_running) return true;
+    m_max_bytes = max_bytes > 0 ? max_bytes : 0;
+    m_max_days = max_days > 0 ? max_days : 0;
+    m_level = (level >= 1 && level <= 9) ? level : 6;
+
+    if (pthread_create(&m_tid, NULL, worker, this) != 0) return false;
+    __atomic_store_n(&m_running, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void log_archiver::watch(const char* file_name) {
+    // 与Log相同的拆分方式：最后一个'/'之前是目录
+    std::string dir, name;
+    const char* p = strrchr(file_name, '/');
+    if (p == NULL) {
+        dir = ".";
+        name = file_name;
+    } else {
+        dir.assign(file_name, p - file_name);
+        if (dir.empty()) dir = "/";
+        name = p + 1;
+    }
+
+    m_mutex.lock();
+    m_watched.push_back(std::make_pair(dir, name));
+    m_mutex.unlock();
+}
+
+void log_archiver::submit(const char* path) {
+    if (!__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) return;
+    m_mutex.lock();
+    m_queue.push_back(path);
+    m_mutex.unlock();
+    m_wakeup.post();
+}
+
+void* log_archiver::worker(void* arg) {
+    // 只降低本线程的CPU和I/O优先级，不影响处理请求的线程
+    pid_t tid = syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, tid, 19);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+    ((log_archiver*)arg)->run();
+    return NULL;
+}
+
+void log_archiver::run() {
+    while (true) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += CHECK_INTERVAL;
+        m_wakeup.timedwait(ts);
+        bool stop = __atomic_load_n(&m_stop, __ATOMIC_ACQUIRE);
+
+        // 依次压缩队列中的文件
+        bool done = false;
+        while (true) {
+            m_mutex.lock();
+            if (m_queue.empty()) {
+                m_mutex.unlock();
+                break;
+            }
+            std::string path = m_queue.front();
+            m_queue.pop_front();
+            m_mutex.unlock();
+
+            __atomic_fetch_add(compress(path) ? &m_stats.compressed : &m_stats.failed, 1, __ATOMIC_RELAXED);
+            done = true;
+        }
+
+        // 压缩了新文件或者定时检查时清理旧文件
+        if (done || !stop) enforce_retention();
+        if (stop) break;
+    }
+}
+
+bool log_archiver::compress(const std::string& path) {
+    std::string gz = path + ".gz";
+    std::string tmp = gz + ".tmp";
+
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        LOG_ERROR("archive: open %s error:%s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    char mode[8];
+    snprintf(mode, sizeof(mode), "wb%d", m_level);
+    gzFile out = gzopen(tmp.c_str(), mode);
+    if (out == NULL) {
+        LOG_ERROR("archive: create %s error", tmp.c_str());
+        close(in);
+        return false;
+    }
+    gzbuffer(out, CHUNK_SIZE);
+
+    // 先写临时文件，全部成功后再改名并删除原文件，中途失败时保留原文件
+    char* buf = new char[CHUNK_SIZE];
+    bool ok = true;
+    uint64_t bytes_in = 0;
+    while (true) {
+        ssize_t n = read(in, buf, CHUNK_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (n == 0) break;
+        if (gzwrite(out, buf, n) != n) {
+            ok = false;
+            break;
+        }
+        bytes_in += n;
+    }
+    delete[] buf;
+    close(in);
+    if (gzclose(out) != Z_OK) ok = false;
+
+    if (!ok || rename(tmp.c_str(), gz.c_str()) != 0) {
+        LOG_ERROR("archive: compress %s error", path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    unlink(path.c_str());
+
+    struct stat st;
+    uint64_t bytes_out = stat(gz.c_str(), &st) == 0 ? st.st_size : 0;
+    __atomic_fetch_add(&m_stats.bytes_in, bytes_in, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&m_stats.bytes_out, bytes_out, __ATOMIC_RELAXED);
+    LOG_INFO("archive: %s %llu -> %llu bytes", gz.c_str(), (unsigned long long)bytes_in, (unsigned long long)bytes_out);
+    return true;
+}
+
+// 日志文件名为 年_月_日_文件名（.part），压缩后加上.gz
+static bool is_archive_of(const char* file, const std::string& name) {
+    size_t len = strlen(file);
+    if (len < 11 + name.size() + 3 || strcmp(file + len - 3, ".gz") != 0) return false;
+    for (int i = 0; i < 11; ++i) {
+        char c = file[i];
+        if ((i == 4 || i == 7 || i == 10) ? c != '_' : (c < '0' || c > '9')) return false;
+    }
+    if (strncmp(file + 11, name.c_str(), name.size()) != 0) return false;
+    // 文件名之后只能是.gz或者.part.gz
+    const char* rest = file + 11 + name.size();
+    if (strcmp(rest, ".gz") == 0) return true;
+    if (*rest++ != '.') return false;
+    while (*rest >= '0' && *rest <= '9') ++rest;
+    return strcmp(rest, ".gz") == 0;
+}
+
+void log_archiver::enforce_retention() {
+    if (m_max_bytes == 0 && m_max_days == 0) return;
+
+    m_mutex.lock();
+    std::vector<std::pair<std::string, std::string> > watched = m_watched;
+    m_mutex.unlock();
+
+    time_t now = time(NULL);
+    for (size_t w = 0; w < watched.size(); ++w) {
+        DIR* dir = opendir(watched[w].first.c_str());
+        if (!dir) continue;
+
+        // 收集这种日志的压缩文件（修改时间（纳秒），大小，路径）
+        std::vector<std::pair<std::pair<long long, long long>, std::string> > files;
+        struct dirent* ent;
+        while ((ent = readdir(dir)) != NULL) {
+            if (!is_archive_of(ent->d_name, watched[w].second)) continue;
+            std::string path = watched[w].first + "/" + ent->d_name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) continue;
+            long long mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+            files.push_back(std::make_pair(std::make_pair(mtime, (long long)st.st_size), path));
+        }
+        closedir(dir);
+
+        // 从最旧的开始，超过保留天数或者总大小超过上限时删除
+        std::sort(files.begin(), files.end());
+        long long total = 0;
+        for (size_t i = 0; i < files.size(); ++i) total += files[i].first.second;
+        for (size_t i = 0; i < files.size(); ++i) {
+            bool expired = m_max_days > 0 && now - files[i].first.first / 1000000000LL > (long long)m_max_days * 86400;
+            bool over = m_max_bytes > 0 && total > m_max_bytes;
+            if (!expired && !over) break;
+            if (unlink(files[i].second.c_str()) == 0) {
+                total -= files[i].first.second;
+                __atomic_fetch_add(&m_stats.removed, 1, __ATOMIC_RELAXED);
+                LOG_INFO("archive: removed %s", files[i].second.c_str());
+            }
+        }
+    }
+}
+
+void log_archiver::get_stats(archive_stats* stats) {
+    stats->compressed = __atomic_load_n(&m_stats.compressed, __ATOMIC_RELAXED);
+    stats->failed = __atomic_load_n(&m_stats.failed, __ATOMIC_RELAXED);
+    stats->bytes_in = __atomic_load_n(&m_stats.bytes_in, __ATOMIC_RELAXED);
+    stats->bytes_out = __atomic_load_n(&m_stats.bytes_out, __ATOMIC_RELAXED);
+    stats->removed = __atomic_load_n(&m_stats.removed, __ATOMIC_RELAXED);
+}
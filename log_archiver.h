@@ -0,0 +1,69 @@
+#ifndef LOG_ARCHIVER_H
+#define LOG_ARCHIVER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include "lock.h"
+
+// 日志归档：Log和access_log切换文件后把旧文件交给这里，由一个低优先级（nice 19，空闲I/O优先级）的后台线程
+// 用gzip压缩为.gz并删除原文件，工作线程只做一次入队；压缩后以及每隔CHECK_INTERVAL按保留策略清理已经压缩的旧文件：
+// 超过保留天数的删除，总大小超过上限时从最旧的开始删除。未初始化时submit不做任何事，旧文件原样保留
+class log_archiver {
+public:
+    static const int CHECK_INTERVAL = 60;  // 没有新文件时检查保留策略的间隔（秒）
+    static const int CHUNK_SIZE = 256 * 1024;  // 每次读取和压缩的字节数
+
+    // 统计信息
+    struct archive_stats {
+        uint64_t compressed;  // 压缩的文件数
+        uint64_t failed;  // 压缩失败的文件数（保留原文件）
+        uint64_t bytes_in;  // 压缩前的总字节数
+        uint64_t bytes_out;  // 压缩后的总字节数
+        uint64_t removed;  // 按保留策略删除的文件数
+    };
+
+    // 局部静态变量单例模式
+    static log_archiver* get_instance();
+
+    // 启动后台线程；max_bytes为每种日志压缩文件的总大小上限，max_days为保留天数（0表示不限制），level为gzip压缩级别
+    bool init(long long max_bytes, int max_days, int level = 6);
+
+    // 登记一种日志，参数与Log::init的文件名相同（可以带路径），保留策略只作用于登记过的日志的压缩文件
+    void watch(const char* file_name);
+
+    // 提交一个已经切换掉、不会再写入的日志文件（线程安全，只入队）
+    void submit(const char* path);
+
+    void get_stats(archive_stats* stats);
+
+private:
+    log_archiver();
+    ~log_archiver();
+
+    static void* worker(void* arg);
+    void run();
+    // 压缩一个文件，成功后删除原文件
+    bool compress(const std::string& path);
+    // 按保留策略清理压缩文件
+    void enforce_retention();
+
+private:
+    bool m_running;
+    long long m_max_bytes;
+    int m_max_days;
+    int m_level;
+
+    mutex m_mutex;  // 保护队列和登记的日志
+    std::deque<std::string> m_queue;  // 待压缩的文件
+    std::vector<std::pair<std::string, std::string> > m_watched;  // 登记的日志（目录，文件名）
+    sem m_wakeup;
+    bool m_stop;
+    pthread_t m_tid;
+    archive_stats m_stats;  // 由后台线程原子地更新
+};
+
+#endif
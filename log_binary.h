@@ -0,0 +1,146 @@
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <string.h>
+#include <stdint.h>
+#include <type_traits>
+
+// 二进制日志格式，由Log写入，由tools/log_decode还原为文本日志
+// 文件以MAGIC开头，之后是一串记录，每条记录的前3字节为：记录总长度（u16，小端）+ 记录类型（u8）
+//   REC_SITE：日志调用点的定义，u32编号 + u8级别 + 格式字符串（不含结尾的'\0'）
+//             每个调用点第一次写日志时写入一次，切换日志文件时在新文件开头重写所有定义，每个文件都可以单独解码
+//             同一天重启后追加到已有的文件时编号重新分配，同一编号以最近写入的定义为准
+//   REC_EVENT：一条日志，u32调用点编号 + u64时间（微秒） + 参数
+//             每个参数为1字节的类型 + 值：整数和浮点数固定8字节，字符串为u16长度 + 内容
+// 热路径上只拷贝调用点编号、时间和原始参数，不做格式化
+namespace log_binary {
+
+static const char MAGIC[8] = {'W', 'S', 'L', 'O', 'G', 'B', '1', '\n'};
+static const int MAGIC_LEN = 8;
+
+static const int HEADER_LEN = 3;  // 记录长度 + 记录类型
+static const int SITE_HEADER_LEN = HEADER_LEN + 4 + 1;
+static const int EVENT_HEADER_LEN = HEADER_LEN + 4 + 8;
+static const int MAX_RECORD = 65535;  // 记录长度用u16表示
+
+enum RECORD {
+    REC_SITE = 1,
+    REC_EVENT = 2
+};
+
+// 参数类型
+enum ARG {
+    ARG_INT = 'i',  // 有符号整数，按int64_t存放
+    ARG_UINT = 'u',  // 无符号整数，按uint64_t存放
+    ARG_DOUBLE = 'f',  // 浮点数
+    ARG_STR = 's',  // 字符串，拷贝内容
+    ARG_PTR = 'p'  // 其他指针，只记录地址
+};
+
+// 按顺序写入参数，空间不足时截断，之后的参数都不再写入
+struct writer {
+    char* p;
+    char* end;
+    bool full;
+};
+
+inline void put_fixed(writer& w, char tag, const void* value) {
+    if (w.full || w.end - w.p < 9) {
+        w.full = true;
+        return;
+    }
+    *w.p++ = tag;
+    memcpy(w.p, value, 8);
+    w.p += 8;
+}
+
+inline void put(writer& w, const char* s) {
+    if (w.full || w.end - w.p < 3) {
+        w.full = true;
+        return;
+    }
+    if (!s) s = "(null)";
+    size_t n = strlen(s);
+    size_t room = w.end - w.p - 3;
+    if (n > room) {
+        n = room;
+        w.full = true;  // 字符串被截断，之后的参数丢弃
+    }
+    if (n > 0xffff) n = 0xffff;
+    uint16_t len = (uint16_t)n;
+    *w.p++ = ARG_STR;
+    memcpy(w.p, &len, 2);
+    memcpy(w.p + 2, s, n);
+    w.p += 2 + n;
+}
+
+inline void put(writer& w, char* s) {
+    put(w, (const char*)s);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type put(writer& w, T v) {
+    int64_t x = v;
+    put_fixed(w, ARG_INT, &x);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type put(writer& w, T v) {
+    uint64_t x = v;
+    put_fixed(w, ARG_UINT, &x);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type put(writer& w, T v) {
+    int64_t x = (int64_t)v;
+    put_fixed(w, ARG_INT, &x);
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type put(writer& w, T v) {
+    double x = v;
+    put_fixed(w, ARG_DOUBLE, &x);
+}
+
+template <typename T>
+inline void put(writer& w, const T* v) {
+    uint64_t x = (uint64_t)(uintptr_t)v;
+    put_fixed(w, ARG_PTR, &x);
+}
+
+inline void write_header(char* rec, int len, int type) {
+    uint16_t n = (uint16_t)len;
+    memcpy(rec, &n, 2);
+    rec[2] = (char)type;
+}
+
+// 编码一个调用点的定义，返回记录长度
+inline int encode_site(char* rec, int cap, uint32_t site, int level, const char* format) {
+    if (cap > MAX_RECORD) cap = MAX_RECORD;
+    int n = strlen(format);
+    if (n > cap - SITE_HEADER_LEN) n = cap - SITE_HEADER_LEN;
+    memcpy(rec + HEADER_LEN, &site, 4);
+    rec[HEADER_LEN + 4] = (char)level;
+    memcpy(rec + SITE_HEADER_LEN, format, n);
+    write_header(rec, SITE_HEADER_LEN + n, REC_SITE);
+    return SITE_HEADER_LEN + n;
+}
+
+// 编码一条日志，返回记录长度；cap至少为EVENT_HEADER_LEN
+template <typename... Args>
+inline int encode_event(char* rec, int cap, uint32_t site, uint64_t usec, Args... args) {
+    if (cap > MAX_RECORD) cap = MAX_RECORD;
+    writer w = {rec + EVENT_HEADER_LEN, rec + cap, false};
+    int expand[] = {0, (put(w, args), 0)...};
+    (void)expand;
+
+    int len = w.p - rec;
+    memcpy(rec + HEADER_LEN, &site, 4);
+    memcpy(rec + HEADER_LEN + 4, &usec, 8);
+    write_header(rec, len, REC_EVENT);
+    return len;
+}
+
+}  // namespace log_binary
+
+#endif
@@ -5,42 +5,39 @@
 #include <time.h>
 #include <arpa/inet.h>
 
+#include "metrics.h"
 
-class util_timer;  // 定时器类包括连接资源、定时事件和超时时间（由于连接资源结构体中需要用到定时器类，所以在这里前向声明）
 
-// 连接资源结构体包括客户端套接字地址、文件描述符和定时器
-struct client_data {
-    sockaddr_in address;  // 客户端套接字地址
-    int sockfd;  // socket文件描述符
-    util_timer* timer;  // 定时器类
-};
+class http_conn;
+struct client_data;  // 连接资源（由于定时器类中需要用到连接资源结构体，所以在这里前向声明）
 
 // 定时器类包括连接资源、定时事件（回调函数）和超时时间
 class util_timer {
 public:
-    util_timer() : prev(NULL), next(NULL) {}  // 列表初始化构造函数
+    util_timer() : user_data(NULL), cb_func(NULL), expire(0), deferrals(0), prev(NULL), next(NULL) {}  // 列表初始化构造函数
 public:
     client_data* user_data;  // 连接资源
     void (*cb_func)(client_data*);  // 任务回调函数
     time_t expire;  // 任务超时时间（绝对时间）
+    int deferrals;  // 关闭被推迟的次数，大于0时到期只是重试关闭，不再算作超时
     util_timer* prev;  // 前向定时器
     util_timer* next;  // 后继定时器
 };
 
+// 连接资源结构体包括定时器、连接对象和文件描述符，按文件描述符存放在数组中。主循环处理一个事件时先访问这里，
+// 大小和对齐都是一条缓存行；定时器嵌入其中，接受连接时不需要单独分配，定时器链表也不负责释放
+struct alignas(64) client_data {
+    util_timer timer;  // 定时器
+    http_conn* conn;  // 连接对象，接受连接时从slab分配，关闭连接时归还
+    int sockfd;  // socket文件描述符
+};
+
 // 定时器链表（有头结点和尾结点的升序双向链表）
 class sort_timer_lst {
 public:
     sort_timer_lst() : head(NULL), tail(NULL) {}  // 列表初始化构造函数
     
-    // 链表析构（释放链表资源）
-    ~sort_timer_lst() {
-        util_timer* tmp = head;
-        while (tmp) {
-            head = tmp->next;
-            delete tmp;
-            tmp = head;
-        }
-    }
+    // 定时器嵌入在连接资源中，链表不负责释放
 
     // 将目标定时器按升序添加到链表中（会调用私有函数add_timer）
     void add_timer(util_timer* timer) {
@@ -87,39 +84,31 @@ public:
         }
     }
 
-    // 删除定时器
+    // 定时器是否在链表中
+    bool linked(util_timer* timer) {
+        return timer->prev || timer->next || timer == head;
+    }
+
+    // 删除定时器（从链表中取出，不释放）
     void del_timer(util_timer* timer) {
-        // 若timer不存在则直接返回 
-        if (!timer) return ;
+        // 若timer不存在或者不在链表中则直接返回
+        if (!timer || !linked(timer)) return ;
 
-        // 若链表中只有一个要删除的定时器timer
-        if ((timer == head) && (timer == tail)) {
-            delete timer;
+        if ((timer == head) && (timer == tail)) {  // 若链表中只有一个要删除的定时器timer
             head = NULL;
             tail = NULL;
-            return ;
-        }
-
-        // 若被删除的timer是头结点
-        if (timer == head) {
+        } else if (timer == head) {  // 若被删除的timer是头结点
             head = head->next;
             head->prev = NULL;
-            delete timer;
-            return ;
-        }
-
-        // 若被删除的timer是尾结点
-        if (timer == tail) {
+        } else if (timer == tail) {  // 若被删除的timer是尾结点
             tail = tail->prev;
             tail->next = NULL;
-            delete timer;
-            return ;
+        } else {  // 被删除的结点在链表内部
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
         }
-
-        // 被删除的结点在链表内部
-        timer->prev->next = timer->next;
-        timer->next->prev = timer->prev;
-        delete timer;
+        timer->prev = NULL;
+        timer->next = NULL;
     }
 
     // 定时任务处理函数
@@ -133,12 +122,14 @@ public:
             // 若当前时间小于定时器的超时时间，则当前时间一定小于后面定时器的超时时间
             if (cur < tmp->expire) break;
 
-            // 当前定时器到期，调用回调函数
-            tmp->cb_func(tmp->user_data);
-            // 将处理后的定时器从链表删除，并重置头结点
+            // 先将到期的定时器从链表删除并重置头结点，回调函数可能把它重新加入链表（推迟关闭连接）
             head = tmp->next;
             if (head) head->prev = NULL;
-            delete tmp;
+            else tail = NULL;
+            tmp->next = NULL;
+            // 调用回调函数（推迟关闭后的重试不重复计数）
+            if (!tmp->deferrals) metrics::add(metrics::TIMEOUTS);
+            tmp->cb_func(tmp->user_data);
             tmp = head;
         }
     }
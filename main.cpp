@@ -7,36 +7,39 @@
 #include <signal.h>  // 提供信号捕捉函数
 #include <arpa/inet.h>  // 提供IP地址转换函数，包含了sys/socket.h（提供socket函数及数据结构）和netinet/in.h（定义数据结构sockaddr_in）
 #include <sys/epoll.h>  // 提供操作内核时间表函数
+#include <netinet/tcp.h>  // 提供TCP_DEFER_ACCEPT、TCP_FASTOPEN选项
 
 #include "threadpool.h"  // 用于线程池的创建
 #include "http_conn.h"  // 用于解析http
 #include "lst_timer.h"  // 用于处理非活跃连接
 #include "log.h"  // 用于写日志
-
-#define MAX_FD 65535  // 最大的文件描述符个数
-#define MAX_EVENT_NUMBER 10000  // 监听的最大的事件数量
-#define TIMESLOT 5  // 最小超时单位5s
-
-#define listenfdLT // 设置监听文件描述符为水平触发模式
-// #define listenfdET  // 设置监听文件描述符为边缘触发模式
-
-#define SYNLOG  // 同步写日志
-// #define ASYNLOG  // 异步写日志
+#include "sql_async.h"  // 用于异步数据库查询
+#include "sql_batch.h"  // 用于注册的批量写入
+#include "access_log.h"  // 用于写访问日志
+#include "log_archiver.h"  // 用于压缩和清理切换掉的日志文件
+#include "metrics.h"  // 用于输出运行指标
+#include "latency.h"  // 用于统计请求各阶段的耗时
+#include "config.h"  // 用于读取运行时配置（端口、触发模式、日志、数据库等，见config.cpp中的配置项）
+#include "startup.h"  // 用于在后台并行完成启动预热
+#include "ip_limiter.h"  // 用于限制每个客户端IP的连接数和请求速率
+#include "slab.h"  // 用于分配连接对象
 
 // 定时器相关变量
 static int pipefd[2];  // 套接字柄对，用于socketpair参数
 static sort_timer_lst timer_lst;
 static int epollfd = 0;
+static slab<http_conn> conn_slab;  // 连接对象池，接受连接时分配，关闭连接时归还
+static const int MAX_DEFERRALS = 10;  // 关闭连接每被推迟这么多次记录一次警告
 
 // 外部函数，定义在了http_conn.cpp中
-// 设置文件描述符非阻塞
-extern void setnonblocking(int fd);
 // 添加文件描述符到epoll
-extern int addfd(int epollfd, int fd, bool one_shot);
+extern void addfd(int epollfd, int fd, bool one_shot, bool et);
 // 从epoll中删除文件描述符
 extern int removefd(int epollfd, int fd);
 // 修改文件描述符到epoll
 extern int modfd(int epollfd, int fd, int ev);
+// 网站根目录
+extern const char* doc_root;
 
 // 添加信号捕捉
 void addsig(int sig, void(handler)(int), bool restart = true) {
@@ -64,81 +67,277 @@ void sig_handler(int sig) {
     errno = save_error;
 }
 
-// 定时器回调函数，删除非活动连接在socket上的注册事件，并关闭
+// 定时器回调函数，删除非活动连接在socket上的注册事件，并关闭（所有关闭连接的路径都调用这里）
 void cb_func(client_data* user_data) {
+    assert(user_data);
+    // 移除链表上的定时器（到期时tick已经移除）
+    timer_lst.del_timer(&user_data->timer);
+
+    // 工作线程仍然持有该连接时不能关闭：先关闭socket的读写让处理尽快结束，工作线程重新注册事件后主线程会收到
+    // EPOLLHUP再次调用这里；定时器在下一个时隙也会再试一次
+    // 反复推迟说明工作线程迟迟没有结束（例如卡在数据库操作上），每推迟MAX_DEFERRALS次记录一次
+    if (user_data->conn->held()) {
+        shutdown(user_data->sockfd, SHUT_RDWR);
+        if (++user_data->timer.deferrals % MAX_DEFERRALS == 0)
+            LOG_WARN("close fd %d deferred %d times, connection still held", user_data->sockfd, user_data->timer.deferrals);
+        user_data->timer.expire = time(NULL) + config::get_instance()->timeslot;
+        timer_lst.add_timer(&user_data->timer);
+        return;
+    }
+
     // 删除非活动连接在socket上的注册事件
     epoll_ctl(epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
-    assert(user_data);
 
     // 减少连接数目
-    http_conn::m_user_count--;
+    __atomic_sub_fetch(&http_conn::m_user_count, 1, __ATOMIC_RELAXED);
+    ip_limiter::get_instance()->release(user_data->conn->get_address()->sin_addr.s_addr);
 
     // 关闭文件描述符
     close(user_data->sockfd);
+    // 归还连接对象
+    conn_slab.release(user_data->conn);
+    user_data->conn = NULL;
 
     // 日志
-    LOG_INFO("close fd %d", user_data->sockfd);
-    Log::get_instance()->flush();
+    LOG_DEBUG("close fd %d", user_data->sockfd);
+}
+
+// 异步查询完成（on_event或者expire返回的链表），将对应的请求重新放入请求队列
+void resume_sql(sql_task* task, threadpool<http_conn>* pool) {
+    while (task) {
+        sql_task* next = task->next;  // 放入请求队列后其他线程随时可能重用task，所以先取出next
+        http_conn* conn = (http_conn*)task->arg;
+        conn->queued();  // 挂起期间一直持有该连接，不再调用hold
+        pool->append(conn, false);  // 已经在处理中的请求不做准入检查
+        task = next;
+    }
+}
+
+// 边缘触发的监听socket重新注册事件，EPOLL_CTL_MOD时如果还有未接受的连接，epoll会再报告一次就绪
+void rearm_listen(int listenfd) {
+    epoll_event event;
+    event.data.fd = listenfd;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    epoll_ctl(epollfd, EPOLL_CTL_MOD, listenfd, &event);
+}
+
+// 将数据库连接池的统计信息写入日志（等待时间和持有时间单位为微秒）
+void log_pool_stats() {
+    static connection_pool::pool_stats stats;  // 包含直方图，放在静态区避免占用过多栈空间
+    connection_pool::GetInstance()->GetStats(&stats);
+    LOG_INFO("sql pool: in_use %u free %u max %u waiting %u timeouts %llu, "
+             "wait_us p50 %llu p99 %llu max %llu, hold_us p50 %llu p99 %llu max %llu, in_use p50 %llu p99 %llu",
+             stats.cur_conn, stats.free_conn, stats.max_conn, stats.waiting, stats.timeouts,
+             (unsigned long long)stats.wait_us.percentile(50), (unsigned long long)stats.wait_us.percentile(99),
+             (unsigned long long)stats.wait_us.max(),
+             (unsigned long long)stats.hold_us.percentile(50), (unsigned long long)stats.hold_us.percentile(99),
+             (unsigned long long)stats.hold_us.max(),
+             (unsigned long long)stats.in_use.percentile(50), (unsigned long long)stats.in_use.percentile(99));
+}
+
+// 将用户缓存的统计信息写入日志
+void log_cache_stats() {
+    user_cache::cache_stats stats;
+    user_cache::get_instance()->get_stats(&stats);
+    LOG_INFO("user cache: size %u capacity %u hits %llu misses %llu evictions %llu",
+             stats.size, stats.capacity, (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+             (unsigned long long)stats.evictions);
+
+    // 布隆过滤器在启动时的后台载入完成之后才输出
+    if (http_conn::filter_ready()) {
+        bloom_filter& filter = http_conn::m_user_filter;
+        LOG_INFO("user filter: %llu users, %llu bytes, target fp %.4f, estimated fp %.4f, skipped checks %llu, false positives %llu",
+                 (unsigned long long)filter.count(), (unsigned long long)filter.bytes(), filter.target_fp(),
+                 filter.estimated_fp(), (unsigned long long)__atomic_load_n(&http_conn::m_filter_skips, __ATOMIC_RELAXED),
+                 (unsigned long long)__atomic_load_n(&http_conn::m_filter_false_pos, __ATOMIC_RELAXED));
+    }
+
+    session_store::session_stats sessions;
+    session_store::get_instance()->get_stats(&sessions);
+    LOG_INFO("sessions: size %u created %llu expired %llu rejected %llu", sessions.size,
+             (unsigned long long)sessions.created, (unsigned long long)sessions.expired,
+             (unsigned long long)sessions.rejected);
+}
+
+// 抓取运行指标时追加其他模块的统计
+void collect_metrics(std::string& out) {
+    metrics::append(out, "webserver_connections_active", "gauge", "Open client connections.",
+                    __atomic_load_n(&http_conn::m_user_count, __ATOMIC_RELAXED));
+
+    connection_pool::pool_stats pool;
+    connection_pool::GetInstance()->GetStats(&pool);
+    metrics::append(out, "webserver_db_pool_connections", "gauge", "Database connections by state.", pool.cur_conn,
+                    "state=\"busy\"");
+    metrics::append_sample(out, "webserver_db_pool_connections", pool.free_conn, "state=\"idle\"");
+    metrics::append_sample(out, "webserver_db_pool_connections", pool.max_conn, "state=\"max\"");
+    metrics::append(out, "webserver_db_pool_waiting", "gauge", "Threads waiting for a database connection.",
+                    pool.waiting);
+    metrics::append(out, "webserver_db_pool_timeouts_total", "counter", "Connection acquisitions that timed out.",
+                    pool.timeouts);
+
+    user_cache::cache_stats cache;
+    user_cache::get_instance()->get_stats(&cache);
+    metrics::append(out, "webserver_user_cache_lookups_total", "counter", "User cache lookups by result.", cache.hits,
+                    "result=\"hit\"");
+    metrics::append_sample(out, "webserver_user_cache_lookups_total", cache.misses, "result=\"miss\"");
+    metrics::append(out, "webserver_user_cache_evictions_total", "counter", "User cache evictions.", cache.evictions);
+    metrics::append(out, "webserver_user_cache_entries", "gauge", "Users held in the cache.", cache.size);
+
+    session_store::session_stats sessions;
+    session_store::get_instance()->get_stats(&sessions);
+    metrics::append(out, "webserver_sessions_active", "gauge", "Live login sessions.", sessions.size);
+
+    ip_limiter::get_instance()->render(out);
+    metrics::append(out, "webserver_conn_objects", "gauge", "Connection objects in the slab by state.",
+                    conn_slab.in_use(), "state=\"in_use\"");
+    metrics::append_sample(out, "webserver_conn_objects", conn_slab.capacity(), "state=\"allocated\"");
+
+    metrics::append(out, "webserver_log_dropped_total", "counter", "Log lines dropped because a buffer was full.",
+                    Log::get_instance()->dropped());
+    if (access_log::get_instance()->enabled()) {
+        access_log::access_stats access;
+        access_log::get_instance()->get_stats(&access);
+        metrics::append(out, "webserver_access_log_lines_total", "counter", "Access log lines written.", access.lines);
+        metrics::append(out, "webserver_access_log_sampled_out_total", "counter",
+                        "Responses skipped by access log sampling.", access.sampled_out);
+    }
+
+    latency::render(out);
+    startup::get_instance()->render(out);
+}
+
+// 访问日志的统计信息
+void log_access_stats() {
+    if (!access_log::get_instance()->enabled()) return;
+    access_log::access_stats stats;
+    access_log::get_instance()->get_stats(&stats);
+    LOG_INFO("access log: lines %llu sampled out %llu bytes %llu", (unsigned long long)stats.lines,
+             (unsigned long long)stats.sampled_out, (unsigned long long)stats.bytes);
+}
+
+// 各阶段耗时的分位数（所有路由合并，微秒）
+void log_latency_stats() {
+    histogram* h = new histogram;  // 直方图较大，不放在栈上
+    for (int stage = 0; stage < latency::STAGES; ++stage) {
+        latency::merge(latency::ROUTES, stage, h);
+        if (h->count() == 0) continue;
+        LOG_INFO("latency %s: count %llu p50 %llu p90 %llu p99 %llu p99.9 %llu max %llu (us)",
+                 latency::stage_name(stage), (unsigned long long)h->count(),
+                 (unsigned long long)h->percentile(50) / 1000, (unsigned long long)h->percentile(90) / 1000,
+                 (unsigned long long)h->percentile(99) / 1000, (unsigned long long)h->percentile(99.9) / 1000,
+                 (unsigned long long)h->max() / 1000);
+    }
+    delete h;
+}
+
+// 日志归档的统计信息
+void log_archive_stats() {
+    log_archiver::archive_stats stats;
+    log_archiver::get_instance()->get_stats(&stats);
+    LOG_INFO("log archive: compressed %llu failed %llu bytes %llu -> %llu removed %llu",
+             (unsigned long long)stats.compressed, (unsigned long long)stats.failed,
+             (unsigned long long)stats.bytes_in, (unsigned long long)stats.bytes_out,
+             (unsigned long long)stats.removed);
 }
 
 // 定时处理任务并重新定时以不断触发SIGALRM信号
 void timer_handler() {
     timer_lst.tick();
-    alarm(SIGALRM);
-}
+    // 日志按时间刷新，空闲时也不会有日志长时间留在缓冲区中
+    Log::get_instance()->flush();
+    // 每次清理一个分片中过期的登录会话
+    session_store::get_instance()->expire();
+
+    // 定期输出统计信息
+    static time_t last_stats = time(NULL);
+    time_t cur = time(NULL);
+    if (cur - last_stats >= config::get_instance()->stats_interval) {
+        log_pool_stats();
+        log_cache_stats();
+        log_access_stats();
+        log_archive_stats();
+        log_latency_stats();
+        last_stats = cur;
+    }
 
-void show_error(int connfd, const char* info) {
-    printf("%s", info);
-    send(connfd, info, strlen(info), 0);
-    close(connfd);
+    alarm(config::get_instance()->timeslot);
 }
 
 // 主函数入口
 int main(int argc, char* argv[]) {  // argc是参数个数，argv是参数值
+    // 从这里开始计算启动耗时
+    startup* boot = startup::get_instance();
+
+    // 读取配置文件和命令行参数（用法：-f 配置文件、--key=value、端口号，-h列出所有配置项），校验失败时退出
+    config* conf = config::get_instance();
+    if (!conf->load(argc, argv)) exit(-1);
+
+    // 初始化日志信息，同步日志每个线程暂存的日志条数为0
+    Log::get_instance()->init(conf->log_file.c_str(), conf->log_buf_size, conf->log_split_lines,
+                              conf->log_mode == config::ASYNC ? conf->log_queue_size : 0, conf->log_binary);
+    // 生效的配置写入日志
+    conf->log_values();
+
+    // 切换掉的日志文件由后台线程压缩，并按大小和天数清理
+    log_archiver::get_instance()->watch(conf->log_file.c_str());
+    log_archiver::get_instance()->watch(conf->access_log_file.c_str());
+    if (!log_archiver::get_instance()->init(conf->archive_max_bytes, conf->archive_max_days, conf->archive_level)) {
+        LOG_ERROR("%s", "log archiver init error");
+    }
 
-// 初始化日志信息
-#ifdef SYNLOG
-    Log::get_instance()->init("ServerLog", 2000, 800000, 0);  // 同步日志，最后一个参数为0
-#endif
-
-#ifdef ASYLOG
-    log::get_instance()->init("ServerLog", 2000, 800000, 8);  // 异步日志，最后一个参数是队列大小
-#endif
-
-    // 命令行输入参数判断
-    if (argc <= 1) {
-        printf("按照如下命令执行：%s port_number\n", basename(argv[0]));
-        exit(-1);
+    // 访问日志写入单独的文件
+    if (conf->access_log_sample > 0 &&
+        !access_log::get_instance()->init(conf->access_log_file.c_str(), conf->access_log_format,
+                                          conf->access_log_sample, conf->access_log_split)) {
+        LOG_ERROR("%s", "access log init error");
     }
 
     // 获取端口号
-    int port = atoi(argv[1]);  // 转换成int类型
+    int port = conf->port;
 
     // 对SIGPIPE信号进行处理（如果通信双方一端关闭，另一端还在写数据，则会收到SIGPIPE信号）
     addsig(SIGPIPE, SIG_IGN);  // 由于SIGPIPE默认会终止程序，所以设置SIG_IGN忽略该信号
 
-    // 创建数据库连接池
+    // 创建数据库连接池（最多db_max_conn条连接，至少保持db_min_conn条，其中db_spare_conn条作为预热的空闲连接）
     connection_pool* connPool = connection_pool::GetInstance();
-    connPool->init("localhost", "root", "123456", "yourdb", 3306, 8);
+    connPool->init(conf->db_host, conf->db_user, conf->db_password, conf->db_name, conf->db_port, conf->db_max_conn,
+                   conf->db_min_conn, conf->db_spare_conn);
+
+    // 启动注册的批量写入线程（每批最多batch_size条，第一条最多等待batch_delay毫秒）
+    sql_batch::get_instance()->init(connPool, conf->batch_size, conf->batch_delay);
 
     // 创建线程池，初始化线程池
     threadpool<http_conn>* pool = NULL;
     // 异常捕捉
     try {  
-        pool = new threadpool<http_conn>(connPool);
+        pool = new threadpool<http_conn>(conf->thread_number, conf->max_requests, conf->queue_target,
+                                         conf->queue_interval);
     } catch (...) {
         exit(-1);
     }
 
-    // 创建一个数组，用于保存所有的客户端信息
-    http_conn* users = new http_conn[MAX_FD];
-    assert(users);
-
-    // 初始化数据库读取表
-    users->initmysql_result(connPool);
+    // 连接相关的配置
+    http_conn::m_read_buf_size = conf->read_buffer_size;
+    http_conn::m_write_buf_size = conf->write_buffer_size;
+    http_conn::m_conn_et = conf->conn_trigger == config::ET;
+    doc_root = conf->doc_root.c_str();
+    http_conn::init_reject_responses(conf->retry_after);
+    // 每个客户端IP的连接数和请求速率限制
+    ip_limiter* limiter = ip_limiter::get_instance();
+    limiter->init(conf->ip_max_conn, conf->ip_rate, conf->ip_burst);
+
+    // 初始化进程内共享的用户缓存（从数据库读取表预热在监听之后由后台线程完成）
+    user_cache::get_instance()->init(conf->user_cache_size);
+    // 分配登录会话表
+    session_store::get_instance()->init(conf->session_capacity, conf->session_ttl);
+    // 需要访问数据库的请求在查询时从连接池获取连接
+    http_conn::m_connPool = connPool;
+    // 抓取/metrics时追加各模块的统计
+    metrics::set_collector(collect_metrics);
 
     // 创建监听套接字，使用IPv4（PF_INET）协议族，流式协议（SOCK_STREAM），第三个参数一般写0， 流式协议默认使用TCP，报式协议默认使用UDP
-    int listenfd = socket(PF_INET, SOCK_STREAM, 0);  // 创建成功则返回文件描述符，失败则返回-1
+    // 监听socket需要非阻塞，accept循环读到EAGAIN时结束
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);  // 创建成功则返回文件描述符，失败则返回-1
     assert(listenfd >= 0);  // assert中条件表达式如果不满足的话，会返回错误并终止程序
     
     // 设置端口复用，在服务器绑定端口之前设置（SOL_SOCKET是端口复用的级别，SO_REUSEADDR表示端口复用）
@@ -149,57 +348,70 @@ int main(int argc, char* argv[]) {  // argc是参数个数，argv是参数值
     struct sockaddr_in address;  // 利用sockaddr_in创建socket地址（sockaddr_in用于IPv4，sockaddr_in6用于IPv6：）
     bzero(&address, sizeof(address));  // 清空address
     address.sin_family = AF_INET;  // 使用IPv4协议族
-<<<<<<< HEAD
     // h-host（主机字节序）、to（转换成什么）、n-network（网络字节序）、s-short unsigned short、l-long unsigned int
     address.sin_addr.s_addr = htonl(INADDR_ANY);  // 转换IP，将主机字节序转变为网络字节序（任何可以使用的IP地址）
     address.sin_port = htons(port);  // 转换端口号，将主机字节序转变为网络字节序
-=======
-    address.sin_addr.s_addr = htonl(INADDR_ANY);  // 任何可以使用的IP地址
-    address.sin_port = htons(port);  // 端口号，将主机字节序转变为网络字节序
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
     int ret = 0;  // 用于接受bind、listen函数返回值，进而判断是否创建成功
     ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));  // 注意将address强制转换为sockaddr
     assert(ret >= 0);
 
+    // 收到客户端的数据后才完成accept，只建立连接不发请求的客户端不占用连接资源
+    if (conf->defer_accept > 0 &&
+        setsockopt(listenfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &conf->defer_accept, sizeof(conf->defer_accept)) < 0) {
+        LOG_WARN("set TCP_DEFER_ACCEPT error, errno is:%d", errno);
+    }
+    // TCP Fast Open：重复连接的客户端在SYN中携带请求，省去一次往返（需要net.ipv4.tcp_fastopen开启服务端）
+    if (conf->fast_open > 0 &&
+        setsockopt(listenfd, IPPROTO_TCP, TCP_FASTOPEN, &conf->fast_open, sizeof(conf->fast_open)) < 0) {
+        LOG_WARN("set TCP_FASTOPEN error, errno is:%d", errno);
+    }
+
     // 监听
-    ret = listen(listenfd, 5);  // 5表示未连接的和已经连接的和的最大值
+    ret = listen(listenfd, conf->listen_backlog);  // 已完成握手、等待accept的连接队列长度，连接突发时队列满会导致SYN重传（1秒以上的延迟）
     assert(ret >= 0);
 
     // 创建内核事件表
-    epoll_event events[MAX_EVENT_NUMBER];
+    epoll_event* events = new epoll_event[conf->max_events];
     epollfd = epoll_create(5);  // 创建一个指示epoll内核事件表的文件描述符，5没有意义，只要大于0即可，失败返回-1，成功返回epoll的文件描述符
     assert(epollfd != -1);
 
     // 将监听的文件描述符添加到epoll对象中
-    addfd(epollfd, listenfd, false);  // 监听文件描述符不需要EPOLLONESHOT事件
+    addfd(epollfd, listenfd, false, conf->listen_trigger == config::ET);  // 监听文件描述符不需要EPOLLONESHOT事件
     http_conn::m_epollfd = epollfd;
+    // 异步数据库查询的socket也注册到同一个epoll
+    sql_async::get_instance()->init(epollfd, conf->max_fd);
     
     // 创建管道套接字，其中管道写端写入信号值，管道读端通过I/O复用系统监测读事件
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);  // 第一个参数表示协议族，第二个参数表示协议，第三个参数表示类型，只能为0，第四个参数是套接字柄对
+    // 两端都设置为非阻塞，信号处理函数写管道时不会阻塞
+    ret = socketpair(PF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pipefd);  // 第一个参数表示协议族，第二个参数表示协议，第三个参数表示类型，只能为0，第四个参数是套接字柄对
     assert(ret != -1);
-    // 设置管道写端为非阻塞
-    setnonblocking(pipefd[1]);
     // 统一事件源，信号处理函数使用管道将信号传递给主循环，
     // 信号处理函数往管道的写端写入信号值，主循环则从管道的读端读出信号值
-    addfd(epollfd, pipefd[0], false);
+    addfd(epollfd, pipefd[0], false, false);
     // 传递给主循环的信号值，添加信号捕捉
-<<<<<<< HEAD
     addsig(SIGALRM, sig_handler, false);  // 由alarm系统调用产生timer时钟信号
     addsig(SIGTERM, sig_handler, false);  // 终端发送的终止信号
-=======
-    addsig(SIGALRM, sig_handler, false);
-    addsig(SIGTERM, sig_handler, false);
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
-    // 每隔TIMESLOT时间触发SIGALRM
-    alarm(TIMESLOT);  // 设置信号SIGALRM在经过TIMESLOT秒后发送给目前的进程
+    // 每隔timeslot时间触发SIGALRM
+    alarm(conf->timeslot);  // 设置信号SIGALRM在经过timeslot秒后发送给目前的进程
     bool timeout = false;  // 超时标志
     bool stop_server = false;  // 循环条件
-    // 在堆区创建用户的连接资源
-    client_data* users_timer = new client_data[MAX_FD];
+    // 在堆区创建用户的连接资源，按文件描述符下标，每项一条缓存行；连接对象在接受连接时从conn_slab分配
+    void* users_mem = NULL;
+    if (posix_memalign(&users_mem, 64, sizeof(client_data) * conf->max_fd) != 0) {
+        LOG_ERROR("%s", "alloc client data failure");
+        return 1;
+    }
+    client_data* users_timer = (client_data*)users_mem;
+    for (int i = 0; i < conf->max_fd; ++i) new (&users_timer[i]) client_data();
+    // 超过最大连接数时新连接直接回复503
+    int max_conn = conf->max_conn > 0 ? conf->max_conn : conf->max_fd;
+
+    // 已经可以接受连接，在后台载入用户表、预读静态文件，全部完成后/ready返回200
+    boot->run(connPool, conf->user_cache_size, conf->user_filter_fp, doc_root, conf->warm_file_bytes);
     
     while (!stop_server) {
         // epoll_wait等待所监控文件描述符上事件的产生，大于0返回就绪的文件描述符个数，等于0表示时间到，等于-1表示失败
-        int num = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);  // events是传出参数，用来存内核得到事件的集合；-1 表示阻塞，直到检测到fd数据发生变化，解除阻塞（0表示不阻塞，大于0表示阻塞的时长（毫秒））
+        int num = epoll_wait(epollfd, events, conf->max_events, -1);  // events是传出参数，用来存内核得到事件的集合；-1 表示阻塞，直到检测到fd数据发生变化，解除阻塞（0表示不阻塞，大于0表示阻塞的时长（毫秒））
         if (num < 0 && errno != EINTR) {
             LOG_ERROR("%s", "epoll failure");
             break;
@@ -213,88 +425,79 @@ int main(int argc, char* argv[]) {  // argc是参数个数，argv是参数值
             if (sockfd == listenfd) {
                 // 接收客户端连接
                 struct sockaddr_in client_address;
-                socklen_t client_addrlen = sizeof(client_address);
-#ifdef listenfdLT     
-                // 分配给客户端的文件描述符           
-<<<<<<< HEAD
-                int connfd = accept(listenfd, (struct sockaddr*)&client_address, &client_addrlen);  // client_address是传出参数（不能直接用sizeof(client_address)，需要有变量接收），成功则返回用于通信的文件描述符，失败返回-1
-=======
-                int connfd = accept(listenfd, (struct sockaddr*)&client_address, &client_addrlen);  // client_address是传出参数，成功则返回用于通信的文件描述符，失败返回-1
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
-                if (connfd < 0) {
-                    // 日志
-                    LOG_ERROR("%s:errno is:%d", "accept error", errno);
-                    continue;
-                }
-
-                if (http_conn::m_user_count >= MAX_FD) {
-                    // 目前连接已满，给客户端一个信息，显示服务器正忙
-                    show_error(connfd, "Internal sever busy");
-                    // 日志
-                    LOG_ERROR("%s", "Internal server busy");
-                    continue;
-                }            
-                // 将新的客户数据初始化放入用户数组中
-                users[connfd].init(connfd, client_address);
-
-                // 初始化新的客户的连接资源
-                users_timer[connfd].address = client_address;
-                users_timer[connfd].sockfd = connfd;
-                // 创建定时器，并设置连接资源、回调函数、超时时间
-                util_timer* timer = new util_timer;
-                timer->user_data = &users_timer[connfd];
-                timer->cb_func = cb_func;
-                time_t cur = time(NULL);  // 当前时间
-                timer->expire = cur + 3 * TIMESLOT;
-                // 连接资源绑定定时器
-                users_timer[connfd].timer = timer;
-                // 将定时器添加到双向链表中
-                timer_lst.add_timer(timer);
-#endif
-
-#ifdef listenfdET
-                while (1) {
-                    // 分配给客户端的文件描述符           
-                    int connfd = accept(listenfd, (struct sockaddr*)&client_address, &client_addrlen);  // client_address是传出参数，成功则返回用于通信的文件描述符，失败返回-1
+                // 每次事件最多接受accept_batch个连接，连接突发时一次处理一批，又不会让其他连接的事件等待太久
+                int accepted = 0;
+                while (accepted < conf->accept_batch) {
+                    socklen_t client_addrlen = sizeof(client_address);
+                    // 分配给客户端的文件描述符，accept4直接设置非阻塞和close-on-exec，不需要再调用fcntl
+                    int connfd = accept4(listenfd, (struct sockaddr*)&client_address, &client_addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);  // client_address是传出参数（不能直接用sizeof(client_address)，需要有变量接收），成功则返回用于通信的文件描述符，失败返回-1
                     if (connfd < 0) {
-                        // 日志
-                        LOG_ERROR("%s:errno is:%d", "accept error", errno);
+                        // 握手完成后客户端又断开了，继续接受下一个
+                        if (errno == ECONNABORTED || errno == EINTR) continue;
+                        // EAGAIN表示已经接受完所有连接
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            // 日志
+                            LOG_ERROR("%s:errno is:%d", "accept error", errno);
+                        }
                         break;
                     }
+                    ++accepted;
 
-                    if (http_conn::m_user_count >= MAX_FD) {
-                        // 目前连接已满，给客户端一个信息，显示服务器正忙
-                        show_error(connfd, "Internal server busy");
+                    // 文件描述符超出数组范围时同样拒绝（进程的文件描述符上限可能大于max_fd）
+                    if (__atomic_load_n(&http_conn::m_user_count, __ATOMIC_RELAXED) >= max_conn ||
+                        connfd >= conf->max_fd) {
+                        // 目前连接已满，回复503（带Retry-After）后关闭连接
+                        http_conn::send_busy(connfd);
+                        close(connfd);
+                        metrics::add(metrics::REJECTS);
                         // 日志
-                        LOG_ERROR("%s", "Internal server busy");
+                        LOG_WARN("%s", "Internal server busy");
+                        continue;  // 继续接受（并拒绝）剩下的连接
+                    }
+                    // 单个客户端IP的连接数超过上限，回复429后关闭连接，之后关闭连接时（cb_func）再减少计数
+                    if (!limiter->acquire(client_address.sin_addr.s_addr)) {
+                        http_conn::send_limited(connfd);
                         close(connfd);
-                        break;
-                    }            
-                    // 将新的客户数据初始化放入用户数组中
-                    users[connfd].init(connfd, client_address);
-
+                        continue;
+                    }
+                    client_data* data = &users_timer[connfd];
+                    // 从对象池分配连接对象，内存不足时同样回复503
+                    http_conn* conn = conn_slab.alloc();
+                    if (!conn) {
+                        limiter->release(client_address.sin_addr.s_addr);
+                        http_conn::send_busy(connfd);
+                        close(connfd);
+                        metrics::add(metrics::REJECTS);
+                        LOG_ERROR("%s", "alloc connection failure");
+                        continue;
+                    }
                     // 初始化新的客户的连接资源
-                    users_timer[connfd].address = client_address;
-                    users_timer[connfd].sockfd = connfd;
-                    // 创建定时器，并设置连接资源、回调函数、超时时间
-                    util_timer* timer = new util_timer;
-                    timer->user_data = &users_timer[connfd];
+                    metrics::add(metrics::ACCEPTS);
+                    data->conn = conn;
+                    data->sockfd = connfd;
+                    conn->init(connfd, client_address);
+                    // 设置嵌入的定时器的连接资源、回调函数、超时时间
+                    util_timer* timer = &data->timer;
+                    timer->user_data = data;
                     timer->cb_func = cb_func;
                     time_t cur = time(NULL);  // 当前时间
-                    timer->expire = cur + 3 * TIMESLOT;
-                    // 连接资源绑定定时器
-                    users_timer[connfd].timer = timer;
+                    timer->expire = cur + 3 * conf->timeslot;
+                    timer->deferrals = 0;
+                    timer->prev = NULL;
+                    timer->next = NULL;
                     // 将定时器添加到双向链表中
                     timer_lst.add_timer(timer);
                 }
-                continue;
-#endif
+                // 边缘触发时没有读到EAGAIN，剩下的连接不会再产生事件，重新设置一次让epoll再次报告就绪
+                if (accepted == conf->accept_batch && conf->listen_trigger == config::ET) {
+                    rearm_listen(listenfd);
+                }
+            } else if (sql_async::get_instance()->is_sql_fd(sockfd)) {
+                // 数据库socket就绪（或者其他线程完成了操作），推进挂起的异步查询，查询完成后将对应的请求重新放入请求队列
+                resume_sql(sql_async::get_instance()->on_event(sockfd, events[i].events), pool);
             } else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {  
-                // 对方异常断开或者出现错误等事件
-                // 移除链表上的定时器
-                util_timer* timer = users_timer[sockfd].timer;
-                timer->cb_func(&users_timer[sockfd]);
-                if (timer) timer_lst.del_timer(timer);
+                // 对方异常断开或者出现错误等事件（包括工作线程通过close_conn交回的连接），关闭连接
+                cb_func(&users_timer[sockfd]);
 
             } else if ((sockfd == pipefd[0]) && (events[i].events & EPOLLIN)) {
                 // recv的传出参数
@@ -317,59 +520,76 @@ int main(int argc, char* argv[]) {  // argc是参数个数，argv是参数值
                     }
                 }
             } else if (events[i].events & EPOLLIN) {
-                // 创建定时器临时变量，将该连接对应的定时器取出
-                util_timer* timer = users_timer[sockfd].timer;
+                // 取出该连接对应的定时器和连接对象
+                util_timer* timer = &users_timer[sockfd].timer;
+                http_conn* conn = users_timer[sockfd].conn;
 
-                if (users[sockfd].read()) {  // 一次性把所有数据都读完
+                bool first = conn->at_request_start();
+                if (conn->read()) {  // 一次性把所有数据都读完
                     // 日志
-                    LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
+                    LOG_DEBUG("deal with the client(%s)", inet_ntoa(conn->get_address()->sin_addr));
                     
-                    Log::get_instance()->flush();
-                    // 若监听到读事件，则将该事件放入请求队列
-                    
-                    
-                    pool->append(users + sockfd);
+                    // 运行指标由主线程直接处理，线程池繁忙时也能抓取；其他请求放入请求队列
+                    // 每个请求在读到开头时计入一次客户端的速率（运行指标不计），请求体分多次到达时不重复计入；
+                    // 每次只处理读缓冲区中的一个请求（不支持流水线），所以计入的次数就是处理的请求数
+                    bool admitted = true, limited = false;
+                    if (conn->is_local_request()) {
+                        conn->hold();
+                        conn->process();
+                    } else if (first && !limiter->allow(conn->get_address()->sin_addr.s_addr, latency::now())) {
+                        limited = true;
+                    } else {
+                        conn->hold();
+                        conn->queued();
+                        admitted = pool->append(conn);
+                        if (!admitted) conn->release();
+                    }
 
-                    // 若有数据传输，则更新定时器，延迟3个单位，并调整定时器在链表中的位置
-                    if (timer) {
+                    if (limited) {
+                        // 客户端超过请求速率，回复429并关闭连接
+                        http_conn::send_limited(sockfd);
+                        cb_func(&users_timer[sockfd]);
+                    } else if (!admitted) {
+                        // 请求队列已满或者排队时间过长，由主线程直接回复503并关闭连接，不让请求在队列中等到超时
+                        http_conn::send_busy(sockfd);
+                        metrics::add(metrics::SHEDS);
+                        cb_func(&users_timer[sockfd]);
+                    } else {
+                        // 若有数据传输，则更新定时器，延迟3个单位，并调整定时器在链表中的位置
                         time_t cur = time(NULL);
-                        timer->expire = cur + 3 * TIMESLOT;
+                        timer->expire = cur + 3 * conf->timeslot;
                         timer_lst.adjust_timer(timer);
                         // 日志
-                        LOG_INFO("%s", "adjust timer once");
-                        Log::get_instance()->flush();
+                        LOG_DEBUG("%s", "adjust timer once");
                         
                     }
                 } else {
-                    // 移除链表上的定时器
-                    timer->cb_func(&users_timer[sockfd]);
-                    if (timer) timer_lst.del_timer(timer);
+                    // 对方关闭连接或者读出错，关闭连接
+                    cb_func(&users_timer[sockfd]);
                 }
             } else if (events[i].events & EPOLLOUT) {
-                util_timer* timer = users_timer[sockfd].timer;
-                if (users[sockfd].write()) {  // 一次性写完所有数据
+                util_timer* timer = &users_timer[sockfd].timer;
+                http_conn* conn = users_timer[sockfd].conn;
+                if (conn->write()) {  // 一次性写完所有数据
                     // 日志
-                    LOG_INFO("send data to the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
-                    Log::get_instance()->flush();
+                    LOG_DEBUG("send data to the client(%s)", inet_ntoa(conn->get_address()->sin_addr));
                     // 若有数据传输，则更新定时器，延时3个单位，并调整定时器在链表中的位置
-                    if (timer) {
-                        time_t cur = time(NULL);
-                        timer->expire = cur + 3 * TIMESLOT;
-                        timer_lst.adjust_timer(timer);
-                        // 日志
-                        LOG_INFO("%s", "adjust timer once");
-                        Log::get_instance()->flush();
-                    }
+                    time_t cur = time(NULL);
+                    timer->expire = cur + 3 * conf->timeslot;
+                    timer_lst.adjust_timer(timer);
+                    // 日志
+                    LOG_DEBUG("%s", "adjust timer once");
                 } else {  
-                    // 否则移除链表上的定时器
-                    timer->cb_func(&users_timer[sockfd]);
-                    if (timer) timer_lst.del_timer(timer);
+                    // 否则关闭连接
+                    cb_func(&users_timer[sockfd]);
                 }
             }
         }
         // 处理定时器为非必须事件，收到信号并不是立即处理，完成读写事件后再进行处理
         if (timeout) {
             timer_handler();
+            // 数据库停止响应时，挂起的查询超时失败，请求继续处理并归还数据库连接
+            resume_sql(sql_async::get_instance()->expire(time(NULL)), pool);
             timeout = false;
         }
     }
@@ -378,8 +598,8 @@ int main(int argc, char* argv[]) {  // argc是参数个数，argv是参数值
     close(listenfd);  // 关闭监听的文件描述符
     close(pipefd[0]);  // 关闭读端文件描述符
     close(pipefd[1]);  // 关闭写端文件描述符
-    delete[] users;  // 删除用户数组
-    delete[] users_timer;  // 删除用户连接资源数组
+    free(users_timer);  // 删除用户连接资源数组（client_data只有平凡析构）
+    delete[] events;  // 删除事件数组
     delete pool;  // 删除线程池
 
     return 0;
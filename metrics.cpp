@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "metrics.h"
+
+__thread metrics::shard* metrics::t_shard = NULL;
+
+// 所有线程的计数区和收集函数
+static metrics::shard* g_shards = NULL;
+static pthread_mutex_t g_shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static metrics::collector g_collector = NULL;
+
+// 单独统计的状态码，其他的计入最后一项
+static const int status_codes[metrics::STATUS_CODES - 1] = {200, 302, 400, 403, 404, 429, 500, 503};
+
+int metrics::status_index(int status) {
+    for (int i = 0; i < STATUS_CODES - 1; ++i) {
+        if (status_codes[i] == status) return i;
+    }
+    return STATUS_CODES - 1;
+}
+
+metrics::shard* metrics::register_thread() {
+    // 按缓存行对齐分配，线程结束后计数区保留（计数仍然有效）
+    void* mem = NULL;
+    if (posix_memalign(&mem, 64, sizeof(shard)) != 0) abort();
+    shard* s = (shard*)mem;
+    memset(s, 0, sizeof(shard));
+
+    pthread_mutex_lock(&g_shards_lock);
+    s->next = g_shards;
+    __atomic_store_n(&g_shards, s, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_shards_lock);
+
+    t_shard = s;
+    return s;
+}
+
+void metrics::set_collector(collector c) {
+    g_collector = c;
+}
+
+void metrics::append_sample(std::string& out, const char* name, double value, const char* labels) {
+    char line[256];
+    int n;
+    // 整数按整数输出，避免科学计数法
+    if (value == (double)(long long)value) {
+        n = snprintf(line, sizeof(line), labels ? "%s{%s} %lld\n" : "%s%s %lld\n", name, labels ? labels : "",
+                     (long long)value);
+    } else {
+        n = snprintf(line, sizeof(line), labels ? "%s{%s} %.6g\n" : "%s%s %.6g\n", name, labels ? labels : "", value);
+    }
+    if (n > 0) out.append(line, n < (int)sizeof(line) ? n : (int)sizeof(line) - 1);
+}
+
+void metrics::append(std::string& out, const char* name, const char* type, const char* help, double value,
+                     const char* labels) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+    append_sample(out, name, value, labels);
+}
+
+void metrics::render(std::string& out) {
+    // 汇总所有线程的计数，读到的是每个线程某一时刻的值，各项之间不要求一致
+    uint64_t counters[COUNTERS] = {0};
+    uint64_t status[STATUS_CODES] = {0};
+    int64_t gauges[GAUGES] = {0};
+    for (shard* s = __atomic_load_n(&g_shards, __ATOMIC_ACQUIRE); s; s = s->next) {
+        for (int i = 0; i < COUNTERS; ++i) counters[i] += __atomic_load_n(&s->counters[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < STATUS_CODES; ++i) status[i] += __atomic_load_n(&s->status[i], __ATOMIC_RELAXED);
+        for (int i = 0; i < GAUGES; ++i) gauges[i] += __atomic_load_n(&s->gauges[i], __ATOMIC_RELAXED);
+    }
+
+    out += "# HELP webserver_http_requests_total Completed HTTP responses by status code.\n"
+           "# TYPE webserver_http_requests_total counter\n";
+    for (int i = 0; i < STATUS_CODES; ++i) {
+        char labels[32];
+        if (i < STATUS_CODES - 1) snprintf(labels, sizeof(labels), "code=\"%d\"", status_codes[i]);
+        else snprintf(labels, sizeof(labels), "code=\"other\"");
+        append_sample(out, "webserver_http_requests_total", status[i], labels);
+    }
+    append(out, "webserver_bytes_received_total", "counter", "Bytes read from client sockets.", counters[BYTES_IN]);
+    append(out, "webserver_bytes_sent_total", "counter", "Bytes written to client sockets.", counters[BYTES_OUT]);
+    append(out, "webserver_connections_accepted_total", "counter", "Accepted client connections.", counters[ACCEPTS]);
+    append(out, "webserver_connections_rejected_total", "counter", "Connections refused because the server was full.",
+           counters[REJECTS]);
+    append(out, "webserver_connections_timed_out_total", "counter", "Connections closed by the idle timer.",
+           counters[TIMEOUTS]);
+    append(out, "webserver_requests_shed_total", "counter",
+           "Requests answered with 503 because the thread pool was overloaded.", counters[SHEDS]);
+    append(out, "webserver_threadpool_queue_depth", "gauge", "Requests waiting in the thread pool queue.",
+           gauges[QUEUE_DEPTH]);
+    append(out, "webserver_threadpool_overloaded", "gauge",
+           "Whether queueing delay stayed above the target for a whole interval.", gauges[OVERLOADED]);
+
+    if (g_collector) g_collector(out);
+}
@@ -0,0 +1,84 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string>
+
+// 运行指标：每个线程有一块按缓存行对齐的计数区，只由本线程写入（单写者，普通的加法即可，用relaxed原子存储避免撕裂），
+// 不同线程的计数不会落在同一条缓存行，热路径上没有锁也没有原子读改写；抓取时遍历所有线程的计数区求和。
+// 仪表（gauge）同样按线程记录增量，一个线程加、另一个线程减时求和后仍然正确。
+// 其他模块自带的统计（连接池、用户缓存、日志等）通过收集函数在抓取时追加，输出为Prometheus文本格式
+class metrics {
+public:
+    // 计数器
+    enum COUNTER {
+        BYTES_IN = 0,  // 读取的字节数
+        BYTES_OUT,  // 发送的字节数
+        ACCEPTS,  // 接受的连接数
+        REJECTS,  // 因为连接数已满而拒绝的连接数
+        TIMEOUTS,  // 因为超时而关闭的连接数
+        SHEDS,  // 因为过载（请求队列已满或者排队时间过长）直接回复503的请求数
+        COUNTERS
+    };
+
+    // 仪表
+    enum GAUGE {
+        QUEUE_DEPTH = 0,  // 线程池请求队列中的请求数
+        OVERLOADED,  // 线程池是否处于过载状态（0或1）
+        GAUGES
+    };
+
+    // 按状态码统计的请求数，其他状态码计入最后一项
+    static const int STATUS_CODES = 9;
+
+    // 收集函数，在抓取时把其他模块的统计追加到out
+    typedef void (*collector)(std::string& out);
+
+    struct alignas(64) shard {
+        uint64_t counters[COUNTERS];
+        uint64_t status[STATUS_CODES];
+        int64_t gauges[GAUGES];
+        shard* next;  // 所有线程的计数区串成链表
+    };
+
+    static void add(int id, uint64_t n = 1) {
+        shard* s = local();
+        __atomic_store_n(&s->counters[id], s->counters[id] + n, __ATOMIC_RELAXED);
+    }
+
+    static void gauge_add(int id, int64_t n) {
+        shard* s = local();
+        __atomic_store_n(&s->gauges[id], s->gauges[id] + n, __ATOMIC_RELAXED);
+    }
+
+    // 记录一个完成的响应
+    static void request(int status) {
+        shard* s = local();
+        int i = status_index(status);
+        __atomic_store_n(&s->status[i], s->status[i] + 1, __ATOMIC_RELAXED);
+    }
+
+    // 设置收集函数（启动时调用一次）
+    static void set_collector(collector c);
+
+    // 汇总所有线程的计数并按Prometheus文本格式输出
+    static void render(std::string& out);
+
+    // 输出一个指标（收集函数使用），labels形如code="200"，可以为NULL
+    static void append(std::string& out, const char* name, const char* type, const char* help, double value,
+                       const char* labels = NULL);
+    // 只输出一个样本，不带HELP和TYPE（同一个指标的多个标签值）
+    static void append_sample(std::string& out, const char* name, double value, const char* labels = NULL);
+
+private:
+    static shard* local() {
+        shard* s = t_shard;
+        return s ? s : register_thread();
+    }
+    static int status_index(int status);
+    static shard* register_thread();
+
+    static __thread shard* t_shard;  // 当前线程的计数区
+};
+
+#endif
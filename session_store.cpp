@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/random.h>
+
+#include "session_store.h"
+
+session_store::session_store() {
+    for (int i = 0; i < SHARDS; ++i) {
+        m_shards[i].slots = NULL;
+        m_shards[i].mask = 0;
+        m_shards[i].size = 0;
+        m_shards[i].limit = 0;
+        m_shards[i].created = m_shards[i].expired = m_shards[i].rejected = 0;
+    }
+    m_ttl = DEFAULT_TTL;
+    m_next_expire = 0;
+}
+
+session_store::~session_store() {
+    for (int i = 0; i < SHARDS; ++i) free(m_shards[i].slots);
+}
+
+// 单例模式
+session_store* session_store::get_instance() {
+    static session_store instance;
+    return &instance;
+}
+
+bool session_store::init(int capacity, int ttl) {
+    int per_shard = capacity / SHARDS;
+    if (per_shard < 1) per_shard = 1;
+
+    // 槽位数取不小于两倍会话数的2的幂，负载不超过一半
+    uint32_t slots = 1;
+    while (slots < (uint32_t)per_shard * 2) slots <<= 1;
+
+    for (int i = 0; i < SHARDS; ++i) {
+        shard& s = m_shards[i];
+        slot* table = (slot*)calloc(slots, sizeof(slot));
+        if (!table) return false;
+        free(s.slots);
+        s.slots = table;
+        s.mask = slots - 1;
+        s.size = 0;
+        s.limit = per_shard;
+    }
+    m_ttl = ttl > 0 ? ttl : DEFAULT_TTL;
+    return true;
+}
+
+bool session_store::parse(const char* sid, uint64_t* id) {
+    id[0] = id[1] = 0;
+    for (int i = 0; i < ID_LEN; ++i) {
+        char c = sid[i];
+        uint64_t v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else return false;
+        id[i / 16] = (id[i / 16] << 4) | v;
+    }
+    return sid[ID_LEN] == '\0';
+}
+
+bool session_store::generate(uint64_t* id) {
+    // 优先使用getrandom，内核不支持时读取/dev/urandom
+    ssize_t n = getrandom(id, sizeof(uint64_t) * 2, 0);
+    if (n == (ssize_t)(sizeof(uint64_t) * 2)) return true;
+
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    n = read(fd, id, sizeof(uint64_t) * 2);
+    close(fd);
+    return n == (ssize_t)(sizeof(uint64_t) * 2);
+}
+
+session_store::slot* session_store::find_nolock(shard& s, const uint64_t* id, char* user, time_t* expire) {
+    if (!s.slots) return NULL;
+
+    uint32_t i = id[1] & s.mask;
+    for (uint32_t n = 0; n <= s.mask; ++n, i = (i + 1) & s.mask) {
+        slot& sl = s.slots[i];
+        while (true) {
+            // 序列号为奇数表示正在修改，读完后序列号不变才说明读到的内容是完整的
+            uint32_t seq = __atomic_load_n(&sl.seq, __ATOMIC_ACQUIRE);
+            if (seq & 1) continue;
+            uint32_t used = __atomic_load_n(&sl.used, __ATOMIC_RELAXED);
+            bool match = used && __atomic_load_n(&sl.id[0], __ATOMIC_RELAXED) == id[0]
+                         && __atomic_load_n(&sl.id[1], __ATOMIC_RELAXED) == id[1];
+            if (match && user) memcpy(user, sl.user, NAME_LEN);
+            if (match) *expire = __atomic_load_n(&sl.expire, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&sl.seq, __ATOMIC_RELAXED) != seq) continue;
+
+            if (!used) return NULL;  // 探测序列结束
+            if (match) return &sl;
+            break;
+        }
+    }
+    return NULL;
+}
+
+session_store::slot* session_store::find_locked(shard& s, const uint64_t* id) {
+    if (!s.slots) return NULL;
+
+    uint32_t i = id[1] & s.mask;
+    for (uint32_t n = 0; n <= s.mask; ++n, i = (i + 1) & s.mask) {
+        slot& sl = s.slots[i];
+        if (!sl.used) return NULL;
+        if (sl.id[0] == id[0] && sl.id[1] == id[1]) return &sl;
+    }
+    return NULL;
+}
+
+void session_store::erase_locked(shard& s, uint32_t i) {
+    // 线性探测的后移删除：其后同一探测序列中的会话依次前移填补空位，不需要墓碑
+    uint32_t j = i;
+    while (true) {
+        j = (j + 1) & s.mask;
+        slot& next = s.slots[j];
+        if (!next.used) break;
+
+        // next的初始位置不在(i, j]区间内时，可以移动到i
+        uint32_t home = next.id[1] & s.mask;
+        bool movable = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+        if (!movable) continue;
+
+        slot& hole = s.slots[i];
+        write_begin(hole);
+        hole.used = 1;
+        hole.id[0] = next.id[0];
+        hole.id[1] = next.id[1];
+        hole.expire = __atomic_load_n(&next.expire, __ATOMIC_RELAXED);
+        memcpy(hole.user, next.user, NAME_LEN);
+        write_end(hole);
+        i = j;
+    }
+
+    slot& hole = s.slots[i];
+    write_begin(hole);
+    hole.used = 0;
+    write_end(hole);
+    s.size--;
+}
+
+bool session_store::create(const char* user, char* sid) {
+    uint64_t id[2];
+    if (!generate(id)) return false;
+
+    shard& s = get_shard(id);
+    if (!s.slots) return false;
+
+    s.lock.lock();
+    // 分片已满时先清理过期的会话
+    if (s.size >= s.limit) {
+        time_t now = time(NULL);
+        for (uint32_t i = 0; i <= s.mask; ++i) {
+            while (s.slots[i].used && __atomic_load_n(&s.slots[i].expire, __ATOMIC_RELAXED) <= now) {
+                erase_locked(s, i);
+                s.expired++;
+            }
+        }
+    }
+    if (s.size >= s.limit) {
+        s.rejected++;
+        s.lock.unlock();
+        return false;
+    }
+
+    uint32_t i = id[1] & s.mask;
+    while (s.slots[i].used) i = (i + 1) & s.mask;
+
+    slot& sl = s.slots[i];
+    write_begin(sl);
+    sl.used = 1;
+    sl.id[0] = id[0];
+    sl.id[1] = id[1];
+    sl.expire = time(NULL) + m_ttl;
+    strncpy(sl.user, user, NAME_LEN - 1);
+    sl.user[NAME_LEN - 1] = '\0';
+    write_end(sl);
+    s.size++;
+    s.created++;
+    s.lock.unlock();
+
+    snprintf(sid, ID_LEN + 1, "%016llx%016llx", (unsigned long long)id[0], (unsigned long long)id[1]);
+    return true;
+}
+
+bool session_store::lookup(const char* sid, char* user) {
+    uint64_t id[2];
+    if (!sid || !parse(sid, id)) return false;
+
+    shard& s = get_shard(id);
+    time_t expire = 0;
+    if (!find_nolock(s, id, user, &expire)) {
+        // 无锁查询可能恰好错过正在前移的会话，加锁再确认一次（只有无效的会话ID才会走到这里）
+        s.lock.lock();
+        slot* sl = find_locked(s, id);
+        if (sl && user) memcpy(user, sl->user, NAME_LEN);
+        if (sl) expire = sl->expire;
+        s.lock.unlock();
+        if (!sl) return false;
+    }
+
+    // 过期的会话由定时器清理，这里只判断
+    time_t now = time(NULL);
+    if (expire <= now) return false;
+    if (expire - now >= m_ttl / 2) return true;
+
+    // 剩余有效期不足一半时顺延（避免每次访问都写）。无锁查询找到的槽位随后可能被前移或者删除，
+    // 所以加锁后重新查找，会话在此期间被删除（退出登录或者过期清理）时查询失败
+    s.lock.lock();
+    slot* sl = find_locked(s, id);
+    bool valid = sl && sl->expire > now;
+    if (valid) {
+        write_begin(*sl);
+        __atomic_store_n(&sl->expire, now + m_ttl, __ATOMIC_RELAXED);
+        write_end(*sl);
+    }
+    s.lock.unlock();
+    return valid;
+}
+
+void session_store::remove(const char* sid) {
+    uint64_t id[2];
+    if (!sid || !parse(sid, id)) return;
+
+    shard& s = get_shard(id);
+    s.lock.lock();
+    slot* sl = find_locked(s, id);
+    if (sl) erase_locked(s, sl - s.slots);
+    s.lock.unlock();
+}
+
+int session_store::expire() {
+    shard& s = m_shards[m_next_expire];
+    m_next_expire = (m_next_expire + 1) % SHARDS;
+    if (!s.slots) return 0;
+
+    int count = 0;
+    time_t now = time(NULL);
+    s.lock.lock();
+    for (uint32_t i = 0; i <= s.mask; ++i) {
+        // 删除后其后的会话可能前移到i，需要再检查一次
+        while (s.slots[i].used && __atomic_load_n(&s.slots[i].expire, __ATOMIC_RELAXED) <= now) {
+            erase_locked(s, i);
+            ++count;
+        }
+    }
+    s.expired += count;
+    s.lock.unlock();
+    return count;
+}
+
+void session_store::get_stats(session_stats* stats) {
+    stats->created = stats->expired = stats->rejected = 0;
+    stats->size = 0;
+
+    for (int i = 0; i < SHARDS; ++i) {
+        shard& s = m_shards[i];
+        s.lock.lock();
+        stats->created += s.created;
+        stats->expired += s.expired;
+        stats->rejected += s.rejected;
+        stats->size += s.size;
+        s.lock.unlock();
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "lock.h"
+
+// 登录会话表：登录成功后生成128位随机的会话ID，通过Cookie发给浏览器，之后的请求凭Cookie识别用户
+// 按会话ID分为SHARDS个分片，每个分片是线性探测的开放寻址哈希表，删除时后移（不留墓碑）；
+// 查询不加锁，每个槽位用序列锁（seqlock）保护，读到正在修改的槽位则重读，没有找到时再加锁确认一次
+// （后移删除期间无锁查询可能错过被移动的会话）；创建、删除、过期清理和顺延有效期加分片的互斥锁
+class session_store {
+public:
+    static const int SHARDS = 16;  // 分片数（2的幂）
+    static const int ID_LEN = 32;  // 会话ID的长度（128位的十六进制）
+    static const int NAME_LEN = 100;  // 用户名缓冲区大小
+    static const int DEFAULT_CAPACITY = 65536;  // 默认最多同时存在的会话数
+    static const int DEFAULT_TTL = 1800;  // 默认的会话有效期（秒），期间有访问则顺延
+
+    // 统计信息
+    struct session_stats {
+        uint64_t created;  // 创建的会话数
+        uint64_t expired;  // 过期清理的会话数
+        uint64_t rejected;  // 会话表满而没有创建的会话数
+        unsigned int size;  // 当前的会话数
+    };
+
+    // 局部静态变量单例模式
+    static session_store* get_instance();
+
+    // 分配会话表，需要在使用前调用
+    bool init(int capacity = DEFAULT_CAPACITY, int ttl = DEFAULT_TTL);
+
+    // 会话有效期（秒），用于Cookie的Max-Age
+    int ttl() {
+        return m_ttl;
+    }
+
+    // 为用户创建会话，会话ID写入sid（至少ID_LEN + 1字节），会话表满时返回false
+    bool create(const char* user, char* sid);
+
+    // 校验会话ID，有效时返回true并将用户名拷贝到user（可以为NULL），同时顺延有效期
+    bool lookup(const char* sid, char* user);
+
+    // 删除会话（退出登录）
+    void remove(const char* sid);
+
+    // 清理一个分片中过期的会话（每次调用轮换到下一个分片），返回清理的个数，由定时器调用
+    int expire();
+
+    // 汇总所有分片的统计信息
+    void get_stats(session_stats* stats);
+
+private:
+    session_store();
+    ~session_store();
+
+    // 一个会话，seq为奇数表示正在被修改
+    struct slot {
+        uint32_t seq;
+        uint32_t used;  // 是否存放了会话
+        uint64_t id[2];  // 会话ID
+        time_t expire;  // 过期时间，查询时在序列锁内读取，顺延时加分片锁
+        char user[NAME_LEN];  // 用户名
+    };
+
+    struct alignas(64) shard {
+        mutex lock;  // 修改槽位时加锁
+        slot* slots;
+        uint32_t mask;  // 槽位数 - 1
+        uint32_t size;  // 当前的会话数
+        uint32_t limit;  // 最多的会话数（槽位数的一半，保证探测序列足够短）
+        uint64_t created;
+        uint64_t expired;
+        uint64_t rejected;
+    };
+
+    // 解析十六进制的会话ID
+    static bool parse(const char* sid, uint64_t* id);
+    // 生成随机的会话ID
+    static bool generate(uint64_t* id);
+
+    shard& get_shard(const uint64_t* id) {
+        return m_shards[id[0] & (SHARDS - 1)];
+    }
+    // 无锁查询，找到时拷贝用户名和过期时间（与会话ID在同一次序列锁读取中读出）并返回槽位
+    slot* find_nolock(shard& s, const uint64_t* id, char* user, time_t* expire);
+    // 加锁后查询
+    slot* find_locked(shard& s, const uint64_t* id);
+    // 删除槽位并将其后的探测序列前移（持有分片锁）
+    void erase_locked(shard& s, uint32_t i);
+    // 带序列号的写入（持有分片锁）
+    static void write_begin(slot& sl) {
+        __atomic_store_n(&sl.seq, sl.seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+    static void write_end(slot& sl) {
+        __atomic_store_n(&sl.seq, sl.seq + 1, __ATOMIC_RELEASE);
+    }
+
+private:
+    shard m_shards[SHARDS];
+    int m_ttl;  // 会话有效期（秒）
+    int m_next_expire;  // 下一次清理的分片
+};
+
+#endif
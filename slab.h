@@ -0,0 +1,76 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+// 对象池（slab）：按块分配对象，每块chunk个，块内每个对象都从缓存行边界开始；对象在所在的块分配时构造，
+// 对象池销毁时析构，分配和归还只是从空闲栈出栈和入栈，对象自己持有的资源（例如缓冲区）在复用时保留。
+// 空闲栈后进先出，下一次分配的是最近归还的对象，它多半还在缓存中；使用的内存随同时存在的对象数增长。
+// 不加锁，只能在一个线程中分配和归还
+template <typename T>
+class slab {
+public:
+    static const size_t ALIGN = 64;  // 缓存行大小
+
+    explicit slab(int chunk = 64) : m_chunk(chunk), m_in_use(0) {}
+
+    ~slab() {
+        for (size_t i = 0; i < m_chunks.size(); ++i) {
+            for (int j = 0; j < m_chunk; ++j) at(m_chunks[i], j)->~T();
+            free(m_chunks[i]);
+        }
+    }
+
+    // 分配一个对象（没有重新初始化），内存不足时返回NULL
+    T* alloc() {
+        if (m_free.empty() && !grow()) return NULL;
+        T* obj = m_free.back();
+        m_free.pop_back();
+        ++m_in_use;
+        return obj;
+    }
+
+    // 归还对象（不析构）
+    void release(T* obj) {
+        m_free.push_back(obj);
+        --m_in_use;
+    }
+
+    int in_use() const {
+        return m_in_use;
+    }
+
+    int capacity() const {
+        return (int)m_chunks.size() * m_chunk;
+    }
+
+private:
+    // 相邻对象的间隔，向上取整到缓存行
+    static size_t stride() {
+        return (sizeof(T) + ALIGN - 1) / ALIGN * ALIGN;
+    }
+
+    static T* at(char* chunk, int i) {
+        return (T*)(chunk + i * stride());
+    }
+
+    bool grow() {
+        void* mem = NULL;
+        if (posix_memalign(&mem, ALIGN, stride() * m_chunk) != 0) return false;
+        char* chunk = (char*)mem;
+        m_chunks.push_back(chunk);
+        // 倒序入栈，先分配块中靠前的对象
+        for (int i = m_chunk - 1; i >= 0; --i) m_free.push_back(new (at(chunk, i)) T());
+        return true;
+    }
+
+private:
+    int m_chunk;  // 每块的对象数
+    int m_in_use;  // 已经分配出去的对象数
+    std::vector<char*> m_chunks;  // 所有的块
+    std::vector<T*> m_free;  // 空闲栈
+};
+
+#endif
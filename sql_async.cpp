@@ -0,0 +1,219 @@
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <mysql/errmsg.h>
+
+#include "sql_async.h"
+#include "log.h"
+
+sql_async::sql_async() {
+    m_epollfd = -1;
+    m_eventfd = -1;
+    m_done = NULL;
+}
+
+sql_async::~sql_async() {
+    if (m_eventfd != -1) close(m_eventfd);
+}
+
+// 单例模式
+sql_async* sql_async::get_instance() {
+    static sql_async instance;
+    return &instance;
+}
+
+void sql_async::init(int epollfd, int max_fd) {
+    m_epollfd = epollfd;
+    m_tasks.assign(max_fd, NULL);
+
+    // 完成通知的eventfd一直注册在epoll中（水平触发）
+    m_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event;
+    event.data.fd = m_eventfd;
+    event.events = EPOLLIN;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_eventfd, &event);
+}
+
+void sql_async::complete(sql_task* task) {
+    m_done_lock.lock();
+    task->next = m_done;
+    m_done = task;
+    m_done_lock.unlock();
+
+    uint64_t one = 1;
+    ssize_t ret = write(m_eventfd, &one, sizeof(one));
+    (void)ret;
+}
+
+// 工作线程提交查询，非阻塞API需要等待socket时立即返回
+bool sql_async::submit(sql_task* task, const char* sql) {
+    task->stmt = NULL;
+    task->result = NULL;
+    task->err = 0;
+    task->sockfd = -1;
+    task->stage = STAGE_QUERY;
+    task->status = mysql_real_query_start(&task->err, task->conn, sql, strlen(sql));
+    return advance(task);
+}
+
+// 预编译语句只发送语句编号和绑定的参数，服务端不需要再解析SQL
+bool sql_async::submit_stmt(sql_task* task) {
+    task->result = NULL;
+    task->err = 0;
+    task->sockfd = -1;
+    task->stage = STAGE_QUERY;
+    task->status = mysql_stmt_execute_start(&task->err, task->stmt);
+    return advance(task);
+}
+
+bool sql_async::is_sql_fd(int fd) {
+    if (fd == m_eventfd) return true;
+    return fd >= 0 && fd < (int)m_tasks.size() && m_tasks[fd] != NULL;
+}
+
+// 主线程推进查询，将epoll事件转换为非阻塞API的就绪事件
+sql_task* sql_async::on_event(int fd, unsigned int events) {
+    // 其他线程完成的操作，一次全部取回
+    if (fd == m_eventfd) {
+        uint64_t count;
+        ssize_t ret = read(m_eventfd, &count, sizeof(count));
+        (void)ret;
+        m_done_lock.lock();
+        sql_task* done = m_done;
+        m_done = NULL;
+        m_done_lock.unlock();
+        return done;
+    }
+
+    sql_task* task = m_tasks[fd];
+    if (!task) return NULL;
+
+    int ready = 0;
+    if (events & EPOLLIN) ready |= MYSQL_WAIT_READ;
+    if (events & EPOLLOUT) ready |= MYSQL_WAIT_WRITE;
+    if (events & EPOLLPRI) ready |= MYSQL_WAIT_EXCEPT;
+    // 出错或者挂断时交给客户端库读写socket，由它返回具体的错误
+    if (events & (EPOLLERR | EPOLLHUP)) ready |= MYSQL_WAIT_READ | MYSQL_WAIT_WRITE;
+
+    resume(task, ready);
+    if (advance(task)) {
+        task->next = NULL;
+        return task;
+    }
+    return NULL;
+}
+
+sql_task* sql_async::expire(time_t now) {
+    // 先取出超时的操作，推进时会修改m_waiting
+    std::vector<sql_task*> expired;
+    m_wait_lock.lock();
+    for (size_t i = 0; i < m_waiting.size(); ++i) {
+        sql_task* task = m_tasks[m_waiting[i]];
+        if (task && task->deadline && task->deadline <= now) expired.push_back(task);
+    }
+    m_wait_lock.unlock();
+
+    sql_task* done = NULL;
+    for (size_t i = 0; i < expired.size(); ++i) {
+        sql_task* task = expired[i];
+        LOG_ERROR("mysql query timed out on socket %d", task->sockfd);
+        resume(task, MYSQL_WAIT_TIMEOUT);
+        if (advance(task)) {
+            task->next = done;
+            done = task;
+        }
+    }
+    return done;
+}
+
+void sql_async::resume(sql_task* task, int ready) {
+    if (task->stmt) {
+        if (task->stage == STAGE_QUERY) task->status = mysql_stmt_execute_cont(&task->err, task->stmt, ready);
+        else task->status = mysql_stmt_store_result_cont(&task->err, task->stmt, ready);
+    } else {
+        if (task->stage == STAGE_QUERY) task->status = mysql_real_query_cont(&task->err, task->conn, ready);
+        else task->status = mysql_store_result_cont(&task->result, task->conn, ready);
+    }
+}
+
+bool sql_async::advance(sql_task* task) {
+    while (true) {
+        // 当前阶段还需要等待socket
+        if (task->status != 0) {
+            if (wait(task)) return false;
+            // 无法注册到epoll，在当前线程中以失败结束
+            fail(task);
+            done(task);
+            return true;
+        }
+
+        // 查询执行成功并且需要结果集，则进入取回结果集阶段
+        if (task->stage == STAGE_QUERY && task->err == 0 && task->store_result) {
+            task->stage = STAGE_STORE;
+            if (task->stmt) task->status = mysql_stmt_store_result_start(&task->err, task->stmt);
+            else task->status = mysql_store_result_start(&task->result, task->conn);
+            continue;
+        }
+
+        done(task);
+        return true;
+    }
+}
+
+bool sql_async::wait(sql_task* task) {
+    int fd = mysql_get_socket(task->conn);
+    if (fd < 0 || fd >= (int)m_tasks.size()) {
+        LOG_ERROR("mysql socket %d exceeds max_fd %d", fd, (int)m_tasks.size());
+        return false;
+    }
+
+    epoll_event event;
+    event.data.fd = fd;
+    event.events = EPOLLONESHOT;  // 每次只推进一次，推进后按照新的等待事件重新注册
+    if (task->status & MYSQL_WAIT_READ) event.events |= EPOLLIN;
+    if (task->status & MYSQL_WAIT_WRITE) event.events |= EPOLLOUT;
+    if (task->status & MYSQL_WAIT_EXCEPT) event.events |= EPOLLPRI;
+
+    // 客户端库按连接设置的读写超时给出等待时间，超时由主线程定期检查（expire）
+    task->deadline = 0;
+    if (task->status & MYSQL_WAIT_TIMEOUT) task->deadline = time(NULL) + mysql_get_timeout_value(task->conn);
+
+    // 必须在注册epoll之前写入映射，注册之后主线程随时可能收到事件
+    m_tasks[fd] = task;
+    if (task->sockfd == -1) {
+        task->sockfd = fd;
+        m_wait_lock.lock();
+        m_waiting.push_back(fd);
+        m_wait_lock.unlock();
+        epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &event);
+    } else epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &event);
+    return true;
+}
+
+void sql_async::fail(sql_task* task) {
+    // 关闭读写后客户端库的读写都立即失败，当前阶段很快结束，连接的错误码为连接断开
+    shutdown(mysql_get_socket(task->conn), SHUT_RDWR);
+    while (task->status != 0) resume(task, MYSQL_WAIT_READ | MYSQL_WAIT_WRITE);
+    if (task->err == 0) task->err = CR_SERVER_LOST;
+}
+
+void sql_async::done(sql_task* task) {
+    if (task->sockfd == -1) return;
+
+    // 连接会归还给连接池并可能被同步使用，所以从epoll中删除
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, task->sockfd, 0);
+    m_wait_lock.lock();
+    for (size_t i = 0; i < m_waiting.size(); ++i) {
+        if (m_waiting[i] == task->sockfd) {
+            m_waiting[i] = m_waiting.back();
+            m_waiting.pop_back();
+            break;
+        }
+    }
+    m_wait_lock.unlock();
+    m_tasks[task->sockfd] = NULL;  // wait只注册范围内的socket
+    task->sockfd = -1;
+}
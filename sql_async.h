@@ -0,0 +1,84 @@
+#ifndef SQL_ASYNC_H
+#define SQL_ASYNC_H
+
+#include <mysql/mysql.h>
+#include <sys/epoll.h>
+#include <vector>
+
+#include "lock.h"
+
+// 一次异步数据库操作的上下文，由发起操作的对象（如http_conn）持有，操作完成前不能释放
+struct sql_task {
+    MYSQL* conn;  // 执行查询的数据库连接（查询完成前由该操作独占）
+    MYSQL_STMT* stmt;  // 执行的预编译语句，由submit_stmt提交，参数和结果需要提前绑定
+    void* arg;  // 发起者，查询完成后由主线程取回
+    bool store_result;  // 是否需要取回结果集（SELECT需要，INSERT不需要）
+    MYSQL_RES* result;  // 文本查询取回的结果集，由发起者调用mysql_free_result释放（预编译语句的结果缓存在stmt中，用mysql_stmt_fetch读取）
+    int err;  // 查询返回值，0表示成功
+    int status;  // 非阻塞API返回的等待事件（MYSQL_WAIT_READ等），0表示当前阶段已完成
+    int stage;  // 当前所处阶段（发送查询或取回结果集）
+    int sockfd;  // 已注册到epoll中的数据库socket，-1表示未注册
+    time_t deadline;  // 客户端库要求超时处理时，当前等待的截止时间，0表示不超时
+    sql_task* next;  // 主线程一次取回多个完成的操作时串成链表
+};
+
+// 基于MariaDB非阻塞客户端API（mysql_real_query_start/cont）的异步查询
+// 工作线程提交查询后立即返回，数据库socket注册到服务器的epoll中，由主线程在socket就绪时推进查询，
+// 查询完成后主线程取回发起者并将其重新放入请求队列，这样少量线程就可以同时挂起大量数据库操作
+class sql_async {
+public:
+    // 局部静态变量单例模式
+    static sql_async* get_instance();
+
+    // 设置数据库socket注册到的epoll，max_fd为文件描述符的上限（数据库socket和客户端连接共用文件描述符）
+    void init(int epollfd, int max_fd);
+
+    // 提交查询（sql在查询完成前必须保持有效），返回true表示查询已经在当前线程完成，false表示查询挂起，等待主线程推进
+    bool submit(sql_task* task, const char* sql);
+
+    // 执行预编译语句（绑定的参数和结果缓冲区在执行完成前必须保持有效），返回值同submit
+    bool submit_stmt(sql_task* task);
+
+    // 其他线程（如批量写入线程）完成了操作，通过eventfd通知主线程取回，可以在任意线程调用
+    void complete(sql_task* task);
+
+    // 判断fd是否是挂起查询的数据库socket或者完成通知的eventfd
+    bool is_sql_fd(int fd);
+
+    // 主线程在fd就绪时调用，推进对应的查询，返回已经完成的操作（通过next串成链表），没有完成的操作返回NULL
+    sql_task* on_event(int fd, unsigned int events);
+
+    // 主线程定期调用，等待超过截止时间的查询通知客户端库超时（查询以失败结束），返回已经完成的操作，同on_event
+    sql_task* expire(time_t now);
+
+private:
+    sql_async();
+    ~sql_async();
+
+    // 推进查询的阶段，返回true表示全部完成
+    bool advance(sql_task* task);
+    // 以就绪事件ready（MYSQL_WAIT_READ等）继续当前阶段
+    void resume(sql_task* task, int ready);
+    // 按照非阻塞API返回的等待事件注册数据库socket，socket超出映射表的范围时返回false
+    bool wait(sql_task* task);
+    // 无法等待的操作：关闭socket的读写，让客户端库以连接断开结束当前阶段（连接归还时被连接池关闭）
+    void fail(sql_task* task);
+    // 查询完成，从epoll中删除数据库socket
+    void done(sql_task* task);
+
+private:
+    enum STAGE {
+        STAGE_QUERY = 0,  // 发送查询并等待执行结果
+        STAGE_STORE  // 取回结果集
+    };
+
+    int m_epollfd;  // 服务器的epoll
+    int m_eventfd;  // 其他线程完成操作后通知主线程
+    mutex m_done_lock;  // 保护m_done
+    sql_task* m_done;  // 其他线程完成、等待主线程取回的操作
+    mutex m_wait_lock;  // 保护m_waiting
+    std::vector<int> m_waiting;  // 已注册到epoll的数据库socket（不超过连接池的连接数），用于检查超时
+    std::vector<sql_task*> m_tasks;  // 数据库socket到挂起查询的映射（按max_fd分配），由提交查询的工作线程在注册epoll之前写入
+};
+
+#endif
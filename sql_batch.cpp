@@ -0,0 +1,290 @@
+#include <string.h>
+#include <string>
+#include <set>
+#include <mysql/errmsg.h>  // 提供CR_UNKNOWN_ERROR
+#include <mysql/mysqld_error.h>  // 提供ER_DUP_ENTRY
+
+#include "sql_batch.h"
+#include "log.h"
+
+sql_batch::sql_batch() {
+    m_connPool = NULL;
+    m_max_batch = 1;
+    m_max_delay = 0;
+    m_started = false;
+    m_stop = false;
+    m_conn = NULL;
+    m_stmt_err = 0;
+}
+
+sql_batch::~sql_batch() {
+    stop();
+}
+
+// 单例模式
+sql_batch* sql_batch::get_instance() {
+    static sql_batch instance;
+    return &instance;
+}
+
+bool sql_batch::init(connection_pool* connPool, int max_batch, int max_delay) {
+    if (max_batch < 1) return false;
+
+    m_connPool = connPool;
+    m_max_batch = max_batch > MAX_BATCH ? MAX_BATCH : max_batch;
+    m_max_delay = max_delay < 0 ? 0 : max_delay;
+    m_stop = false;
+
+    if (pthread_create(&m_tid, NULL, worker, this) != 0) {
+        LOG_ERROR("%s", "create sql batch thread error");
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void sql_batch::submit(sql_task* task, const char* name, const char* passwd, bool check) {
+    item it = {task, name, passwd, check};
+
+    m_lock.lock();
+    // 这一批的第一条注册，计算最晚的发送时间（条件变量使用CLOCK_REALTIME）
+    if (m_pending.empty()) {
+        clock_gettime(CLOCK_REALTIME, &m_deadline);
+        m_deadline.tv_nsec += (long)m_max_delay * 1000000;
+        m_deadline.tv_sec += m_deadline.tv_nsec / 1000000000;
+        m_deadline.tv_nsec %= 1000000000;
+    }
+    m_pending.push_back(it);
+
+    // 第一条到达（开始计时）或者凑满一批时唤醒批量写入线程
+    if (m_pending.size() == 1 || (int)m_pending.size() >= m_max_batch) m_cond.signal();
+    m_lock.unlock();
+}
+
+void sql_batch::stop() {
+    m_lock.lock();
+    m_stop = true;
+    m_cond.signal();
+    m_lock.unlock();
+
+    if (m_started) {
+        pthread_join(m_tid, NULL);
+        m_started = false;
+    }
+    release_conn();
+}
+
+void* sql_batch::worker(void* arg) {
+    sql_batch* batch = (sql_batch*) arg;
+    batch->run();
+    return batch;
+}
+
+void sql_batch::run() {
+    vector<item> batch;
+
+    m_lock.lock();
+    while (true) {
+        if (m_pending.empty()) {
+            if (m_stop) break;
+            m_cond.wait(m_lock.get());
+            continue;
+        }
+
+        // 没有凑满一批则等到最晚的发送时间，期间被唤醒就重新判断
+        if ((int)m_pending.size() < m_max_batch && !m_stop) {
+            if (m_cond.timedwait(m_lock.get(), m_deadline)) continue;
+        }
+
+        // 取出一批，剩余的注册已经等待过，下一批立即发送
+        while (!m_pending.empty() && (int)batch.size() < m_max_batch) {
+            batch.push_back(m_pending.front());
+            m_pending.pop_front();
+        }
+        if (!m_pending.empty()) clock_gettime(CLOCK_REALTIME, &m_deadline);
+        m_lock.unlock();
+
+        execute(batch);
+        batch.clear();
+
+        m_lock.lock();
+    }
+    m_lock.unlock();
+}
+
+void sql_batch::execute(vector<item>& batch) {
+    int n = batch.size();
+    vector<int> result(n, 0);
+
+    // 同一批中重复的用户名只有第一条需要写入，其余的直接返回用户名已存在
+    vector<int> fresh;
+    set<string> names;
+    for (int i = 0; i < n; ++i) {
+        if (names.insert(batch[i].name).second) fresh.push_back(i);
+        else result[i] = ER_DUP_ENTRY;
+    }
+
+    // 批量写入线程持有一条连接，并在其上开启事务
+    if (!m_conn) {
+        m_conn = m_connPool->GetConnection();
+        if (m_conn) mysql_autocommit(m_conn, 0);
+    }
+
+    int err = 0;
+    if (!m_conn) err = BATCH_UNAVAILABLE;
+
+    // 1.查询这一批中已经存在的用户名，调用者确定不存在的用户名不参与查询，全部不需要查询时跳过这一步。
+    // 查询之后仍然可能重名（布隆过滤器之外写入的用户名、其他进程在查询之后写入），由下面的插入逐行重试处理
+    set<string> exists;
+    vector<int> checks;
+    for (size_t i = 0; i < fresh.size(); ++i) {
+        if (batch[fresh[i]].check) checks.push_back(fresh[i]);
+    }
+    if (!err && !checks.empty()) {
+        int m = checks.size();
+        MYSQL_STMT* stmt = statement(false, m);
+        vector<MYSQL_BIND> params(m);
+        vector<unsigned long> lens(m);
+        memset(&params[0], 0, sizeof(MYSQL_BIND) * m);
+        for (int i = 0; i < m; ++i) {
+            const char* name = batch[checks[i]].name;
+            lens[i] = strlen(name);
+            params[i].buffer_type = MYSQL_TYPE_STRING;
+            params[i].buffer = (void*)name;
+            params[i].buffer_length = lens[i];
+            params[i].length = &lens[i];
+        }
+
+        char found[100];
+        unsigned long found_len = 0;
+        MYSQL_BIND res;
+        memset(&res, 0, sizeof(res));
+        res.buffer_type = MYSQL_TYPE_STRING;
+        res.buffer = found;
+        res.buffer_length = sizeof(found);
+        res.length = &found_len;
+
+        if (!stmt || mysql_stmt_bind_param(stmt, &params[0]) || mysql_stmt_bind_result(stmt, &res)
+            || mysql_stmt_execute(stmt) || mysql_stmt_store_result(stmt)) {
+            err = stmt ? mysql_stmt_errno(stmt) : m_stmt_err;
+            if (stmt) LOG_ERROR("batch SELECT error:%s", mysql_stmt_error(stmt));
+        } else {
+            while (mysql_stmt_fetch(stmt) == 0) exists.insert(string(found, found_len));
+        }
+        if (stmt) mysql_stmt_free_result(stmt);
+    }
+
+    // 2.将其余的用户用一条多行INSERT写入
+    vector<int> inserts;
+    for (size_t i = 0; i < fresh.size(); ++i) {
+        if (exists.count(batch[fresh[i]].name)) result[fresh[i]] = ER_DUP_ENTRY;
+        else inserts.push_back(fresh[i]);
+    }
+    if (!err && !inserts.empty()) {
+        err = insert(batch, &inserts[0], inserts.size());
+        // 有一行重名时整条INSERT失败：回滚后逐行插入，重名的注册各自失败，其余的照常写入
+        if (err == ER_DUP_ENTRY) {
+            mysql_rollback(m_conn);
+            err = 0;
+            for (size_t i = 0; i < inserts.size() && !err; ++i) {
+                int ret = insert(batch, &inserts[i], 1);
+                if (ret == ER_DUP_ENTRY) result[inserts[i]] = ER_DUP_ENTRY;
+                else err = ret;
+            }
+        }
+    }
+
+    // 3.提交事务，一批注册只需要一次提交
+    if (!err && mysql_commit(m_conn)) {
+        err = mysql_errno(m_conn);
+        LOG_ERROR("batch COMMIT error:%s", mysql_error(m_conn));
+    }
+
+    // 出错则回滚，这一批中需要写入的注册全部失败，并归还连接（连接断开时由连接池关闭）
+    if (err) {
+        if (m_conn) {
+            mysql_rollback(m_conn);
+            release_conn();
+        }
+        for (size_t i = 0; i < inserts.size(); ++i) result[inserts[i]] = err;
+        if (err == BATCH_UNAVAILABLE) {
+            for (size_t i = 0; i < fresh.size(); ++i) result[fresh[i]] = err;
+        }
+    }
+
+    // 每个请求得到各自的结果，交还主线程重新放入请求队列
+    for (int i = 0; i < n; ++i) {
+        batch[i].task->err = result[i];
+        sql_async::get_instance()->complete(batch[i].task);
+    }
+}
+
+int sql_batch::insert(vector<item>& batch, const int* rows, int k) {
+    MYSQL_STMT* stmt = statement(true, k);
+    vector<MYSQL_BIND> params(2 * k);
+    vector<unsigned long> lens(2 * k);
+    memset(&params[0], 0, sizeof(MYSQL_BIND) * 2 * k);
+    for (int i = 0; i < k; ++i) {
+        const char* fields[2] = {batch[rows[i]].name, batch[rows[i]].passwd};
+        for (int j = 0; j < 2; ++j) {
+            int p = 2 * i + j;
+            lens[p] = strlen(fields[j]);
+            params[p].buffer_type = MYSQL_TYPE_STRING;
+            params[p].buffer = (void*)fields[j];
+            params[p].buffer_length = lens[p];
+            params[p].length = &lens[p];
+        }
+    }
+
+    if (!stmt || mysql_stmt_bind_param(stmt, &params[0]) || mysql_stmt_execute(stmt)) {
+        int err = stmt ? mysql_stmt_errno(stmt) : m_stmt_err;
+        if (stmt && err != ER_DUP_ENTRY) LOG_ERROR("batch INSERT error:%s", mysql_stmt_error(stmt));
+        return err;
+    }
+    return 0;
+}
+
+MYSQL_STMT* sql_batch::statement(bool insert, int n) {
+    map<int, MYSQL_STMT*>& stmts = insert ? m_insert_stmts : m_select_stmts;
+    map<int, MYSQL_STMT*>::iterator it = stmts.find(n);
+    if (it != stmts.end()) return it->second;
+
+    // 只拼接占位符，用户数据全部通过参数绑定
+    string sql = insert ? "INSERT INTO user(username, passwd) VALUES" : "SELECT username FROM user WHERE username IN (";
+    for (int i = 0; i < n; ++i) {
+        if (insert) sql += i ? ", (?, ?)" : "(?, ?)";
+        else sql += i ? ", ?" : "?";
+    }
+    if (!insert) sql += ")";
+
+    // 失败时在关闭语句之前记下错误码，客户端库没有给出错误码时也不能是0，否则调用者会当作成功提交
+    MYSQL_STMT* stmt = mysql_stmt_init(m_conn);
+    if (stmt == NULL) {
+        m_stmt_err = mysql_errno(m_conn) ? mysql_errno(m_conn) : CR_UNKNOWN_ERROR;
+        LOG_ERROR("mysql_stmt_init error:%s", mysql_error(m_conn));
+        return NULL;
+    }
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) != 0) {
+        m_stmt_err = mysql_stmt_errno(stmt) ? mysql_stmt_errno(stmt) : CR_UNKNOWN_ERROR;
+        LOG_ERROR("mysql_stmt_prepare error:%s", mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+    stmts[n] = stmt;
+    return stmt;
+}
+
+void sql_batch::release_conn() {
+    if (!m_conn) return;
+
+    map<int, MYSQL_STMT*>::iterator it;
+    for (it = m_select_stmts.begin(); it != m_select_stmts.end(); ++it) mysql_stmt_close(it->second);
+    for (it = m_insert_stmts.begin(); it != m_insert_stmts.end(); ++it) mysql_stmt_close(it->second);
+    m_select_stmts.clear();
+    m_insert_stmts.clear();
+
+    // 恢复自动提交后再归还，连接池中的其他使用者依赖自动提交
+    mysql_autocommit(m_conn, 1);
+    m_connPool->ReleaseConnection(m_conn);
+    m_conn = NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef SQL_BATCH_H
+#define SQL_BATCH_H
+
+#include <list>
+#include <map>
+#include <vector>
+#include <time.h>
+#include <mysql/mysql.h>
+
+#include "lock.h"
+#include "sql_connection_pool.h"
+#include "sql_async.h"
+
+using namespace std;
+
+// 注册的批量写入（group commit）
+// 注册请求不再各自占用一条连接执行单行INSERT，而是交给批量写入线程，凑满max_batch条或者第一条等待超过max_delay毫秒后，
+// 在一个事务中用一条多行INSERT写入，每个请求各自得到成功或者用户名已存在的结果，完成后通过sql_async交还主线程
+class sql_batch {
+public:
+    static const int BATCH_UNAVAILABLE = -1;  // 没有获得数据库连接
+    static const int MAX_BATCH = 256;  // 每批的最大条数上限
+
+    // 局部静态变量单例模式
+    static sql_batch* get_instance();
+
+    // 启动批量写入线程（max_batch小于1表示不启用，注册仍然由工作线程逐条写入）
+    bool init(connection_pool* connPool, int max_batch = 32, int max_delay = 2);
+
+    // 是否启用了批量写入
+    bool enabled() {
+        return m_started;
+    }
+
+    // 提交一条注册（name和passwd在完成前必须保持有效），check为false表示调用者已经确定用户名不存在，不需要查询，
+    // 完成后task->err为0（成功）、ER_DUP_ENTRY（用户名已存在）、BATCH_UNAVAILABLE或者其他错误码
+    void submit(sql_task* task, const char* name, const char* passwd, bool check = true);
+
+    // 结束批量写入线程，已经提交的注册会先写完
+    void stop();
+
+private:
+    sql_batch();
+    ~sql_batch();
+
+    // 一条待写入的注册
+    struct item {
+        sql_task* task;
+        const char* name;
+        const char* passwd;
+        bool check;  // 是否需要查询用户名是否已经存在
+    };
+
+    static void* worker(void* arg);
+    void run();
+    // 在一个事务中写入一批注册，并完成其中的每个请求
+    void execute(vector<item>& batch);
+    // 用一条k行的INSERT写入batch中下标为rows[0..k)的注册，返回错误码（0表示成功，ER_DUP_ENTRY表示其中有重名）
+    int insert(vector<item>& batch, const int* rows, int k);
+    // 获取n个用户名的查询语句或者n行的插入语句（按行数缓存在批量写入线程持有的连接上）
+    MYSQL_STMT* statement(bool insert, int n);
+    // 关闭缓存的语句并归还连接
+    void release_conn();
+
+private:
+    connection_pool* m_connPool;  // 数据库连接池
+    int m_max_batch;  // 每批最多条数
+    int m_max_delay;  // 第一条到达后最多等待的时间（毫秒）
+
+    mutex m_lock;  // 保护m_pending
+    cond m_cond;  // 有新的注册时唤醒批量写入线程
+    list<item> m_pending;  // 等待写入的注册
+    struct timespec m_deadline;  // 当前这批最晚的发送时间
+
+    pthread_t m_tid;  // 批量写入线程
+    bool m_started;  // 批量写入线程是否已经启动
+    bool m_stop;  // 是否结束批量写入线程
+
+    // 以下只由批量写入线程访问
+    MYSQL* m_conn;  // 批量写入线程持有的连接（出错时归还并重新获取）
+    map<int, MYSQL_STMT*> m_select_stmts;  // 按用户名个数缓存的查询语句
+    map<int, MYSQL_STMT*> m_insert_stmts;  // 按行数缓存的插入语句
+    int m_stmt_err;  // statement()返回NULL时的错误码
+};
+
+#endif
@@ -1,11 +1,36 @@
-#include <iostream>
+#include <string.h>
+#include <mysql/errmsg.h>  // 提供CR_SERVER_GONE_ERROR等客户端错误码
 
 #include "sql_connection_pool.h"
+#include "log.h"
+
+// 单调时钟（微秒），用于统计等待时间和持有时间
+static long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 预编译语句的SQL，下标对应SQL_STMT
+static const char* stmt_sql[STMT_COUNT] = {
+    "SELECT passwd FROM user WHERE username = ?",
+    "INSERT INTO user(username, passwd) VALUES(?, ?)"
+};
 
 // 构造函数
 connection_pool::connection_pool() {
+    this->MaxConn = 0;
+    this->MinConn = 0;
+    this->SpareConn = 0;
     this->CurConn = 0;
     this->FreeConn = 0;
+    this->m_connecting = 0;
+    this->m_starting = 0;
+    this->m_started = false;
+    this->m_stop = false;
+    this->m_backoff = 0;
+    this->m_next_connect = 0;
+    this->m_timeouts = 0;
 }
 
 // 析构函数
@@ -20,54 +45,225 @@ connection_pool* connection_pool::GetInstance() {
 }
 
 // 初始化连接池
-void connection_pool::init(string url, string User, string PassWord, string DatabaseName, int Port, unsigned int MaxConn) {
+void connection_pool::init(string url, string User, string PassWord, string DatabaseName, int Port, unsigned int MaxConn,
+                           unsigned int MinConn, unsigned int SpareConn) {
     // 初始化数据信息
     this->url = url;
     this->Port = Port;
     this->User = User;
     this->PassWord = PassWord;
     this->DatabaseName = DatabaseName;
+    this->MaxConn = MaxConn;
+    this->MinConn = MinConn > MaxConn ? MaxConn : MinConn;
+    this->SpareConn = SpareConn;
+
+    m_stop = false;
 
+    // 启动时每条连接用一个临时线程并行建立（TCP握手、认证和预编译语句的往返不再串行累加），init立即返回；
+    // 正在建立的连接计入total()，期间获取连接的线程排队等待，连接失败的由维护线程退避重连
     lock.lock();
-    // 创建MaxConn条数据库连接
-    for (int i = 0; i < MaxConn; i++) {
-        
-        // 分配或者初始化一个MYSQL对象，用于连接mysql服务端
-        MYSQL* con = NULL;
-        con = mysql_init(con);  
-        if (con == NULL) {
-            cout << "Error:" << mysql_error(con);
-            exit(-1);
+    for (unsigned int i = 0; i < this->MinConn; i++) {
+        pthread_t tid;
+        ++m_connecting;
+        ++m_starting;
+        if (pthread_create(&tid, NULL, connect_thread, this) != 0) {
+            --m_connecting;
+            --m_starting;
+            LOG_ERROR("%s", "create connect thread error");
+            break;
         }
+        pthread_detach(tid);
+    }
+    lock.unlock();
+
+    // 创建维护线程，负责健康检查、重连和预热连接
+    if (pthread_create(&m_tid, NULL, maintain_thread, this) != 0) {
+        LOG_ERROR("%s", "create connection pool maintain thread error");
+        return;
+    }
+    m_started = true;
+}
+
+void* connection_pool::connect_thread(void* arg) {
+    connection_pool* pool = (connection_pool*)arg;
+    MYSQL* con = pool->connect();
+
+    pool->lock.lock();
+    pool->connected(con);
+    if (--pool->m_starting == 0) pool->m_startup.broadcast();
+    pool->lock.unlock();
+    return NULL;
+}
+
+unsigned int connection_pool::WaitStartup() {
+    lock.lock();
+    while (m_starting > 0) m_startup.wait(lock.get());
+    unsigned int n = CurConn + FreeConn;
+    lock.unlock();
+    return n;
+}
 
-        // 连接MYSQL数据库
-        con = mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DatabaseName.c_str(), Port, NULL, 0);
-        if (con == NULL) {
-            cout << "Error:" << mysql_error(con);
+void connection_pool::connected(MYSQL* con) {
+    --m_connecting;
+    if (con) {
+        idle_conn idle = {con, time(NULL), time(NULL)};
+        put_idle(idle, true);
+        m_backoff = 0;
+        m_next_connect = 0;
+    } else {
+        // 连接失败则指数退避，避免数据库重启期间反复握手；并行建立的连接同时失败只退避一次
+        if (time(NULL) >= m_next_connect) {
+            m_backoff = m_backoff == 0 ? 1 : m_backoff * 2;
+            if (m_backoff > MAX_BACKOFF) m_backoff = MAX_BACKOFF;
+            m_next_connect = time(NULL) + m_backoff;
         }
-        connList.push_back(con);
-        ++FreeConn;
+        // 唤醒等待的线程，重新判断数据库是否可用
+        wake_waiters();
+    }
+}
+
+// 建立一条新的数据库连接
+MYSQL* connection_pool::connect() {
+    // 分配或者初始化一个MYSQL对象，用于连接mysql服务端
+    MYSQL* con = mysql_init(NULL);
+    if (con == NULL) {
+        LOG_ERROR("%s", "mysql_init error");
+        return NULL;
+    }
+
+    // 开启非阻塞客户端API（mysql_real_query_start/cont），阻塞API仍然可以正常使用
+    mysql_options(con, MYSQL_OPT_NONBLOCK, 0);
+    // 读写超时：阻塞API由客户端库计时，非阻塞API返回MYSQL_WAIT_TIMEOUT，由sql_async计时
+    unsigned int timeout = QUERY_TIMEOUT;
+    mysql_options(con, MYSQL_OPT_READ_TIMEOUT, &timeout);
+    mysql_options(con, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+
+    // 连接MYSQL数据库，失败则关闭句柄，不能放入连接池
+    if (mysql_real_connect(con, url.c_str(), User.c_str(), PassWord.c_str(), DatabaseName.c_str(), Port, NULL, 0) == NULL) {
+        LOG_ERROR("mysql connect error:%s", mysql_error(con));
+        mysql_close(con);
+        return NULL;
+    }
+
+    // 建立连接时预编译所有语句，请求处理时不再需要服务端解析SQL（失败的语句在第一次使用时重试）
+    stmt_cache cache;
+    for (int i = 0; i < STMT_COUNT; ++i) cache.stmt[i] = prepare(con, (SQL_STMT)i);
+    lock.lock();
+    m_stmts[con] = cache;
+    lock.unlock();
+
+    return con;
+}
+
+MYSQL_STMT* connection_pool::prepare(MYSQL* con, SQL_STMT id) {
+    MYSQL_STMT* stmt = mysql_stmt_init(con);
+    if (stmt == NULL) return NULL;
+    if (mysql_stmt_prepare(stmt, stmt_sql[id], strlen(stmt_sql[id])) != 0) {
+        LOG_ERROR("mysql_stmt_prepare error:%s", mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return NULL;
+    }
+    return stmt;
+}
+
+MYSQL_STMT* connection_pool::GetStatement(MYSQL* con, SQL_STMT id) {
+    MYSQL_STMT* stmt = NULL;
+    lock.lock();
+    map<MYSQL*, stmt_cache>::iterator it = m_stmts.find(con);
+    if (it != m_stmts.end()) stmt = it->second.stmt[id];
+    lock.unlock();
+    if (stmt) return stmt;
+
+    // 建立连接时预编译失败，调用者独占该连接，可以在锁外重新预编译
+    stmt = prepare(con, id);
+    if (stmt == NULL) return NULL;
+    lock.lock();
+    it = m_stmts.find(con);
+    if (it == m_stmts.end()) {
+        stmt_cache cache;
+        memset(&cache, 0, sizeof(cache));
+        it = m_stmts.insert(make_pair(con, cache)).first;
+    }
+    it->second.stmt[id] = stmt;
+    lock.unlock();
+    return stmt;
+}
+
+void connection_pool::close_conn(MYSQL* con) {
+    lock.lock();
+    map<MYSQL*, stmt_cache>::iterator it = m_stmts.find(con);
+    stmt_cache cache;
+    bool found = (it != m_stmts.end());
+    if (found) {
+        cache = it->second;
+        m_stmts.erase(it);
     }
-    reserve = sem(FreeConn);
-    this->MaxConn = FreeConn;
     lock.unlock();
+
+    // 先关闭预编译语句再关闭连接
+    if (found) {
+        for (int i = 0; i < STMT_COUNT; ++i) {
+            if (cache.stmt[i]) mysql_stmt_close(cache.stmt[i]);
+        }
+    }
+    mysql_close(con);
 }
 
 // 当有请求时，从数据库连接池中返回一个可用连接
-MYSQL* connection_pool::GetConnection() {
+MYSQL* connection_pool::GetConnection(int timeout) {
+    long long start = now_us();
     MYSQL* con = NULL;
-    if (0 == connList.size()) return NULL;
-
-    // 取出连接，信号量减1，若信号量为0则等待
-    reserve.wait();
 
     lock.lock();
-    con = connList.front();  // 从链表头端取出一个连接
-    connList.pop_front();
-    --FreeConn;
-    ++CurConn;
+    if (!connList.empty() && m_waiters.empty()) {
+        // 有空闲连接并且没有更早的等待者，直接从链表头端取出最近使用过的连接
+        con = connList.front().conn;
+        connList.pop_front();
+        --FreeConn;
+        ++CurConn;
+    } else {
+        // 加入等待队列，由归还连接或者新建连接的线程按先来先服务的顺序直接交给等待者
+        waiter w;
+        w.conn = NULL;
+        m_waiters.push_back(&w);
+        // 唤醒维护线程立即补充连接
+        m_maintain.signal();
+
+        // 计算等待的截止时间（条件变量使用CLOCK_REALTIME）
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        if (timeout > 0) {
+            deadline.tv_sec += timeout / 1000;
+            deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+        }
+
+        while (!w.conn) {
+            // 连接池已经销毁，或者数据库不可用（没有任何连接并且正在退避重连），放弃等待
+            if (m_stop || (total() == 0 && m_backoff > 0)) break;
+            if (timeout < 0) w.m_cond.wait(lock.get());
+            else if (!w.m_cond.timedwait(lock.get(), deadline)) break;  // 等待超时
+        }
+
+        if (!w.conn) {
+            // 超时之前没有获得连接，从等待队列中删除，由调用者快速失败（返回503）
+            m_waiters.remove(&w);
+            ++m_timeouts;
+            m_wait_hist.record(now_us() - start);
+            lock.unlock();
+            return NULL;
+        }
+        con = w.conn;
+    }
+    on_acquire(con, now_us() - start);
+
+    // 预热的空闲连接不足时通知维护线程补充
+    if (FreeConn < SpareConn && total() < MaxConn) m_maintain.signal();
     lock.unlock();
-    
+
     return con;
 }
 
@@ -75,35 +271,91 @@ MYSQL* connection_pool::GetConnection() {
 bool connection_pool::ReleaseConnection(MYSQL* con) {
     if (NULL == con) return false;
 
+    // 连接已经断开（例如数据库重启），直接关闭而不是放回连接池
+    unsigned int err = mysql_errno(con);
+    bool broken = (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST);
+
     lock.lock();
-    connList.push_back(con);
-    ++FreeConn;
     --CurConn;
+    // 统计连接的持有时间
+    map<MYSQL*, long long>::iterator it = m_acquire_time.find(con);
+    if (it != m_acquire_time.end()) {
+        m_hold_hist.record(now_us() - it->second);
+        m_acquire_time.erase(it);
+    }
+
+    if (broken || m_stop) {
+        lock.unlock();
+        if (broken) LOG_ERROR("evict broken mysql connection:%s", mysql_error(con));
+        close_conn(con);
+
+        // 由维护线程补充新的连接
+        lock.lock();
+        m_maintain.signal();
+        lock.unlock();
+        return true;
+    }
+
+    // 放回链表头端，使空闲连接按使用时间排序，链表尾端是最久未使用的连接
+    idle_conn idle = {con, time(NULL), time(NULL)};
+    put_idle(idle, true);
     lock.unlock();
 
-    reserve.post();  // 信号量加1
     return true;
 }
 
+void connection_pool::put_idle(const idle_conn& idle, bool front) {
+    // 有等待者则直接交给队首的等待者，避免后来的线程抢先取走连接
+    if (!m_waiters.empty()) {
+        waiter* w = m_waiters.front();
+        m_waiters.pop_front();
+        w->conn = idle.conn;
+        ++CurConn;
+        w->m_cond.signal();
+        return;
+    }
+
+    if (front) connList.push_front(idle);
+    else connList.push_back(idle);
+    ++FreeConn;
+}
+
+void connection_pool::on_acquire(MYSQL* con, long long wait_us) {
+    m_acquire_time[con] = now_us();
+    m_wait_hist.record(wait_us);
+    m_inuse_hist.record(CurConn);
+}
+
+void connection_pool::wake_waiters() {
+    list<waiter*>::iterator it;
+    for (it = m_waiters.begin(); it != m_waiters.end(); ++it) (*it)->m_cond.signal();
+}
+
 // 销毁连接池
 void connection_pool::DestroyPool() {
+    // 通知维护线程退出并唤醒所有等待连接的线程
     lock.lock();
-    if (connList.size() > 0) {
-        // 利用迭代器关闭数据库连接
-        list<MYSQL*>::iterator it;
-        for (it = connList.begin(); it != connList.end(); ++it) {
-            MYSQL* con = *it;
-            mysql_close(con);
-        }
-        CurConn = 0;
-        FreeConn = 0;
-
-        // 清空链表
-        connList.clear();
+    m_stop = true;
+    m_maintain.signal();
+    wake_waiters();
+    lock.unlock();
 
-        lock.unlock();
+    if (m_started) {
+        pthread_join(m_tid, NULL);
+        m_started = false;
     }
+
+    // 等待启动时的连接线程结束，取出并清空链表
+    lock.lock();
+    while (m_starting > 0) m_startup.wait(lock.get());
+    list<idle_conn> closing;
+    closing.swap(connList);
+    FreeConn = 0;
     lock.unlock();
+
+    // 利用迭代器关闭数据库连接
+    list<idle_conn>::iterator it;
+    for (it = closing.begin(); it != closing.end(); ++it) close_conn(it->conn);
 }
 
 // 获取当前的空闲连接数
@@ -111,6 +363,133 @@ int connection_pool::GetFreeConn() {
     return this->FreeConn;
 }
 
+void connection_pool::GetStats(pool_stats* stats) {
+    lock.lock();
+    stats->max_conn = MaxConn;
+    stats->cur_conn = CurConn;
+    stats->free_conn = FreeConn;
+    stats->waiting = m_waiters.size();
+    stats->timeouts = m_timeouts;
+    stats->wait_us = m_wait_hist;
+    stats->hold_us = m_hold_hist;
+    stats->in_use = m_inuse_hist;
+    lock.unlock();
+}
+
+void* connection_pool::maintain_thread(void* arg) {
+    connection_pool* pool = (connection_pool*) arg;
+    pool->maintain();
+    return pool;
+}
+
+// 维护线程每隔CHECK_INTERVAL检查一次，连接不足时会被GetConnection和ReleaseConnection提前唤醒
+void connection_pool::maintain() {
+    lock.lock();
+    while (!m_stop) {
+        time_t cur = time(NULL);
+        bool need_grow = total() < MaxConn && (total() < MinConn || FreeConn < SpareConn);
+
+        // 不需要补充连接或者处于退避期间，则等待到下一次检查（或者退避结束）
+        if (!need_grow || cur < m_next_connect) {
+            struct timespec t;
+            t.tv_sec = cur + CHECK_INTERVAL;
+            t.tv_nsec = 0;
+            if (need_grow && m_next_connect < t.tv_sec) t.tv_sec = m_next_connect;
+            m_maintain.timedwait(lock.get(), t);
+            if (m_stop) break;
+        }
+        lock.unlock();
+
+        grow();
+        check_idle();
+        shrink();
+
+        lock.lock();
+    }
+    lock.unlock();
+}
+
+void connection_pool::grow() {
+    while (true) {
+        lock.lock();
+        bool need_grow = !m_stop && total() < MaxConn && (total() < MinConn || FreeConn < SpareConn)
+                         && time(NULL) >= m_next_connect;
+        if (!need_grow) {
+            lock.unlock();
+            return;
+        }
+        ++m_connecting;
+        lock.unlock();
+
+        // 在锁外完成TCP连接和认证
+        MYSQL* con = connect();
+
+        lock.lock();
+        connected(con);
+        lock.unlock();
+
+        if (!con) return;
+    }
+}
+
+void connection_pool::check_idle() {
+    list<idle_conn> checking;
+    time_t cur = time(NULL);
+
+    // 取出长时间未检查的空闲连接，检查期间计入使用中的连接
+    lock.lock();
+    list<idle_conn>::iterator it = connList.begin();
+    while (it != connList.end()) {
+        if (cur - it->last_check >= PING_INTERVAL) {
+            checking.push_back(*it);
+            it = connList.erase(it);
+            --FreeConn;
+            ++CurConn;
+        } else ++it;
+    }
+    lock.unlock();
+
+    if (checking.empty()) return;
+
+    // 在锁外ping，断开的连接直接关闭
+    for (it = checking.begin(); it != checking.end(); ++it) {
+        if (mysql_ping(it->conn) == 0) {
+            it->last_check = cur;
+            continue;
+        }
+        LOG_ERROR("evict dead mysql connection:%s", mysql_error(it->conn));
+        close_conn(it->conn);
+        it->conn = NULL;
+    }
+
+    // 存活的连接放回链表尾端（保持原来的空闲时间，不影响shrink）
+    lock.lock();
+    for (it = checking.begin(); it != checking.end(); ++it) {
+        --CurConn;
+        if (!it->conn) continue;
+        put_idle(*it, false);
+    }
+    lock.unlock();
+}
+
+void connection_pool::shrink() {
+    list<MYSQL*> closing;
+    time_t cur = time(NULL);
+
+    // 从链表尾端关闭多余的空闲连接，保留预热连接和最小连接数
+    lock.lock();
+    while (FreeConn > SpareConn && total() > MinConn && !connList.empty()
+           && cur - connList.back().last_used >= IDLE_TIMEOUT) {
+        closing.push_back(connList.back().conn);
+        connList.pop_back();
+        --FreeConn;
+    }
+    lock.unlock();
+
+    list<MYSQL*>::iterator it;
+    for (it = closing.begin(); it != closing.end(); ++it) close_conn(*it);
+}
+
 connectionRAII::connectionRAII(MYSQL** SQL, connection_pool* connPool) {
     *SQL = connPool->GetConnection();
     conRAII = *SQL;
@@ -119,4 +498,4 @@ connectionRAII::connectionRAII(MYSQL** SQL, connection_pool* connPool) {
 
 connectionRAII::~connectionRAII() {
     poolRAII->ReleaseConnection(conRAII);
-}
\ No newline at end of file
+}
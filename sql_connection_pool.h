@@ -4,23 +4,54 @@
 #include <string>
 #include <mysql/mysql.h>
 #include <list>
+#include <map>
+#include <time.h>
 
 #include "lock.h"
+#include "histogram.h"
 
 using namespace std;
 
+// 每条连接上缓存的预编译语句，建立连接时mysql_stmt_prepare一次，之后只需绑定参数执行
+enum SQL_STMT {
+    STMT_SELECT_USER = 0,  // 按用户名查询密码
+    STMT_INSERT_USER,  // 插入新用户
+    STMT_COUNT
+};
+
 class connection_pool {
 public:
+    static const int CHECK_INTERVAL = 5;  // 维护线程的检查周期（秒）
+    static const int PING_INTERVAL = 30;  // 空闲超过该时间的连接需要用mysql_ping检查是否存活（秒）
+    static const int IDLE_TIMEOUT = 60;  // 多余的空闲连接超过该时间后关闭（秒）
+    static const int MAX_BACKOFF = 32;  // 重连失败后的最大退避时间（秒）
+    static const int WAIT_TIMEOUT = 500;  // 获取连接的默认等待时间（毫秒）
+    static const unsigned int QUERY_TIMEOUT = 10;  // 连接上每次读写的超时时间（秒），数据库停止响应时查询以连接断开失败
+
+    // 连接池统计信息（等待时间和持有时间单位为微秒）
+    struct pool_stats {
+        unsigned int max_conn;  // 最大连接数
+        unsigned int cur_conn;  // 使用中的连接数
+        unsigned int free_conn;  // 空闲连接数
+        unsigned int waiting;  // 正在等待连接的线程数
+        unsigned long long timeouts;  // 等待超时（获取失败）的次数
+        histogram wait_us;  // 获取连接的等待时间
+        histogram hold_us;  // 连接从获取到归还的持有时间
+        histogram in_use;  // 每次获取连接后使用中的连接数
+    };
+
     // 局部静态变量单例模式
     static connection_pool* GetInstance();
 
-    // 构造初始化（主机地址、数据库用户名、数据库登录密码、数据库名、数据库端口号、最大连接数）
-    void init(string url, string User, string PassWord, string DatabaseName, int Port, unsigned int MaxConn);
+    // 构造初始化（主机地址、数据库用户名、数据库登录密码、数据库名、数据库端口号、最大连接数、最小连接数、预热的空闲连接数）
+    // 最小连接数的连接由临时线程并行建立，init不等待连接完成
+    void init(string url, string User, string PassWord, string DatabaseName, int Port, unsigned int MaxConn,
+              unsigned int MinConn = 2, unsigned int SpareConn = 2);
 
-    // 获取数据库连接
-    MYSQL* GetConnection();
+    // 获取数据库连接，最多等待timeout毫秒（小于0表示一直等待），等待的线程按先来先服务的顺序获得连接，超时返回NULL
+    MYSQL* GetConnection(int timeout = WAIT_TIMEOUT);
 
-    // 释放连接
+    // 释放连接（连接已经断开则直接关闭，由维护线程补充新的连接）
     bool ReleaseConnection(MYSQL* conn);
 
     // 销毁连接池
@@ -29,22 +60,101 @@ public:
     // 获取当前空闲连接数
     int GetFreeConn();
 
+    // 获取统计信息的快照
+    void GetStats(pool_stats* stats);
+
+    // 等待init中并行建立的连接全部完成（成功或者失败），返回当前的连接数
+    unsigned int WaitStartup();
+
+    // 获取连接conn上缓存的预编译语句（调用者必须持有该连接），没有缓存时当场预编译，失败返回NULL
+    MYSQL_STMT* GetStatement(MYSQL* conn, SQL_STMT id);
+
     connection_pool();
     ~connection_pool();
+
 private:
+    // 空闲连接及其归还时间、上次检查存活的时间
+    struct idle_conn {
+        MYSQL* conn;
+        time_t last_used;
+        time_t last_check;
+    };
+
+    // 等待连接的线程，归还的连接直接交给队首的等待者，保证先来先服务
+    struct waiter {
+        cond m_cond;  // 获得连接或者需要重新判断时唤醒
+        MYSQL* conn;  // 交给该线程的连接
+    };
+
+    // 连接变为空闲：有等待者则直接交给队首等待者，否则放入连接池（调用前需要加锁）
+    void put_idle(const idle_conn& idle, bool front);
+    // 取出一条连接后的统计（调用前需要加锁）
+    void on_acquire(MYSQL* con, long long wait_us);
+    // 唤醒所有等待者重新判断是否需要放弃等待（调用前需要加锁）
+    void wake_waiters();
+
+    // 维护线程：检查空闲连接是否存活、补充预热连接、关闭多余的空闲连接
+    static void* maintain_thread(void* arg);
+    void maintain();
+    // 启动时建立一条连接的临时线程
+    static void* connect_thread(void* arg);
+    // 建立一条新连接并预编译语句，失败返回NULL
+    MYSQL* connect();
+    // 新连接建立完成：成功则放入连接池，失败（con为NULL）则退避重连（调用前需要加锁）
+    void connected(MYSQL* con);
+    // 关闭连接及其缓存的预编译语句（调用前不能加锁）
+    void close_conn(MYSQL* con);
+    // 在连接上预编译一条语句，失败返回NULL
+    static MYSQL_STMT* prepare(MYSQL* con, SQL_STMT id);
+    // 按照最小连接数和预热连接数补充连接，连接失败则按指数退避
+    void grow();
+    // 用mysql_ping检查长时间空闲的连接，剔除已经断开的连接
+    void check_idle();
+    // 关闭超过预热数量且长时间空闲的连接
+    void shrink();
+    // 连接总数（使用中、空闲和正在建立的连接）
+    unsigned int total() {
+        return CurConn + FreeConn + m_connecting;
+    }
 
+private:
     string url;  // 主机地址
-    string Port;  // 数据库端口号
+    int Port;  // 数据库端口号
     string User;  // 登录数据库用户名
     string PassWord;  // 登录数据库密码
     string DatabaseName;  // 使用数据库名
     unsigned int MaxConn;  // 最大的连接数
+    unsigned int MinConn;  // 最小的连接数
+    unsigned int SpareConn;  // 保持预热的空闲连接数，负载突增时不需要等待TCP连接和认证
     unsigned int CurConn; // 当前已使用的连接数
     unsigned int FreeConn;  // 当前空闲的连接数
+    unsigned int m_connecting;  // 维护线程和启动线程正在建立的连接数
+    unsigned int m_starting;  // 启动时并行建立、还没有完成的连接数
 
     mutex lock;  // 互斥锁
-    list<MYSQL*> connList;  // 连接池
-    sem reserve;  // 信号量
+    list<idle_conn> connList;  // 连接池（空闲连接）
+    list<waiter*> m_waiters;  // 等待连接的线程（先进先出）
+    cond m_maintain;  // 唤醒维护线程立即补充连接
+    cond m_startup;  // 启动时的连接全部完成时广播
+
+    pthread_t m_tid;  // 维护线程
+    bool m_started;  // 维护线程是否已经启动
+    bool m_stop;  // 是否结束维护线程
+    int m_backoff;  // 当前的重连退避时间（秒），0表示上次连接成功
+    time_t m_next_connect;  // 退避期间下一次允许重连的时间
+
+    // 每条连接的预编译语句缓存（在lock保护下访问）
+    struct stmt_cache {
+        MYSQL_STMT* stmt[STMT_COUNT];
+    };
+    map<MYSQL*, stmt_cache> m_stmts;
+
+    // 统计信息（在lock保护下更新）
+    map<MYSQL*, long long> m_acquire_time;  // 使用中的连接被取出的时间（微秒）
+    unsigned long long m_timeouts;  // 等待超时的次数
+    histogram m_wait_hist;  // 获取连接的等待时间
+    histogram m_hold_hist;  // 连接的持有时间
+    histogram m_inuse_hist;  // 获取连接后使用中的连接数
 };
 
 
@@ -61,4 +171,4 @@ private:
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "startup.h"
+#include "http_conn.h"
+#include "latency.h"
+#include "metrics.h"
+#include "log.h"
+
+static const char* const task_names[startup::TASKS] = {"db_pool", "user_table", "file_cache"};
+
+startup* startup::get_instance() {
+    static startup instance;
+    return &instance;
+}
+
+startup::startup()
+    : m_pool(NULL), m_cache_size(0), m_fp_rate(0), m_warm_bytes(0), m_start_ns(latency::now()), m_done(0),
+      m_files(0), m_file_bytes(0) {
+    memset(m_elapsed_ns, 0, sizeof(m_elapsed_ns));
+    memset(m_ok, 0, sizeof(m_ok));
+}
+
+bool startup::run(connection_pool* pool, int cache_size, double fp_rate, const char* doc_root, long long warm_bytes) {
+    m_pool = pool;
+    m_cache_size = cache_size;
+    m_fp_rate = fp_rate;
+    m_doc_root = doc_root;
+    m_warm_bytes = warm_bytes;
+    LOG_INFO("startup: listening after %llu ms", (unsigned long long)((latency::now() - m_start_ns) / 1000000));
+
+    // 两个预热线程执行完就结束，不需要join
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, user_table_thread, this) != 0) {
+        LOG_ERROR("%s", "create user table thread error");
+        finish(DB_POOL, false);
+        finish(USER_TABLE, false);
+    } else {
+        pthread_detach(tid);
+    }
+    if (pthread_create(&tid, NULL, file_cache_thread, this) != 0) {
+        LOG_ERROR("%s", "create file cache thread error");
+        finish(FILE_CACHE, false);
+    } else {
+        pthread_detach(tid);
+    }
+    return true;
+}
+
+void* startup::user_table_thread(void* arg) {
+    startup* s = (startup*)arg;
+    // 连接池启动时的连接都完成后再载入用户表，避免在等待连接时超时
+    unsigned int conns = s->m_pool->WaitStartup();
+    s->finish(DB_POOL, conns > 0);
+    s->finish(USER_TABLE, http_conn::initmysql_result(s->m_pool, s->m_cache_size, s->m_fp_rate));
+    return NULL;
+}
+
+void* startup::file_cache_thread(void* arg) {
+    startup* s = (startup*)arg;
+    s->warm_files();
+    s->finish(FILE_CACHE, true);
+    return NULL;
+}
+
+// nftw的回调没有用户参数，预热线程只有一个，用静态变量传递
+static long long g_warm_budget = 0;
+static uint64_t g_warm_files = 0;
+static uint64_t g_warm_bytes = 0;
+
+static int warm_file(const char* path, const struct stat* st, int type, struct FTW*) {
+    if (type != FTW_F || !S_ISREG(st->st_mode) || st->st_size == 0) return 0;
+    if (g_warm_budget < st->st_size) return 0;  // 超出预读上限的大文件跳过，继续预读较小的文件
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    // 由内核异步读入页面缓存，之后请求中的mmap不需要等待磁盘
+    posix_fadvise(fd, 0, st->st_size, POSIX_FADV_WILLNEED);
+    close(fd);
+
+    g_warm_budget -= st->st_size;
+    ++g_warm_files;
+    g_warm_bytes += st->st_size;
+    return 0;
+}
+
+void startup::warm_files() {
+    if (m_warm_bytes <= 0 || m_doc_root.empty()) return;
+    g_warm_budget = m_warm_bytes;
+    g_warm_files = 0;
+    g_warm_bytes = 0;
+    // 不跟随符号链接，最多同时打开16个目录
+    if (nftw(m_doc_root.c_str(), warm_file, 16, FTW_PHYS) != 0) {
+        LOG_ERROR("startup: walk %s error", m_doc_root.c_str());
+    }
+    m_files = g_warm_files;
+    m_file_bytes = g_warm_bytes;
+}
+
+void startup::finish(TASK task, bool ok) {
+    m_elapsed_ns[task] = latency::now() - m_start_ns;
+    m_ok[task] = ok;
+    if (task == FILE_CACHE) {
+        LOG_INFO("startup: %s %s in %llu ms, %llu files %llu bytes", task_names[task], ok ? "done" : "failed",
+                 (unsigned long long)(m_elapsed_ns[task] / 1000000), (unsigned long long)m_files,
+                 (unsigned long long)m_file_bytes);
+    } else {
+        LOG_INFO("startup: %s %s in %llu ms", task_names[task], ok ? "done" : "failed",
+                 (unsigned long long)(m_elapsed_ns[task] / 1000000));
+    }
+
+    // 最后一个完成的任务负责通知（耗时和结果在置位之前写入）
+    unsigned int done = __atomic_or_fetch(&m_done, 1u << task, __ATOMIC_ACQ_REL);
+    if (done == (1u << TASKS) - 1) {
+        LOG_INFO("startup: ready after %llu ms", (unsigned long long)((latency::now() - m_start_ns) / 1000000));
+        notify_ready();
+    }
+}
+
+void startup::notify_ready() {
+    const char* path = getenv("NOTIFY_SOCKET");
+    if (!path || (path[0] != '/' && path[0] != '@')) return;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    size_t len = strlen(path);
+    if (len >= sizeof(addr.sun_path)) return;
+    memcpy(addr.sun_path, path, len);
+    if (path[0] == '@') addr.sun_path[0] = '\0';  // 抽象命名空间
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return;
+    const char* msg = "READY=1";
+    if (sendto(fd, msg, strlen(msg), 0, (struct sockaddr*)&addr, offsetof(struct sockaddr_un, sun_path) + len) < 0) {
+        LOG_ERROR("startup: notify %s error", path);
+    }
+    close(fd);
+}
+
+void startup::render(std::string& out) {
+    unsigned int done = __atomic_load_n(&m_done, __ATOMIC_ACQUIRE);
+    metrics::append(out, "webserver_ready", "gauge", "Whether all startup warm-up tasks have finished.",
+                    done == (1u << TASKS) - 1);
+
+    char labels[64];
+    bool first = true;
+    for (int t = 0; t < TASKS; ++t) {
+        if (!(done & (1u << t))) continue;
+        snprintf(labels, sizeof(labels), "task=\"%s\",result=\"%s\"", task_names[t], m_ok[t] ? "ok" : "failed");
+        if (first) {
+            metrics::append(out, "webserver_startup_seconds", "gauge",
+                            "Time from process start until a startup task finished.", m_elapsed_ns[t] / 1e9, labels);
+            first = false;
+        } else {
+            metrics::append_sample(out, "webserver_startup_seconds", m_elapsed_ns[t] / 1e9, labels);
+        }
+    }
+}
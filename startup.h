@@ -0,0 +1,65 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdint.h>
+#include <string>
+
+class connection_pool;
+
+// 启动预热：监听socket创建之后，耗时的初始化在后台线程中并行完成，期间服务器已经在处理请求——
+// 静态页面直接服务，登录和注册在用户表载入之前直接查询数据库（布隆过滤器载入完成前不跳过重名查询）。
+// 一个线程等待连接池的并行连接完成后载入用户表，另一个线程预读网站根目录下的文件到页面缓存。
+// 全部完成后记录耗时、/ready返回200，并在由systemd启动（设置了NOTIFY_SOCKET）时发送READY=1
+class startup {
+public:
+    // 预热任务
+    enum TASK {
+        DB_POOL = 0,  // 连接池启动时的连接
+        USER_TABLE,  // 载入用户表（布隆过滤器和用户缓存）
+        FILE_CACHE,  // 预读静态文件
+        TASKS
+    };
+
+    // 局部静态变量单例模式，第一次调用时开始计算启动耗时
+    static startup* get_instance();
+
+    // 启动预热线程后立即返回；cache_size和fp_rate传给initmysql_result，warm_bytes为最多预读的字节数（0表示不预读）
+    bool run(connection_pool* pool, int cache_size, double fp_rate, const char* doc_root, long long warm_bytes);
+
+    // 所有预热任务是否都已经完成（成功或者失败）
+    bool ready() {
+        return __atomic_load_n(&m_done, __ATOMIC_ACQUIRE) == (1u << TASKS) - 1;
+    }
+
+    // 按Prometheus文本格式输出是否就绪以及各任务的耗时
+    void render(std::string& out);
+
+private:
+    startup();
+
+    // 任务完成，全部完成时记录日志并通知systemd
+    void finish(TASK task, bool ok);
+
+    static void* user_table_thread(void* arg);
+    static void* file_cache_thread(void* arg);
+    void warm_files();
+
+    // 通过NOTIFY_SOCKET通知systemd服务已经就绪（sd_notify协议）
+    static void notify_ready();
+
+private:
+    connection_pool* m_pool;
+    int m_cache_size;
+    double m_fp_rate;
+    std::string m_doc_root;
+    long long m_warm_bytes;
+
+    uint64_t m_start_ns;  // 开始计时的时间（单调时钟）
+    uint64_t m_elapsed_ns[TASKS];  // 各任务完成时距离开始的时间
+    bool m_ok[TASKS];  // 各任务是否成功
+    unsigned int m_done;  // 已经完成的任务（按位）
+    uint64_t m_files;  // 预读的文件数
+    uint64_t m_file_bytes;  // 预读的字节数
+};
+
+#endif
@@ -1,42 +1,59 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
-<<<<<<< HEAD
-=======
 #include <pthread.h>
->>>>>>> bf7723c55c92d67fd49ab6503b8fc273c0bdb8fd
 #include <list>
 #include <cstdio>
 
 #include "lock.h"
-#include "sql_connection_pool.h"
+#include "metrics.h"
+#include "latency.h"
 
 // 线程池定义为模板类，实现代码复用，其中T是任务类
+// 准入控制（参考CoDel）：工作线程出队时记录请求的排队时间，每个间隔（interval）结束时如果这个间隔内的最小排队时间
+// 仍然超过目标（target），说明队列一直没有排空，是持续的过载而不是突发。过载时队头已经等待超过target就拒绝新请求，
+// 否则超过interval才拒绝，排队时间因此有上界，超出处理能力的请求由调用者快速返回503，而不是在队列里等到超时
 template <typename T>
 class threadpool {
 public:
-    threadpool(connection_pool* connPool, int thread_number = 8, int max_requests = 10000);  // 构造函数，默认创建8个线程，最大的请求数量是10000
+    // 构造函数，默认创建8个线程，最大的请求数量是10000，排队时间的目标和判断过载的间隔单位为毫秒
+    threadpool(int thread_number = 8, int max_requests = 10000, int target_ms = 5, int interval_ms = 100);
     ~threadpool();  // 析构函数
-    bool append(T* request);  // 将任务添加到请求队列
+    // 将任务添加到请求队列，队列已满或者排队时间过长时返回false；admit为false时不做准入检查（已经在处理中的请求，
+    // 例如异步查询完成后重新入队，丢弃会浪费已经完成的工作）
+    bool append(T* request, bool admit = true);
 
 private:
+    // 队列中的任务和入队时间
+    struct item {
+        T* request;
+        uint64_t time;
+    };
+
     static void* worker(void* arg);  // 线程处理函数
     void run();  // run执行任务，与worker分开写，因为run中使用了大量的类内成员，与worker不分开写就得写大量的pool->
+    void update(uint64_t now);  // 间隔结束时更新是否过载，调用时持有队列的锁
 
 private:
     int m_thread_number;  // 线程数量
     pthread_t* m_threads;  // 线程池数组，大小为m_thread_number
     int m_max_requests;  // 请求队列最多允许的请求数量
-    std::list<T*> m_workqueue;  // 请求队列
+    std::list<item> m_workqueue;  // 请求队列
     mutex m_queuelocker;  // 队列的互斥锁
     sem m_queuestate;  // 信号量用来判断是否有任务需要处理
     bool m_stop;  // 是否结束线程
-    connection_pool* m_connPoll;  // 数据库
+
+    // 准入控制相关变量（纳秒），都由队列的锁保护
+    uint64_t m_target;  // 排队时间的目标
+    uint64_t m_interval;  // 判断是否过载的间隔
+    uint64_t m_interval_end;  // 当前间隔结束的时间
+    uint64_t m_min_sojourn;  // 当前间隔内出队请求的最小排队时间
+    bool m_overloaded;  // 上一个间隔是否过载
 };
 
 template <typename T>
-threadpool<T>::threadpool(connection_pool* connPool, int thread_number, int max_requests) : 
-    m_connPoll(connPool), m_thread_number(thread_number), m_max_requests(max_requests), 
-    m_threads(NULL), m_stop(false) {  // 列表初始化
+threadpool<T>::threadpool(int thread_number, int max_requests, int target_ms, int interval_ms) : 
+    m_thread_number(thread_number), m_threads(NULL), m_max_requests(max_requests), m_stop(false), m_target(target_ms * 1000000ULL), m_interval(interval_ms * 1000000ULL),
+    m_interval_end(0), m_min_sojourn(UINT64_MAX), m_overloaded(false) {  // 列表初始化
 
     if (thread_number <= 0 || max_requests <= 0) throw std::exception();  // 如果输入参数不满足要求则抛出异常
     m_threads = new pthread_t[m_thread_number];  // 动态创建线程数组
@@ -67,17 +84,25 @@ threadpool<T>::~threadpool() {
 }
 
 template <typename T>
-bool threadpool<T>::append(T* request) {
+bool threadpool<T>::append(T* request, bool admit) {
+    uint64_t now = latency::now();
     m_queuelocker.lock();  // 队列上锁
 
-    // 如果当前工作队列已满，则队列解锁并退出程序
-    if (m_workqueue.size() > m_max_requests) {
-        m_queuelocker.unlock();
-        return false;
+    if (admit) {
+        update(now);
+        // 如果当前工作队列已满，或者队头等待的时间（新请求至少也要等这么久）超过上限，则队列解锁并拒绝
+        uint64_t limit = m_overloaded ? m_target : m_interval;
+        if ((int)m_workqueue.size() >= m_max_requests ||
+            (!m_workqueue.empty() && now - m_workqueue.front().time > limit)) {
+            m_queuelocker.unlock();
+            return false;
+        }
     }
 
     // 将任务添加到当前队列
-    m_workqueue.push_back(request);  // 尾插
+    item it = {request, now};
+    m_workqueue.push_back(it);  // 尾插
+    metrics::gauge_add(metrics::QUEUE_DEPTH, 1);
     m_queuelocker.unlock();  // 队列解锁
     m_queuestate.post();  // 队列信号量加1
     return true;  // 退出程序
@@ -102,17 +127,36 @@ void threadpool<T>::run() {
             continue;
         }
 
-        // 工作队列不为空，则从队头取任务并处理
-        T* request = m_workqueue.front();
+        // 工作队列不为空，则从队头取任务并处理，记录排队时间
+        T* request = m_workqueue.front().request;
+        uint64_t now = latency::now();
+        uint64_t sojourn = now - m_workqueue.front().time;
         m_workqueue.pop_front();
+        metrics::gauge_add(metrics::QUEUE_DEPTH, -1);
+        if (sojourn < m_min_sojourn) m_min_sojourn = sojourn;
+        update(now);
         m_queuelocker.unlock();
         if (!request) continue;
 
-        // 数据库
-        connectionRAII mysqlcon(&request->mysql, m_connPoll);
-
+        // 线程池不再为每个任务获取数据库连接，只有需要访问数据库的请求才会在查询时从连接池获取
         request->process();
     }
 }
+
+template <typename T>
+void threadpool<T>::update(uint64_t now) {
+    if (now < m_interval_end) return;
+
+    uint64_t sojourn = m_min_sojourn;
+    // 这个间隔内没有请求出队（工作线程全部阻塞）时，用队头已经等待的时间判断
+    if (sojourn == UINT64_MAX) sojourn = m_workqueue.empty() ? 0 : now - m_workqueue.front().time;
+    bool overloaded = sojourn > m_target;
+    if (overloaded != m_overloaded) {
+        m_overloaded = overloaded;
+        metrics::gauge_add(metrics::OVERLOADED, overloaded ? 1 : -1);
+    }
+    m_min_sojourn = UINT64_MAX;
+    m_interval_end = now + m_interval;
+}
     
 #endif
\ No newline at end of file
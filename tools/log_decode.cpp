@@ -0,0 +1,267 @@
+// 二进制日志解码工具：把Log二进制模式写出的文件还原为与文本模式相同格式的日志
+// 编译（在项目根目录）：g++ -O2 -I. tools/log_decode.cpp -o log_decode
+// 用法：./log_decode 日志文件...（不带参数或者参数为-时读取标准输入），结果写到标准输出
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "log_binary.h"
+
+using namespace std;
+
+// 与Log文本模式相同的级别标签
+static const char* const level_tags[] = {"[debug]:", "[info]:", "[warn]:", "[erro]:"};
+
+struct site {
+    bool defined;
+    int level;
+    string format;
+};
+
+struct arg {
+    char type;
+    int64_t i;
+    uint64_t u;
+    double f;
+    string s;
+};
+
+// 按格式字符串和记录中的参数还原日志内容
+static void format_message(const string& format, const vector<arg>& args, string& out) {
+    size_t next = 0;
+    char spec[64], buf[512];
+    const char* p = format.c_str();
+
+    while (*p) {
+        if (*p != '%') {
+            out += *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            p += 2;
+            continue;
+        }
+
+        // 解析转换说明：标志、宽度、精度、长度修饰符、转换字符
+        const char* start = p++;
+        int n = 0;
+        spec[n++] = '%';
+        int star = 0;
+        while (*p && strchr("-+ #0123456789.*", *p)) {
+            if (*p == '*') ++star;
+            if (n < 40) spec[n++] = *p;
+            ++p;
+        }
+        while (*p && strchr("hlLqjzt", *p)) ++p;  // 长度修饰符按参数的实际类型重新生成
+        char conv = *p;
+        if (conv == '\0') {
+            out.append(start);
+            break;
+        }
+        ++p;
+
+        // 宽度或精度为*时各消耗一个整数参数
+        int stars[2] = {0, 0};
+        for (int i = 0; i < star && i < 2; ++i) {
+            if (next < args.size()) stars[i] = (int)args[next++].i;
+        }
+        if (next >= args.size()) {
+            // 参数在写日志时被截断，原样输出转换说明
+            out.append(start, p - start);
+            continue;
+        }
+        const arg& a = args[next++];
+
+        int m = -1;
+        if (strchr("diouxXc", conv)) {
+            if (conv == 'c') {
+                spec[n++] = 'c';
+            } else {
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = conv;
+            }
+            spec[n] = '\0';
+            long long v = a.type == log_binary::ARG_INT ? (long long)a.i : (long long)a.u;
+            if (a.type == log_binary::ARG_DOUBLE) v = (long long)a.f;
+            if (conv == 'c') {
+                m = star == 0 ? snprintf(buf, sizeof(buf), spec, (int)v)
+                    : star == 1 ? snprintf(buf, sizeof(buf), spec, stars[0], (int)v)
+                                : snprintf(buf, sizeof(buf), spec, stars[0], stars[1], (int)v);
+            } else {
+                m = star == 0 ? snprintf(buf, sizeof(buf), spec, v)
+                    : star == 1 ? snprintf(buf, sizeof(buf), spec, stars[0], v)
+                                : snprintf(buf, sizeof(buf), spec, stars[0], stars[1], v);
+            }
+        } else if (strchr("fFeEgGaA", conv)) {
+            spec[n++] = conv;
+            spec[n] = '\0';
+            double v = a.type == log_binary::ARG_DOUBLE ? a.f
+                       : a.type == log_binary::ARG_INT ? (double)a.i
+                                                        : (double)a.u;
+            m = star == 0 ? snprintf(buf, sizeof(buf), spec, v)
+                : star == 1 ? snprintf(buf, sizeof(buf), spec, stars[0], v)
+                            : snprintf(buf, sizeof(buf), spec, stars[0], stars[1], v);
+        } else if (conv == 's') {
+            spec[n++] = 's';
+            spec[n] = '\0';
+            if (star == 0 && n == 2) {
+                out += a.s;  // 最常见的%s直接拼接，不受缓冲区长度限制
+                continue;
+            }
+            const char* v = a.type == log_binary::ARG_STR ? a.s.c_str() : "(?)";
+            m = star == 0 ? snprintf(buf, sizeof(buf), spec, v)
+                : star == 1 ? snprintf(buf, sizeof(buf), spec, stars[0], v)
+                            : snprintf(buf, sizeof(buf), spec, stars[0], stars[1], v);
+        } else if (conv == 'p') {
+            m = snprintf(buf, sizeof(buf), "%p", (void*)(uintptr_t)a.u);
+        } else {
+            out.append(start, p - start);
+            continue;
+        }
+        if (m > 0) out.append(buf, m < (int)sizeof(buf) ? m : (int)sizeof(buf) - 1);
+    }
+}
+
+// 解析一条日志的参数
+static bool parse_args(const char* p, const char* end, vector<arg>& args) {
+    args.clear();
+    while (p < end) {
+        arg a;
+        a.type = *p++;
+        a.i = 0;
+        a.u = 0;
+        a.f = 0;
+        if (a.type == log_binary::ARG_STR) {
+            if (end - p < 2) return false;
+            uint16_t len;
+            memcpy(&len, p, 2);
+            p += 2;
+            if (end - p < len) return false;
+            a.s.assign(p, len);
+            p += len;
+        } else {
+            if (end - p < 8) return false;
+            if (a.type == log_binary::ARG_INT) {
+                memcpy(&a.i, p, 8);
+            } else if (a.type == log_binary::ARG_DOUBLE) {
+                memcpy(&a.f, p, 8);
+            } else if (a.type == log_binary::ARG_UINT || a.type == log_binary::ARG_PTR) {
+                memcpy(&a.u, p, 8);
+                a.i = (int64_t)a.u;
+            } else {
+                return false;
+            }
+            p += 8;
+        }
+        args.push_back(a);
+    }
+    return true;
+}
+
+// 解码一个文件，返回是否完整解码
+static bool decode(FILE* in, const char* name, FILE* out) {
+    string data;
+    char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) data.append(chunk, n);
+
+    if (data.size() < (size_t)log_binary::MAGIC_LEN || memcmp(data.data(), log_binary::MAGIC, log_binary::MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a binary log\n", name);
+        return false;
+    }
+
+    vector<site> sites;
+    vector<arg> args;
+    string line;
+    time_t cached_sec = -1;
+    char prefix[64];
+    size_t pos = log_binary::MAGIC_LEN;
+
+    while (pos < data.size()) {
+        const char* rec = data.data() + pos;
+        // 旧版本在同一天重启后会在文件中间再写入MAGIC，之后是新进程的调用点编号
+        if (data.size() - pos >= (size_t)log_binary::MAGIC_LEN && memcmp(rec, log_binary::MAGIC, log_binary::MAGIC_LEN) == 0) {
+            sites.clear();
+            pos += log_binary::MAGIC_LEN;
+            continue;
+        }
+        if (data.size() - pos < (size_t)log_binary::HEADER_LEN) break;
+        uint16_t len;
+        memcpy(&len, rec, 2);
+        int type = (unsigned char)rec[2];
+        if (len < log_binary::HEADER_LEN || data.size() - pos < len) break;
+
+        if (type == log_binary::REC_SITE && len >= log_binary::SITE_HEADER_LEN) {
+            uint32_t id;
+            memcpy(&id, rec + log_binary::HEADER_LEN, 4);
+            if (id >= sites.size()) sites.resize(id + 1);
+            sites[id].defined = true;
+            sites[id].level = (unsigned char)rec[log_binary::HEADER_LEN + 4];
+            if (sites[id].level > 3) sites[id].level = 1;
+            sites[id].format.assign(rec + log_binary::SITE_HEADER_LEN, len - log_binary::SITE_HEADER_LEN);
+        } else if (type == log_binary::REC_EVENT && len >= log_binary::EVENT_HEADER_LEN) {
+            uint32_t id;
+            uint64_t usec;
+            memcpy(&id, rec + log_binary::HEADER_LEN, 4);
+            memcpy(&usec, rec + log_binary::HEADER_LEN + 4, 8);
+            if (id >= sites.size() || !sites[id].defined) {
+                fprintf(stderr, "%s: offset %zu: undefined call site %u\n", name, pos, id);
+            } else if (!parse_args(rec + log_binary::EVENT_HEADER_LEN, rec + len, args)) {
+                fprintf(stderr, "%s: offset %zu: malformed arguments\n", name, pos);
+            } else {
+                // 与Log::write_log相同的格式：时间+微秒+级别+内容
+                time_t sec = usec / 1000000;
+                if (sec != cached_sec) {
+                    struct tm tm;
+                    localtime_r(&sec, &tm);
+                    snprintf(prefix, sizeof(prefix), "%d-%02d-%02d %02d:%02d:%02d.", tm.tm_year + 1900, tm.tm_mon + 1,
+                             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+                    cached_sec = sec;
+                }
+                char us[16];
+                snprintf(us, sizeof(us), "%06d ", (int)(usec % 1000000));
+                line = prefix;
+                line += us;
+                line += level_tags[sites[id].level];
+                format_message(sites[id].format, args, line);
+                line += '\n';
+                fwrite(line.data(), 1, line.size(), out);
+            }
+        }
+        // 未知类型的记录按长度跳过
+        pos += len;
+    }
+
+    if (pos < data.size()) {
+        fprintf(stderr, "%s: truncated record at offset %zu\n", name, pos);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    bool ok = true;
+    if (argc < 2) return decode(stdin, "-", stdout) ? 0 : 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-") == 0) {
+            ok = decode(stdin, "-", stdout) && ok;
+            continue;
+        }
+        FILE* fp = fopen(argv[i], "rb");
+        if (!fp) {
+            perror(argv[i]);
+            ok = false;
+            continue;
+        }
+        ok = decode(fp, argv[i], stdout) && ok;
+        fclose(fp);
+    }
+    return ok ? 0 : 1;
+}
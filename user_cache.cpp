@@ -0,0 +1,115 @@
+#include "user_cache.h"
+
+user_cache::user_cache() {
+    init(DEFAULT_CAPACITY);
+}
+
+// 单例模式
+user_cache* user_cache::get_instance() {
+    static user_cache instance;
+    return &instance;
+}
+
+void user_cache::init(int capacity) {
+    int per_shard = capacity / SHARDS;
+    if (per_shard < 1) per_shard = 1;
+
+    for (int i = 0; i < SHARDS; ++i) {
+        shard& s = m_shards[i];
+        s.lock.wrlock();
+        s.index.clear();
+        s.slots.clear();
+        s.hand = 0;
+        s.capacity = per_shard;
+        s.hits = s.misses = s.evictions = 0;
+        s.lock.unlock();
+    }
+}
+
+uint32_t user_cache::hash(const char* name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; ++p) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+user_cache::LOOKUP user_cache::check(const char* name, const char* passwd) {
+    shard& s = get_shard(name);
+    LOOKUP ret = USER_MISS;
+
+    s.lock.rdlock();
+    unordered_map<string, int>::iterator it = s.index.find(name);
+    if (it != s.index.end()) {
+        entry& e = s.slots[it->second];
+        touch(e);
+        ret = e.passwd == passwd ? USER_MATCH : USER_MISMATCH;
+    }
+    s.lock.unlock();
+
+    __atomic_fetch_add(ret == USER_MISS ? &s.misses : &s.hits, 1, __ATOMIC_RELAXED);
+    return ret;
+}
+
+bool user_cache::contains(const char* name) {
+    shard& s = get_shard(name);
+
+    s.lock.rdlock();
+    unordered_map<string, int>::iterator it = s.index.find(name);
+    bool found = it != s.index.end();
+    if (found) touch(s.slots[it->second]);
+    s.lock.unlock();
+
+    __atomic_fetch_add(found ? &s.hits : &s.misses, 1, __ATOMIC_RELAXED);
+    return found;
+}
+
+void user_cache::put(const char* name, const char* passwd) {
+    shard& s = get_shard(name);
+
+    s.lock.wrlock();
+    unordered_map<string, int>::iterator it = s.index.find(name);
+    if (it != s.index.end()) {
+        // 已经缓存，更新密码
+        entry& e = s.slots[it->second];
+        e.passwd = passwd;
+        e.ref = 1;
+    } else if ((int)s.slots.size() < s.capacity) {
+        // 分片未满，直接追加
+        entry e = {name, passwd, 0};
+        s.slots.push_back(e);
+        s.index[name] = s.slots.size() - 1;
+    } else {
+        // 分片已满，CLOCK指针跳过最近访问过的用户（清除其标记），替换第一个没有访问标记的用户
+        while (s.slots[s.hand].ref) {
+            s.slots[s.hand].ref = 0;
+            s.hand = (s.hand + 1) % s.capacity;
+        }
+        entry& e = s.slots[s.hand];
+        s.index.erase(e.name);
+        e.name = name;
+        e.passwd = passwd;
+        e.ref = 0;
+        s.index[name] = s.hand;
+        s.hand = (s.hand + 1) % s.capacity;
+        __atomic_fetch_add(&s.evictions, 1, __ATOMIC_RELAXED);
+    }
+    s.lock.unlock();
+}
+
+void user_cache::get_stats(cache_stats* stats) {
+    stats->hits = stats->misses = stats->evictions = 0;
+    stats->size = stats->capacity = 0;
+
+    for (int i = 0; i < SHARDS; ++i) {
+        shard& s = m_shards[i];
+        s.lock.rdlock();
+        stats->size += s.slots.size();
+        stats->capacity += s.capacity;
+        s.lock.unlock();
+        stats->hits += __atomic_load_n(&s.hits, __ATOMIC_RELAXED);
+        stats->misses += __atomic_load_n(&s.misses, __ATOMIC_RELAXED);
+        stats->evictions += __atomic_load_n(&s.evictions, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef USER_CACHE_H
+#define USER_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "lock.h"
+
+using namespace std;
+
+// 进程内共享的用户名和密码缓存
+// 按用户名的哈希分为SHARDS个分片，每个分片一把读写锁，登录校验只加读锁，多个工作线程可以同时查询；
+// 容量有上限，满了以后按CLOCK算法（近似LRU）淘汰最近没有被访问的用户，未命中时由调用者回源数据库再放入缓存
+class user_cache {
+public:
+    static const int SHARDS = 64;  // 分片数（2的幂）
+    static const int DEFAULT_CAPACITY = 1 << 20;  // 默认最多缓存的用户数
+
+    // 登录校验的结果
+    enum LOOKUP {
+        USER_MISS = 0,  // 缓存中没有该用户，需要查询数据库
+        USER_MATCH,  // 用户存在且密码正确
+        USER_MISMATCH  // 用户存在但密码错误
+    };
+
+    // 统计信息
+    struct cache_stats {
+        uint64_t hits;  // 命中次数
+        uint64_t misses;  // 未命中次数
+        uint64_t evictions;  // 淘汰次数
+        unsigned int size;  // 当前缓存的用户数
+        unsigned int capacity;  // 容量
+    };
+
+    // 局部静态变量单例模式
+    static user_cache* get_instance();
+
+    // 设置容量，需要在使用前调用
+    void init(int capacity = DEFAULT_CAPACITY);
+
+    // 校验用户名和密码（只加读锁）
+    LOOKUP check(const char* name, const char* passwd);
+
+    // 用户名是否在缓存中（只加读锁）
+    bool contains(const char* name);
+
+    // 放入或更新一个用户（加写锁），分片满了则淘汰一个最近没有被访问的用户
+    void put(const char* name, const char* passwd);
+
+    // 汇总所有分片的统计信息
+    void get_stats(cache_stats* stats);
+
+private:
+    user_cache();
+
+    // 一个缓存的用户，ref为CLOCK算法的访问标记
+    struct entry {
+        string name;
+        string passwd;
+        unsigned char ref;
+    };
+
+    // 分片按缓存行对齐，避免不同分片的锁和计数器之间的伪共享
+    struct alignas(64) shard {
+        rwlock lock;
+        unordered_map<string, int> index;  // 用户名到slots下标的映射
+        vector<entry> slots;  // 缓存的用户，达到容量后原地替换
+        int hand;  // CLOCK算法的指针
+        int capacity;  // 分片的容量
+        uint64_t hits;  // 以下计数器用原子操作更新
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+    // FNV-1a哈希，用于选择分片
+    static uint32_t hash(const char* name);
+    shard& get_shard(const char* name) {
+        return m_shards[hash(name) & (SHARDS - 1)];
+    }
+    // 在读锁下标记访问（已经标记过则不写，避免读者之间争抢缓存行）
+    static void touch(entry& e) {
+        if (!__atomic_load_n(&e.ref, __ATOMIC_RELAXED)) __atomic_store_n(&e.ref, 1, __ATOMIC_RELAXED);
+    }
+
+private:
+    shard m_shards[SHARDS];
+};
+
+#endif